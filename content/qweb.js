@@ -1,32 +1,272 @@
+/**
+ * qweb browser client: calls to POST callbacks, WebSockets and helpers.
+ * qweb.min.js is generated from this file by tools/qweb_minify.py, and is
+ * embedded with qweb_embed_client and served with QWEB_CLIENT.
+ */
+
+
+/**
+ * Client settings, to change before the first call
+ */
+var qweb_config = {
+    // Path of the server's batch endpoint (QWEB_BATCH_PATH, see qweb_register_batch).
+    // Calls made in the same tick are sent there together, null to send them one by one.
+    batch_path: "/qweb/batch",
+    // Most requests in flight at once, the others wait for one to finish. Keeps
+    // some of the server's max_sockets (7 by default, 4 with SSL) free for
+    // page loads, Server-Sent Events and WebSockets.
+    max_requests: 4,
+    // Timeout of each call in milliseconds, 0 for none
+    timeout: 0
+};
+
+
+/**
+ * The failure of a call
+ */
+class QwebError extends Error {
+    /**
+     * @param {number} status HTTP status, 0 without a response (network error, timeout, abort)
+     * @param {string} body response text
+     * @param {string} message description, the status by default
+     */
+    constructor(status, body, message) {
+        super(message || "qweb: HTTP " + status);
+        this.name = "QwebError";
+        this.status = status;
+        this.body = body;
+    }
+}
+
+
+let qweb_queue = [];        // calls made during this tick
+let qweb_waiting = [];      // requests waiting for one in flight to finish
+let qweb_active = 0;        // requests in flight
+
+
+/**
+ * Call a qweb POST callback. Calls made in the same tick are coalesced into
+ * a single request to qweb_config.batch_path.
+ *
+ * @param {string} path qweb registered path for callback
+ * @param {Uint8Array|ArrayBuffer|string|any} data bytes, text (sent as UTF-8), or any other value (sent as JSON)
+ * @param {{type: string, timeout: number, signal: AbortSignal}} options (all optional)
+ *  - type: what the promise resolves to, "text" (default), "json" or "bytes" (a Uint8Array)
+ *  - timeout: in milliseconds, qweb_config.timeout by default
+ *  - signal: abort the call, as with fetch
+ * @returns {Promise} the response, rejected with a QwebError unless the status is 200
+ */
+function qweb_call(path, data, options) {
+    options = options || {};
+    return new Promise((resolve, reject) => {
+        let timer = 0;
+        const call = { path: path, data: qweb_bytes(data), type: options.type || "text", done: false, abort: null };
+        call.resolve = (value) => {
+            if (call.done) return;
+            call.done = true;
+            clearTimeout(timer);
+            resolve(value);
+        };
+        call.reject = (err) => {
+            if (call.done) return;
+            call.done = true;
+            clearTimeout(timer);
+            reject(err);
+            if (call.abort) call.abort();
+        };
+
+        const timeout = options.timeout === undefined ? qweb_config.timeout : options.timeout;
+        if (timeout) timer = setTimeout(() => call.reject(new QwebError(0, "", "qweb: timeout")), timeout);
+        if (options.signal) {
+            if (options.signal.aborted) return call.reject(new QwebError(0, "", "qweb: aborted"));
+            options.signal.addEventListener("abort", () => call.reject(new QwebError(0, "", "qweb: aborted")));
+        }
+
+        qweb_queue.push(call);
+        if (qweb_queue.length == 1) Promise.resolve().then(qweb_flush);
+    });
+}
+
+
 /**
  * Make a request to a qweb POST callback
- * 
+ *
  * @param {string} path qweb registered path for callback
  * @param {Uint8Array} data raw byte data
  * @param {CallableFunction(string)} success Callback for a successful response
  * @param {CallableFunction(string)} failure Callback for a failure response
  */
-function qweb(path, data, success, failure){
-    const http = new XMLHttpRequest();
-    http.open("POST", path);
-    http.setRequestHeader('Content-type', 'application/octet-stream');
-    http.onloadend = () => {
-        if (http.status == 200) {
-            if (success) success(http.responseText);
+function qweb(path, data, success, failure) {
+    qweb_call(path, data).then(success, (err) => { if (failure) failure(err.body) });
+}
+
+
+/**
+ * Send the calls made during this tick, in one batch if there are several
+ */
+function qweb_flush() {
+    const calls = qweb_queue.filter((c) => !c.done);
+    qweb_queue = [];
+    if (calls.length > 1 && qweb_config.batch_path) {
+        qweb_schedule(() => qweb_send_batch(calls));
+    } else {
+        calls.forEach((c) => qweb_schedule(() => qweb_send(c)));
+    }
+}
+
+
+/**
+ * Start a request once fewer than qweb_config.max_requests are in flight
+ * @param {CallableFunction():Promise} send starts the request (none to start those waiting)
+ */
+function qweb_schedule(send) {
+    if (send) qweb_waiting.push(send);
+    while (qweb_active < qweb_config.max_requests && qweb_waiting.length) {
+        qweb_active++;
+        qweb_waiting.shift()().finally(() => {
+            qweb_active--;
+            qweb_schedule();
+        });
+    }
+}
+
+
+/**
+ * POST some data
+ * @returns {Promise<[number, Uint8Array]>} status and content of the response
+ */
+function qweb_fetch(path, body, signal) {
+    return fetch(path, {
+        method: "POST",
+        headers: { "Content-Type": "application/octet-stream" },
+        body: body,
+        signal: signal
+    }).then((resp) => resp.arrayBuffer().then((buf) => [resp.status, new Uint8Array(buf)]));
+}
+
+
+/**
+ * Send a call on its own
+ */
+function qweb_send(call) {
+    if (call.done) return Promise.resolve();
+    const ctrl = new AbortController();
+    call.abort = () => ctrl.abort();
+    return qweb_fetch(call.path, call.data, ctrl.signal).then(
+        (resp) => qweb_result(call, resp[0], resp[1]),
+        (err) => call.reject(new QwebError(0, "", "qweb: " + err.message)));
+}
+
+
+/**
+ * Send calls together to the batch endpoint, as "<path> <length>\n<data>" each
+ */
+function qweb_send_batch(calls) {
+    calls = calls.filter((c) => !c.done);
+    if (!calls.length) return Promise.resolve();
+
+    // Aborted once none of its calls waits for it anymore
+    const ctrl = new AbortController();
+    calls.forEach((c) => c.abort = () => { if (calls.every((x) => x.done)) ctrl.abort() });
+
+    const enc = new TextEncoder();
+    const parts = [];
+    for (const c of calls) parts.push(enc.encode(c.path + " " + c.data.length + "\n"), c.data);
+    return qweb_fetch(qweb_config.batch_path, new Blob(parts), ctrl.signal).then((resp) => {
+        if (resp[0] == 200) {
+            qweb_unbatch(resp[1], calls);
+        } else if (resp[0] >= 400) {
+            // Refused as a whole, so none of the calls ran: the server has no batch
+            // endpoint, or the batch is too large. They are sent one by one from now on.
+            qweb_config.batch_path = null;
+            calls.forEach((c) => qweb_schedule(() => qweb_send(c)));
         } else {
-            if (failure) failure(http.responseText);
+            calls.forEach((c) => c.reject(new QwebError(resp[0], "")));
+        }
+    }, (err) => calls.forEach((c) => c.reject(new QwebError(0, "", "qweb: " + err.message))));
+}
+
+
+/**
+ * Settle the calls of a batch with its results, "<status> <length> <type>\n<data>" each
+ */
+function qweb_unbatch(bytes, calls) {
+    let pos = 0;
+    for (const c of calls) {
+        const nl = bytes.indexOf(10, pos);
+        if (nl < 0) {
+            c.reject(new QwebError(0, "", "qweb: batch cut short"));
+            continue;
         }
+        const head = new TextDecoder().decode(bytes.subarray(pos, nl)).split(" ");
+        pos = nl + 1 + Number(head[1]);
+        qweb_result(c, Number(head[0]), bytes.subarray(nl + 1, pos));
+    }
+}
+
+
+/**
+ * Settle a call with its response
+ */
+function qweb_result(call, status, bytes) {
+    const text = () => new TextDecoder().decode(bytes);
+    if (status != 200) return call.reject(new QwebError(status, text()));
+    try {
+        call.resolve(call.type == "bytes" ? bytes : call.type == "json" ? JSON.parse(text()) : text());
+    } catch (err) {
+        call.reject(new QwebError(status, text(), "qweb: " + err.message));
     }
-    http.send(data);
+}
+
+
+/**
+ * Get the bytes sent for the data of a call
+ * @param {Uint8Array|ArrayBuffer|string|any} data data given to qweb_call
+ * @returns {Uint8Array} bytes sent
+ */
+function qweb_bytes(data) {
+    if (data === undefined || data === null) return new Uint8Array(0);
+    if (data instanceof Uint8Array) return data;
+    if (data instanceof ArrayBuffer) return new Uint8Array(data);
+    if (ArrayBuffer.isView(data)) return new Uint8Array(data.buffer, data.byteOffset, data.byteLength);
+    return new TextEncoder().encode(typeof data == "string" ? data : JSON.stringify(data));
+}
+
+
+/**
+ * Open a WebSocket to a qweb registered endpoint, reconnecting if it drops
+ *
+ * @param {string} path qweb registered path for the endpoint
+ * @param {CallableFunction(string|ArrayBuffer)} message Callback for each message from the server
+ * @returns {{send: CallableFunction(string|Uint8Array):boolean, close: CallableFunction()}} the connection
+ */
+function qweb_ws(path, message) {
+    const url = (location.protocol == "https:" ? "wss://" : "ws://") + location.host + path;
+    let ws, closed = false;
+    const open = () => {
+        ws = new WebSocket(url);
+        ws.binaryType = "arraybuffer";
+        ws.onmessage = (e) => { if (message) message(e.data) };
+        ws.onclose = () => { if (!closed) setTimeout(open, 1000) };
+    };
+    open();
+    return {
+        send: (data) => {
+            if (ws.readyState != WebSocket.OPEN) return false;
+            ws.send(data);
+            return true;
+        },
+        close: () => { closed = true; ws.close() }
+    };
 }
 
 
 /**
  * Convert string to bytes
  * @param {string} s string
- * @returns Nullterminated byte array based on string
+ * @returns Null terminated UTF-8 bytes of the string
  */
-function qweb_s2b(s) { return Uint8Array.from((s+'\0').split("").map(x => x.charCodeAt())) }
+function qweb_s2b(s) { return new TextEncoder().encode(s + "\0") }
 
 
 /**
@@ -34,4 +274,4 @@ function qweb_s2b(s) { return Uint8Array.from((s+'\0').split("").map(x => x.char
  * @param {any} json any stringifiable json
  * @returns Null terminated byte array based on stringified json
  */
-function qweb_j2b(json) { return qweb_s2b(JSON.stringify(json)) }
\ No newline at end of file
+function qweb_j2b(json) { return qweb_s2b(JSON.stringify(json)) }
@@ -1 +1,16 @@
-function qweb(p,d,s,f){let h =new XMLHttpRequest();h.open("POST",p);h.setRequestHeader('Content-type','application/octet-stream');h.onloadend=()=>{(h.status==200)?s?.(h.responseText):f?.(h.responseText)};h.send(d)}function qweb_s2b(s){return Uint8Array.from((s+'\0').split("").map(x=>x.charCodeAt()))}
\ No newline at end of file
+var qweb_config={batch_path:"/qweb/batch",max_requests:4,timeout:0};class QwebError extends Error{constructor(status,body,message){super(message||"qweb: HTTP "+status);this.name="QwebError";this.status=status;this.body=body;}}
+let qweb_queue=[];let qweb_waiting=[];let qweb_active=0;function qweb_call(path,data,options){options=options||{};return new Promise((resolve,reject)=>{let timer=0;const call={path:path,data:qweb_bytes(data),type:options.type||"text",done:false,abort:null};call.resolve=(value)=>{if(call.done)return;call.done=true;clearTimeout(timer);resolve(value);};call.reject=(err)=>{if(call.done)return;call.done=true;clearTimeout(timer);reject(err);if(call.abort)call.abort();};const timeout=options.timeout===undefined?qweb_config.timeout:options.timeout;if(timeout)timer=setTimeout(()=>call.reject(new QwebError(0,"","qweb: timeout")),timeout);if(options.signal){if(options.signal.aborted)return call.reject(new QwebError(0,"","qweb: aborted"));options.signal.addEventListener("abort",()=>call.reject(new QwebError(0,"","qweb: aborted")));}
+qweb_queue.push(call);if(qweb_queue.length==1)Promise.resolve().then(qweb_flush);});}
+function qweb(path,data,success,failure){qweb_call(path,data).then(success,(err)=>{if(failure)failure(err.body)});}
+function qweb_flush(){const calls=qweb_queue.filter((c)=>!c.done);qweb_queue=[];if(calls.length>1&&qweb_config.batch_path){qweb_schedule(()=>qweb_send_batch(calls));}else{calls.forEach((c)=>qweb_schedule(()=>qweb_send(c)));}}
+function qweb_schedule(send){if(send)qweb_waiting.push(send);while(qweb_active<qweb_config.max_requests&&qweb_waiting.length){qweb_active++;qweb_waiting.shift()().finally(()=>{qweb_active--;qweb_schedule();});}}
+function qweb_fetch(path,body,signal){return fetch(path,{method:"POST",headers:{"Content-Type":"application/octet-stream"},body:body,signal:signal}).then((resp)=>resp.arrayBuffer().then((buf)=>[resp.status,new Uint8Array(buf)]));}
+function qweb_send(call){if(call.done)return Promise.resolve();const ctrl=new AbortController();call.abort=()=>ctrl.abort();return qweb_fetch(call.path,call.data,ctrl.signal).then((resp)=>qweb_result(call,resp[0],resp[1]),(err)=>call.reject(new QwebError(0,"","qweb: "+err.message)));}
+function qweb_send_batch(calls){calls=calls.filter((c)=>!c.done);if(!calls.length)return Promise.resolve();const ctrl=new AbortController();calls.forEach((c)=>c.abort=()=>{if(calls.every((x)=>x.done))ctrl.abort()});const enc=new TextEncoder();const parts=[];for(const c of calls)parts.push(enc.encode(c.path+" "+c.data.length+"\n"),c.data);return qweb_fetch(qweb_config.batch_path,new Blob(parts),ctrl.signal).then((resp)=>{if(resp[0]==200){qweb_unbatch(resp[1],calls);}else if(resp[0]>=400){qweb_config.batch_path=null;calls.forEach((c)=>qweb_schedule(()=>qweb_send(c)));}else{calls.forEach((c)=>c.reject(new QwebError(resp[0],"")));}},(err)=>calls.forEach((c)=>c.reject(new QwebError(0,"","qweb: "+err.message))));}
+function qweb_unbatch(bytes,calls){let pos=0;for(const c of calls){const nl=bytes.indexOf(10,pos);if(nl<0){c.reject(new QwebError(0,"","qweb: batch cut short"));continue;}
+const head=new TextDecoder().decode(bytes.subarray(pos,nl)).split(" ");pos=nl+1+Number(head[1]);qweb_result(c,Number(head[0]),bytes.subarray(nl+1,pos));}}
+function qweb_result(call,status,bytes){const text=()=>new TextDecoder().decode(bytes);if(status!=200)return call.reject(new QwebError(status,text()));try{call.resolve(call.type=="bytes"?bytes:call.type=="json"?JSON.parse(text()):text());}catch(err){call.reject(new QwebError(status,text(),"qweb: "+err.message));}}
+function qweb_bytes(data){if(data===undefined||data===null)return new Uint8Array(0);if(data instanceof Uint8Array)return data;if(data instanceof ArrayBuffer)return new Uint8Array(data);if(ArrayBuffer.isView(data))return new Uint8Array(data.buffer,data.byteOffset,data.byteLength);return new TextEncoder().encode(typeof data=="string"?data:JSON.stringify(data));}
+function qweb_ws(path,message){const url=(location.protocol=="https:"?"wss://":"ws://")+location.host+path;let ws,closed=false;const open=()=>{ws=new WebSocket(url);ws.binaryType="arraybuffer";ws.onmessage=(e)=>{if(message)message(e.data)};ws.onclose=()=>{if(!closed)setTimeout(open,1000)};};open();return{send:(data)=>{if(ws.readyState!=WebSocket.OPEN)return false;ws.send(data);return true;},close:()=>{closed=true;ws.close()}};}
+function qweb_s2b(s){return new TextEncoder().encode(s+"\0")}
+function qweb_j2b(json){return qweb_s2b(JSON.stringify(json))}
@@ -1,9 +1,21 @@
 #include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stddef.h>
+#include <limits.h>
+#include <stdatomic.h>
 #include "esp-qweb.h"
 #include "static-containers.h"
 
 #include "esp_log.h"
 #include "esp_err.h"
+#include "esp_idf_version.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
 
 #include "esp_http_server.h"
 
@@ -12,15 +24,76 @@
 #endif
 
 #include "lcl_hmap.h"
+#include "qweb-router.h"
+#include "qweb-resp.h"
+#include "qweb-ws.h"
+#include "qweb-sse.h"
+#include "qweb-metrics.h"
+#include "qweb-access-log.h"
+#include "qweb-fs.h"
+#include "qweb-table.h"
+#include "qweb-dyn.h"
+#include "qweb-form.h"
+#include "qweb-cache.h"
+
+// esp_http_server can hand requests off from their handler since v5.2
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 2, 0)
+#define QWEB_HAS_ASYNC_REQ
+#endif
+
+// Requests are timed for the metrics and the access log
+#if defined(CONFIG_QWEB_METRICS) || defined(CONFIG_QWEB_ACCESS_LOG)
+#define SERV_TIMED
+#define SERV_START(name)    int64_t name = esp_timer_get_time()
+#define SERV_STARTED(name)  (name)
+#else
+#define SERV_START(name)
+#define SERV_STARTED(name)  ((int64_t) 0)
+#endif
+
+// Each request is logged from the handlers only without the access log
+#ifdef CONFIG_QWEB_ACCESS_LOG
+#define REQ_LOGI(...)
+#else
+#define REQ_LOGI(...)       ESP_LOGI(TAG, __VA_ARGS__)
+#endif
+
+// Size comparison
+#define LEN_MIN(a,b)    (((a) < (b)) ? (a) : (b))
+
+// Statuses not provided by esp_http_server
+#define HTTPD_206           "206 Partial Content"
+#define HTTPD_304           "304 Not Modified"
+#define HTTPD_416           "416 Range Not Satisfiable"
+#define HTTPD_503           "503 Service Unavailable"
 
-// Pointer comparison
-#define PTR_MIN(a,b)    (((a) < (b)) ? (a) : (b))
+// Priority of async post workers (same as the httpd task by default)
+#define ASYNC_TASK_PRIORITY (5)
 
-// Internal Maximum
-#define FILEPATH_MAX        (256)
+// Quoted 64-bit hex entity tag, with terminator
+#define ETAG_SIZE           (19)
+
+_Static_assert(DYN_ETAG_SIZE == ETAG_SIZE, "dynamic files hold entity tags of the same size");
+
+// Entity tag of an encoded variant ("<hash>-gz")
+#define ETAG_RESP_SIZE      (ETAG_SIZE + 3)
+
+// "bytes <first>-<last>/<length>"
+#define CONTENT_RANGE_SIZE  (48)
 
 static const char* TAG = "qweb-server";
 
+/**
+ * @brief A GET callback, kept until qweb_free since requests handed off
+ *  to the workers or waiting on its cache may outlive its file entry
+ */
+typedef struct http_get_cb_entry {
+    struct http_get_cb_entry* next;
+    qweb_get_cb_t cb;
+    cache_t* cache;                 // responses kept for a while, NULL to run cb for each request
+    bool async: 1;                  // run `cb` on a worker task
+} http_get_cb_entry_t;
+
 /**
  * @brief A file entry in the internal file system
  */
@@ -29,23 +102,125 @@ typedef struct http_file_ent {
     const char* type;               // MIME type
     const char* content;            // data content
     size_t content_length;          // data length
+    const char* gz_content;         // gzip encoded content (optional)
+    size_t gz_length;               // gzip encoded length
+    const char* br_content;         // brotli encoded content (optional)
+    size_t br_length;               // brotli encoded length
+    const char* cache_control;      // Cache-Control policy, NULL for the server default
+    const char* fs_path;            // file read on each request instead of content (optional)
+    const char* fs_gz_path;         // file read for the gzip encoded content (optional)
+    qweb_dyn_t* dyn;                // versions served instead of content (optional)
+    const qweb_template_t* tpl;     // template rendered instead of content (optional)
+    qweb_template_slot_cb_t tpl_cb; // fills the slots of tpl
+    void* tpl_ctx;
+    http_get_cb_entry_t* get;       // callback computing the content instead (optional)
+    char etag[ETAG_SIZE];           // strong validator of the content
+    bool stream: 1;                 // always send in chunks
+    bool supress_log: 1;            // supress logs about this file
+#ifdef CONFIG_QWEB_METRICS
+    metrics_route_t metrics;
+#endif
 } http_file_ent_t;
 
+/**
+ * @brief The representation of a file chosen to answer a request
+ */
+typedef struct serv_body {
+    const char* status;             // response status
+    const char* data;               // content to send
+    const char* fs_path;            // file to read the content from instead of data
+    size_t offset;                  // start of the content in fs_path
+    dyn_buf_t* dyn;                 // version of a dynamic file holding data, released once sent
+    cache_resp_t* cached;           // cached response holding data, released once sent
+    size_t length;                  // content length
+    const char* type;               // MIME type
+    const char* encoding;           // Content-Encoding, NULL for identity
+    const char* cache_control;      // Cache-Control, NULL for none
+    bool vary: 1;                   // other encodings exist
+    char etag[ETAG_RESP_SIZE];      // validator of this representation
+    char content_range[CONTENT_RANGE_SIZE]; // Content-Range, empty for none
+} serv_body_t;
+
 /**
  * @brief A post request handler entry in the internal file system
  */
 typedef struct http_post_cb_entry {
     const char* fpath;              // file name or path used to POST to this handler
-    qweb_post_cb_t cb;              // callback function to handle requests
+    union {
+        struct {
+            qweb_post_cb_t cb;                  // callback function to handle requests
+            qweb_post_writer_cb_t writer_cb;    // callback writing its response, used instead of `cb` when set
+            qweb_post_params_cb_t params_cb;    // callback given the request's parameters, used instead of `cb` when set
+        };
+        qweb_post_stream_handler_t stream;      // callbacks to handle streamed requests
+        qweb_post_form_handler_t form;          // callbacks to handle multipart forms
+    };
+    bool streaming: 1;              // use `stream` instead of `cb`
+    bool multipart: 1;              // use `form` instead of `cb`
+    bool batch: 1;                  // run the calls of a batch instead of `cb`
     bool supress_log: 1;            // supress logs about this post
+    bool async: 1;                  // run `cb` on a worker task
+#ifdef CONFIG_QWEB_METRICS
+    metrics_route_t metrics;
+#endif
 } http_post_cb_entry_t;
 
+/**
+ * @brief A post request handler entry for a route pattern
+ */
+typedef struct http_post_route_entry {
+    const char* pattern;            // route pattern used to POST to this handler
+    qweb_post_route_cb_t cb;        // callback function to handle requests
+    bool supress_log: 1;            // supress logs about this post
+#ifdef CONFIG_QWEB_METRICS
+    metrics_route_t metrics;
+#endif
+} http_post_route_entry_t;
+
+/**
+ * @brief A route manifest being served, along with the counters of its files.
+ *  Replaced whole, and freed once the readers of the file table are done with it.
+ */
+typedef struct serv_manifest {
+    const qweb_manifest_t* manifest;
+#ifdef CONFIG_QWEB_METRICS
+    metrics_route_t metrics[];      // by manifest file index
+#endif
+} serv_manifest_t;
+
 typedef struct qweb_server {
     const char* name;
-    lcl_hmap_t* files;
+    _Atomic(serv_manifest_t*) manifest;     // read in the read-side sections of files
+    table_t* files;                 // read by the handlers without locks
     lcl_hmap_t* post_cbs;
+    router_t* post_routes;
+    sse_t* sse;
+    fs_map_t* fs_maps;              // partitions mapped for their images
+    qweb_dyn_t* dyns;               // versioned dynamic files, kept until qweb_free
+    http_get_cb_entry_t* get_cbs;   // GET callbacks, kept until qweb_free
+    #ifdef CONFIG_QWEB_METRICS
+    metrics_t* metrics;
+    const char* metrics_path;           // path serving the counters (NULL until registered)
+    #endif
+    #ifdef CONFIG_QWEB_ACCESS_LOG
+    access_log_t* access_log;           // NULL if its task could not start
+    #endif
+    #ifdef CONFIG_HTTPD_WS_SUPPORT
+    const char* ws_paths[QWEB_WS_MAX_ENDPOINTS];
+    ws_endpoint_t* ws_endpoints[QWEB_WS_MAX_ENDPOINTS];
+    size_t ws_count;
+    #endif
+
+    size_t async_workers;
+    size_t async_queue_len;
+    size_t async_stack_size;
+    QueueHandle_t async_queue;      // pending async post requests (NULL until needed)
+    SemaphoreHandle_t async_done;   // given by each worker as it exits
 
     size_t max_recvlen;
+    size_t stream_threshold;
+    size_t stream_chunk;
+    const char* cache_control;
 
     httpd_uri_t get_uri;
     httpd_uri_t post_uri;
@@ -59,16 +234,787 @@ typedef struct qweb_server {
 
 
 
-static const char* uri_get_fpath_end( const char* uri ) {
+/**
+ * @brief Length of the path of a uri (everything before '?' or '#'),
+ *  which is looked up where it stands in the uri
+ */
+static size_t uri_fpath_len( const char* uri ) {
 
-    const char* end = uri + strlen(uri);
-    const char* qmark = strchr(uri, '?');
-    qmark = qmark ? qmark : end;
-    const char* htag = strchr(uri, '#');
-    htag = htag ? htag : end;
+    return strcspn(uri, "?#");
 
-    return PTR_MIN(end, PTR_MIN(qmark, htag));
+}
 
+/**
+ * @brief Seeded 32-bit FNV-1a, the hash of route manifests
+ *  (must match tools/qweb_manifest.py)
+ */
+static uint32_t manifest_hash(const char* key, size_t len, uint32_t seed) {
+    uint32_t hash = 0x811c9dc5 ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t) key[i];
+        hash *= 0x01000193;
+    }
+    return hash;
+}
+
+/**
+ * @brief Find a file in a route manifest
+ * @param out file entry describing the manifest file, if found
+ * @param index set to the index of the file in the manifest, if found
+ * @returns true if found
+ */
+static bool manifest_get(const qweb_manifest_t* manifest, const char* fpath, size_t fpath_len, http_file_ent_t* out, size_t* index) {
+    if (!manifest || !manifest->file_count) {
+        return false;
+    }
+
+    // The first hash picks a bucket, whose seed leads to the file's own slot
+    uint32_t seed = manifest->seeds[manifest_hash(fpath, fpath_len, 0) % manifest->bucket_count];
+    const qweb_manifest_file_t* file = &manifest->files[manifest_hash(fpath, fpath_len, seed) % manifest->file_count];
+
+    // Paths outside the manifest land on some other file
+    if (strncmp(file->path, fpath, fpath_len) != 0 || file->path[fpath_len] != '\0') {
+        return false;
+    }
+
+    *out = (http_file_ent_t) {
+        .fname = file->path,
+        .type = file->type,
+        .content = file->content,
+        .content_length = file->content_length,
+        .gz_content = file->gz_content,
+        .gz_length = file->gz_length,
+        .br_content = NULL,
+        .br_length = 0,
+        .cache_control = file->cache_control,
+        .stream = false
+    };
+    snprintf(out->etag, ETAG_SIZE, "%s", file->etag);
+    *index = file - manifest->files;
+    return true;
+}
+
+/**
+ * @brief Compute the strong entity tag of some content
+ *  (64-bit FNV-1a, must match tools/qweb_etag.py)
+ */
+static void etag_compute(char etag[ETAG_SIZE], const char* content, size_t content_length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < content_length; i++) {
+        hash ^= (uint8_t) content[i];
+        hash *= 0x100000001b3ULL;
+    }
+    snprintf(etag, ETAG_SIZE, "\"%08lx%08lx\"", (unsigned long) (hash >> 32), (unsigned long) (hash & 0xffffffff));
+}
+
+// Accept-Encoding flags
+#define ACCEPT_GZIP         (1 << 0)
+#define ACCEPT_BR           (1 << 1)
+
+// Longest request header considered for content negotiation and validation
+#define REQ_HDR_MAX         (128)
+
+/**
+ * @brief Find out which content codings the client accepts
+ * @returns ACCEPT_* flags
+ */
+static int serv_accepted_encodings(httpd_req_t* req) {
+    char hdr[REQ_HDR_MAX];
+    if (httpd_req_get_hdr_value_len(req, "Accept-Encoding") == 0) {
+        return 0;
+    }
+    // A truncated header still holds the leading codings
+    httpd_req_get_hdr_value_str(req, "Accept-Encoding", hdr, sizeof(hdr));
+
+    int accepted = 0;
+    char* save = NULL;
+    for (char* tok = strtok_r(hdr, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        while (*tok == ' ' || *tok == '\t') tok++;
+
+        // Split off parameters, a qvalue of zero refuses the coding
+        size_t name_len = strcspn(tok, " \t;");
+        const char* q = strstr(&tok[name_len], "q=");
+        if (q && strtof(&q[2], NULL) <= 0.0f) {
+            continue;
+        }
+
+        if (name_len == 4 && strncasecmp(tok, "gzip", 4) == 0) {
+            accepted |= ACCEPT_GZIP;
+        } else if (name_len == 2 && strncasecmp(tok, "br", 2) == 0) {
+            accepted |= ACCEPT_BR;
+        } else if (name_len == 1 && tok[0] == '*') {
+            accepted |= ACCEPT_GZIP | ACCEPT_BR;
+        }
+    }
+    return accepted;
+}
+
+/**
+ * @brief Check if the client already holds the given representation
+ *  (If-None-Match, weak comparison)
+ */
+static bool serv_not_modified(httpd_req_t* req, const char* etag) {
+    char hdr[REQ_HDR_MAX];
+    if (httpd_req_get_hdr_value_len(req, "If-None-Match") == 0 ||
+        httpd_req_get_hdr_value_str(req, "If-None-Match", hdr, sizeof(hdr)) != ESP_OK) {
+        return false;
+    }
+
+    char* save = NULL;
+    for (char* tok = strtok_r(hdr, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        while (*tok == ' ' || *tok == '\t') tok++;
+        tok[strcspn(tok, " \t")] = '\0';
+        if (strncmp(tok, "W/", 2) == 0) {
+            tok += 2;
+        }
+        if (strcmp(tok, "*") == 0 || strcmp(tok, etag) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Pick the smallest representation of a file the client accepts
+ */
+static void serv_choose_body(httpd_req_t* req, const qweb_server_t* server, const http_file_ent_t* content, serv_body_t* body) {
+    *body = (serv_body_t) {
+        .status = HTTPD_200,
+        .data = content->content,
+        .fs_path = content->fs_path,
+        .offset = 0,
+        .dyn = NULL,
+        .cached = NULL,
+        .length = content->content_length,
+        .type = content->type,
+        .encoding = NULL,
+        .cache_control = content->cache_control ? content->cache_control : server->cache_control,
+        .vary = content->gz_content || content->br_content || content->fs_gz_path
+    };
+    strcpy(body->etag, content->etag);
+    body->content_range[0] = '\0';
+    if (content->dyn) {
+        // Sent whole, whatever is committed meanwhile
+        body->dyn = dyn_read(content->dyn);
+        body->data = dyn_buf_data(body->dyn);
+        body->length = dyn_buf_length(body->dyn);
+        strcpy(body->etag, dyn_buf_etag(body->dyn));
+    }
+    if (!body->vary) {
+        return;
+    }
+
+    int accepted = serv_accepted_encodings(req);
+    bool gz = (content->gz_content || content->fs_gz_path) && (accepted & ACCEPT_GZIP);
+    const char* suffix = NULL;
+    if (content->br_content && (accepted & ACCEPT_BR) && (!gz || content->br_length <= content->gz_length)) {
+        body->data = content->br_content;
+        body->fs_path = NULL;
+        body->length = content->br_length;
+        body->encoding = "br";
+        suffix = "-br\"";
+    } else if (gz) {
+        body->data = content->gz_content;
+        body->fs_path = content->fs_gz_path;
+        body->length = content->gz_length;
+        body->encoding = "gzip";
+        suffix = "-gz\"";
+    }
+
+    // Each encoding is a different representation, so it gets its own tag
+    if (suffix) {
+        strcpy(&body->etag[strlen(body->etag) - 1], suffix);
+    }
+}
+
+/**
+ * @brief Narrow a response down to the byte range requested by the client, if any.
+ *  Only single ranges are served, the whole representation is sent for
+ *  multiple ranges, malformed Range headers and failed If-Range conditions.
+ * @returns false if the range cannot be satisfied
+ */
+static bool serv_apply_range(httpd_req_t* req, serv_body_t* body) {
+    char hdr[REQ_HDR_MAX];
+    if (httpd_req_get_hdr_value_len(req, "Range") == 0 ||
+        httpd_req_get_hdr_value_str(req, "Range", hdr, sizeof(hdr)) != ESP_OK) {
+        return true;
+    }
+
+    // A range of an older version would be garbage to the client
+    char validator[REQ_HDR_MAX];
+    if (httpd_req_get_hdr_value_len(req, "If-Range") != 0 &&
+        (httpd_req_get_hdr_value_str(req, "If-Range", validator, sizeof(validator)) != ESP_OK ||
+         strcmp(validator, body->etag) != 0)) {
+        return true;
+    }
+
+    if (strncmp(hdr, "bytes=", 6) != 0 || strchr(hdr, ',')) {
+        return true;
+    }
+
+    const char* spec = &hdr[6];
+    char* end;
+    unsigned long long first, last;
+    if (spec[0] == '-') {
+        // Suffix range: the last N bytes
+        unsigned long long suffix = strtoull(&spec[1], &end, 10);
+        if (end == &spec[1] || *end) {
+            return true;
+        }
+        if (suffix == 0 || body->length == 0) {
+            return false;
+        }
+        first = suffix < body->length ? body->length - suffix : 0;
+        last = body->length - 1;
+    } else {
+        first = strtoull(spec, &end, 10);
+        if (end == spec || *end != '-') {
+            return true;
+        }
+        const char* last_spec = end + 1;
+        if (*last_spec) {
+            last = strtoull(last_spec, &end, 10);
+            if (*end || last < first) {
+                return true;
+            }
+        } else {
+            last = ULLONG_MAX;
+        }
+        if (first >= body->length) {
+            return false;
+        }
+        if (last >= body->length) {
+            last = body->length - 1;
+        }
+    }
+
+    snprintf(body->content_range, sizeof(body->content_range), "bytes %llu-%llu/%u", first, last, (unsigned) body->length);
+    body->status = HTTPD_206;
+    if (body->fs_path) {
+        body->offset += first;
+    } else {
+        body->data += first;
+    }
+    body->length = last - first + 1;
+    return true;
+}
+
+/**
+ * @brief Set the response headers for a file
+ * @param body representation sent, must outlive the response
+ */
+static void serv_get_set_headers(httpd_req_t* req, const serv_body_t* body) {
+    httpd_resp_set_status(req, body->status);
+    httpd_resp_set_type(req, body->type);
+    httpd_resp_set_hdr(req, "Connection", "keep-alive");
+    httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
+    httpd_resp_set_hdr(req, "ETag", body->etag);
+    if (body->content_range[0]) {
+        httpd_resp_set_hdr(req, "Content-Range", body->content_range);
+    }
+    if (body->cache_control) {
+        httpd_resp_set_hdr(req, "Cache-Control", body->cache_control);
+    }
+    if (body->vary) {
+        httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    }
+    if (body->encoding) {
+        httpd_resp_set_hdr(req, "Content-Encoding", body->encoding);
+    }
+    // Those set by the callback of a cached response
+    for (size_t i = 0; body->cached && i < body->cached->hdrs_len; ) {
+        const char* field = &body->cached->hdrs[i];
+        const char* value = field + strlen(field) + 1;
+        httpd_resp_set_hdr(req, field, value);
+        i = value + strlen(value) + 1 - body->cached->hdrs;
+    }
+}
+
+/**
+ * @brief A file being sent to a client in chunks
+ */
+typedef struct serv_stream {
+    httpd_req_t* req;               // request (or its async copy)
+    serv_body_t body;               // representation being sent
+    size_t sent;                    // data sent so far
+    size_t chunk;                   // chunk size
+    FILE* file;                     // file the data is read from, NULL to send body.data
+    char buf[];                     // chunk read from the file
+} serv_stream_t;
+
+static void serv_stream_free(serv_stream_t* stream) {
+    if (stream->file) {
+        fclose(stream->file);
+    }
+    dyn_release(stream->body.dyn);
+    cache_release(stream->body.cached);
+    free(stream);
+}
+
+/**
+ * @brief Send the next chunk of a streamed file
+ * @returns true if there is more to send
+ */
+static bool serv_stream_step(serv_stream_t* stream) {
+    if (stream->sent < stream->body.length) {
+        size_t amt = LEN_MIN(stream->chunk, stream->body.length - stream->sent);
+        const char* data = &stream->body.data[stream->sent];
+        if (stream->file) {
+            if (fread(stream->buf, 1, amt, stream->file) != amt) {
+                // The client cannot tell a short response from a complete one
+                // (the path went with the entry, which may be gone already)
+                ESP_LOGE(TAG, "Could not read a file after %ub", stream->sent);
+                httpd_sess_trigger_close(stream->req->handle, httpd_req_to_sockfd(stream->req));
+                return false;
+            }
+            data = stream->buf;
+        }
+        if (httpd_resp_send_chunk(stream->req, data, amt) != ESP_OK) {
+            ESP_LOGE(TAG, "Stream aborted after %ub of %ub", stream->sent, stream->body.length);
+            return false;
+        }
+        stream->sent += amt;
+    }
+    if (stream->sent < stream->body.length) {
+        return true;
+    }
+    // Terminate the chunked response
+    httpd_resp_send_chunk(stream->req, NULL, 0);
+    return false;
+}
+
+#ifdef QWEB_HAS_ASYNC_REQ
+/**
+ * @brief Work item sending one chunk of a streamed file from the httpd task.
+ *  It queues itself again until the file is sent, which lets the httpd task
+ *  serve the other sockets between chunks.
+ */
+static void serv_stream_work(void* arg) {
+    serv_stream_t* stream = (serv_stream_t*) arg;
+    if (serv_stream_step(stream)) {
+        if (httpd_queue_work(stream->req->handle, serv_stream_work, stream) == ESP_OK) {
+            return;
+        }
+        // Could not queue the next chunk, finish here
+        while (serv_stream_step(stream));
+    }
+    httpd_req_async_handler_complete(stream->req);
+    serv_stream_free(stream);
+}
+#endif
+
+/**
+ * @brief Send a file to the client in chunks
+ * @param file file to read the body from, positioned at its start (closed once sent),
+ *  or NULL to send the body data
+ */
+static esp_err_t serv_get_stream(httpd_req_t* req, const qweb_server_t* server, const serv_body_t* body, FILE* file) {
+    serv_stream_t* stream = (serv_stream_t*) malloc(sizeof(serv_stream_t) + (file ? server->stream_chunk : 0));
+    if (!stream) {
+        if (file) {
+            fclose(file);
+        }
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+        return ESP_FAIL;
+    }
+    *stream = (serv_stream_t) {
+        .req = req,
+        .body = *body,
+        .sent = 0,
+        .chunk = server->stream_chunk,
+        .file = file
+    };
+    // The handler releases its own reference to the version when it returns
+    if (stream->body.dyn) {
+        dyn_retain(stream->body.dyn);
+    }
+    if (stream->body.cached) {
+        cache_retain(stream->body.cached);
+    }
+
+#ifdef QWEB_HAS_ASYNC_REQ
+    if (httpd_req_async_handler_begin(req, &stream->req) == ESP_OK) {
+        serv_get_set_headers(stream->req, &stream->body);
+        if (httpd_queue_work(req->handle, serv_stream_work, stream) == ESP_OK) {
+            return ESP_OK;
+        }
+        httpd_req_async_handler_complete(stream->req);
+        stream->req = req;
+    }
+#endif
+
+    // Send everything from the handler, letting other tasks run between chunks
+    serv_get_set_headers(req, &stream->body);
+    while (serv_stream_step(stream)) {
+        taskYIELD();
+    }
+    serv_stream_free(stream);
+    return ESP_OK;
+}
+
+/**
+ * @brief Send a file read from a filesystem. Files up to the stream chunk
+ *  size are read whole, larger ones are streamed through a buffer that size.
+ * @param sent set to the amount of content sent
+ * @param status set to the status line of the response
+ */
+static esp_err_t serv_get_fs(httpd_req_t* req, const qweb_server_t* server, const serv_body_t* body, size_t* sent, const char** status) {
+    FILE* file = fopen(body->fs_path, "rb");
+    if (!file || fseek(file, body->offset, SEEK_SET) != 0) {
+        ESP_LOGE(TAG, "Could not open %s", body->fs_path);
+        if (file) {
+            fclose(file);
+        }
+        *sent = 0;
+        *status = HTTPD_500;
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+        return ESP_FAIL;
+    }
+
+    if (body->length > server->stream_chunk) {
+        return serv_get_stream(req, server, body, file);
+    }
+
+    char* data = malloc(body->length + 1);
+    size_t amt = data ? fread(data, 1, body->length, file) : 0;
+    fclose(file);
+    if (amt != body->length) {
+        ESP_LOGE(TAG, "Could not read %s", body->fs_path);
+        free(data);
+        *sent = 0;
+        *status = HTTPD_500;
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+        return ESP_FAIL;
+    }
+    serv_get_set_headers(req, body);
+    esp_err_t err = httpd_resp_send(req, data, body->length);
+    free(data);
+    return err;
+}
+
+/**
+ * @brief Send the representation of a file chosen for a request
+ * @param sent set to the amount of content sent
+ * @param status set to the status line of the response
+ */
+static esp_err_t serv_send_body(httpd_req_t* req, const qweb_server_t* server, const http_file_ent_t* content, serv_body_t* body, size_t* sent, const char** status) {
+    *sent = 0;
+
+    // The client's cached copy is still valid
+    if (serv_not_modified(req, body->etag)) {
+        *status = body->status = HTTPD_304;
+        serv_get_set_headers(req, body);
+        if (!content->supress_log) {
+            REQ_LOGI("HTTP 304 Not Modified");
+        }
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
+    }
+
+    // Only send the part the client asked for
+    if (!serv_apply_range(req, body)) {
+        snprintf(body->content_range, sizeof(body->content_range), "bytes */%u", (unsigned) body->length);
+        *status = HTTPD_416;
+        httpd_resp_set_status(req, HTTPD_416);
+        httpd_resp_set_hdr(req, "Content-Range", body->content_range);
+        if (!content->supress_log) {
+            REQ_LOGI("HTTP 416 Range Not Satisfiable");
+        }
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
+    }
+
+    *sent = body->length;
+    *status = body->status;
+
+    // Files on a filesystem are read on each request
+    if (body->fs_path) {
+        if (!content->supress_log) {
+            REQ_LOGI("HTTP %s (fs): %ub", body->status, body->length);
+        }
+        return serv_get_fs(req, server, body, sent, status);
+    }
+
+    // Large files are sent in chunks
+    if (content->stream || (server->stream_threshold && body->length > server->stream_threshold)) {
+        if (!content->supress_log) {
+            REQ_LOGI("HTTP %s (stream): %ub", body->status, body->length);
+        }
+        return serv_get_stream(req, server, body, NULL);
+    }
+
+    // Construct reply
+    serv_get_set_headers(req, body);
+    if (!content->supress_log) {
+        REQ_LOGI("HTTP %s: %ub", body->status, body->length);
+    }
+
+    // Send reply
+    ESP_ERROR_CHECK( httpd_resp_send(req, body->data, body->length));
+    return ESP_OK;
+}
+
+/**
+ * @brief Render a template file, in chunks once it outgrows the writer's buffer
+ * @param sent set to the amount of content sent
+ * @param status set to the status line of the response
+ */
+static esp_err_t serv_get_template(httpd_req_t* req, const http_file_ent_t* content, size_t* sent, const char** status) {
+    char buf[QWEB_RESP_WRITER_BUF];
+    qweb_resp_writer_t writer;
+    resp_writer_init(&writer, req, buf, sizeof(buf));
+    qweb_resp_set_type(&writer, content->type);
+    // Rendered pages differ from one request to the next, they get no validator
+    qweb_resp_set_hdr(&writer, "Cache-Control", content->cache_control ? content->cache_control : "no-cache");
+
+    esp_err_t result = qweb_template_render(&writer, content->tpl, req->uri, content->tpl_cb, content->tpl_ctx);
+    esp_err_t err = resp_writer_finish(&writer, result);
+    *sent = writer.sent;
+    *status = writer.status;
+    if (!content->supress_log) {
+        REQ_LOGI("HTTP %s (template): %ub", writer.status, writer.sent);
+    }
+    return result == ESP_OK ? err : result;
+}
+
+/**
+ * @brief Send a file found by the get handler
+ * @param sent set to the amount of content sent
+ * @param status set to the status line of the response
+ */
+static esp_err_t serv_get_file(httpd_req_t* req, const qweb_server_t* server, const http_file_ent_t* content, size_t* sent, const char** status) {
+    if (content->tpl) {
+        return serv_get_template(req, content, sent, status);
+    }
+    // Use a precompressed variant if the client takes it
+    serv_body_t body;
+    serv_choose_body(req, server, content, &body);
+    esp_err_t err = serv_send_body(req, server, content, &body, sent, status);
+    dyn_release(body.dyn);
+    return err;
+}
+
+/**
+ * @brief A request for a GET callback, run by the handler or a worker task
+ */
+typedef struct serv_get_job {
+    httpd_req_t* req;               // request (or its async copy)
+    const http_get_cb_entry_t* entry;
+    const char* cache_control;
+    bool fill: 1;                   // keep the response in the entry's cache
+    bool supress_log: 1;
+#ifdef CONFIG_QWEB_METRICS
+    metrics_route_t* metrics;
+#endif
+    int64_t start;
+} serv_get_job_t;
+
+#ifdef QWEB_HAS_ASYNC_REQ
+/**
+ * @brief A request waiting for a worker task
+ */
+typedef struct serv_async_job {
+    httpd_req_t* req;               // async copy of the request, NULL to stop the worker
+    qweb_post_cb_t cb;              // callback to run
+    qweb_post_writer_cb_t writer_cb;    // callback to run instead of `cb` when set
+    qweb_post_params_cb_t params_cb;    // callback to run instead of `cb` when set
+    char* batch;                    // received batch to run instead, when set
+    bool supress_log;
+    serv_get_job_t get;             // GET callback to run instead, when get.entry is set
+    uint32_t files_epoch;           // read section of the file table, left once get is done
+#ifdef CONFIG_QWEB_METRICS
+    metrics_route_t* metrics;
+#endif
+#ifdef SERV_TIMED
+    int64_t start;
+#endif
+} serv_async_job_t;
+#endif
+
+/**
+ * @brief Answer a request for a GET callback with a response from its cache
+ * @param start arrival time of the request
+ * @param resp response to send, NULL to answer with an error
+ * @param busy error for a NULL resp, 503 if set, 500 otherwise
+ */
+static void serv_get_answer(qweb_server_t* server, const serv_get_job_t* job, httpd_req_t* req, int64_t start,
+    cache_resp_t* resp, bool busy) {
+    size_t sent = 0;
+    const char* status = busy ? HTTPD_503 : HTTPD_500;
+    esp_err_t err = ESP_FAIL;
+    if (resp) {
+        // Only what serv_send_body looks at
+        http_file_ent_t ent = { .stream = false, .supress_log = job->supress_log };
+        serv_body_t body = {
+            .status = resp->status,
+            .data = resp->data,
+            .fs_path = NULL,
+            .offset = 0,
+            .dyn = NULL,
+            .cached = resp,
+            .length = resp->length,
+            .type = resp->type,
+            .encoding = NULL,
+            .cache_control = job->cache_control,
+            .vary = false
+        };
+        strcpy(body.etag, resp->etag);
+        body.content_range[0] = '\0';
+        err = serv_send_body(req, server, &ent, &body, &sent, &status);
+    } else if (busy) {
+        ESP_LOGW(TAG, "Too many requests waiting, turning away GET %s", req->uri);
+        httpd_resp_set_status(req, HTTPD_503);
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        httpd_resp_send(req, NULL, 0);
+    } else {
+        httpd_resp_send_500(req);
+    }
+    METRICS_RECORD(job->metrics, start, 0, sent, err != ESP_OK);
+    ACCESS_LOG_PUSH(server->access_log, job->supress_log, HTTP_GET, req->uri, status, 0, sent, start);
+}
+
+/**
+ * @brief Store the response generated for a job in the cache, and answer
+ *  the request along with those that waited for it
+ * @param data heap buffer holding the response, taken over (NULL if it could not be generated)
+ * @param busy the job was turned away, so are the waiters
+ */
+static void serv_get_done(qweb_server_t* server, const serv_get_job_t* job, char* data, size_t length,
+    const char* type, const char* status, const char* hdrs, size_t hdrs_len, const char* etag, bool busy) {
+    cache_waiter_t waiters[CACHE_WAITERS_MAX];
+    size_t count;
+    cache_resp_t* resp = cache_done(job->entry->cache, data, length, type, status, hdrs, hdrs_len, etag, waiters, &count);
+    serv_get_answer(server, job, job->req, job->start, resp, busy);
+#ifdef QWEB_HAS_ASYNC_REQ
+    for (size_t i = 0; i < count; i++) {
+        serv_get_answer(server, job, waiters[i].req, waiters[i].start, resp, busy);
+        httpd_req_async_handler_complete(waiters[i].req);
+    }
+#endif
+    cache_release(resp);
+}
+
+/**
+ * @brief Run a GET callback for a request. Without a cache the response is
+ *  sent as it is written, otherwise it is collected whole to be kept.
+ */
+static void serv_get_generate(qweb_server_t* server, const serv_get_job_t* job) {
+    httpd_req_t* req = job->req;
+    qweb_resp_writer_t writer;
+    if (!job->fill) {
+        char buf[QWEB_RESP_WRITER_BUF];
+        resp_writer_init(&writer, req, buf, sizeof(buf));
+        qweb_resp_set_hdr(&writer, "Cache-Control", job->cache_control);
+        esp_err_t result = job->entry->cb(req->uri, &writer);
+        esp_err_t err = resp_writer_finish(&writer, result);
+        if (!job->supress_log) {
+            REQ_LOGI("HTTP %s (callback): %ub", writer.status, writer.sent);
+        }
+        METRICS_RECORD(job->metrics, job->start, 0, writer.sent, result != ESP_OK || err != ESP_OK);
+        ACCESS_LOG_PUSH(server->access_log, job->supress_log, HTTP_GET, req->uri, writer.status, 0, writer.sent, job->start);
+        return;
+    }
+
+    char* data = NULL;
+    size_t length = 0;
+    char etag[ETAG_SIZE];
+    if (resp_writer_init_capture(&writer, req, true) == ESP_OK) {
+        esp_err_t result = job->entry->cb(req->uri, &writer);
+        resp_writer_finish(&writer, result);
+        if (result == ESP_OK && writer.err == ESP_OK) {
+            data = writer.buf;
+            length = writer.len;
+            etag_compute(etag, data, length);
+        } else {
+            free(writer.buf);
+        }
+    }
+    serv_get_done(server, job, data, length, writer.type, writer.status, writer.hdrs, writer.hdrs_len, etag, false);
+    free(writer.hdrs);
+}
+
+#ifdef QWEB_HAS_ASYNC_REQ
+/**
+ * @brief Hand a GET request over to the worker tasks. The read section of
+ *  the file table stays open until it is done, keeping its entry around.
+ * @returns ESP_OK if the request was queued, ESP_ERR_NO_MEM if the queue is full
+ */
+static esp_err_t serv_get_async(qweb_server_t* server, const serv_get_job_t* get) {
+    if (!server->async_queue || !server->async_workers) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    serv_async_job_t job = { .req = NULL, .cb = NULL, .writer_cb = NULL, .params_cb = NULL, .supress_log = get->supress_log, .get = *get };
+    if (httpd_req_async_handler_begin(get->req, &job.req) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    job.get.req = job.req;
+    job.files_epoch = table_read_lock(server->files);
+    if (xQueueSend(server->async_queue, &job, 0) != pdTRUE) {
+        table_read_unlock(server->files, job.files_epoch);
+        httpd_req_async_handler_complete(job.req);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+#endif
+
+/**
+ * @brief Answer a request for a GET callback, from its cache when it can
+ * @param start arrival time of the request
+ */
+static void serv_get_cb(httpd_req_t* req, qweb_server_t* server, http_file_ent_t* content, int64_t start) {
+    serv_get_job_t job = {
+        .req = req,
+        .entry = content->get,
+        // Computed resources change at any time, clients revalidate them by default
+        .cache_control = content->cache_control ? content->cache_control : "no-cache",
+        .fill = false,
+        .supress_log = content->supress_log,
+#ifdef CONFIG_QWEB_METRICS
+        .metrics = &content->metrics,
+#endif
+        .start = start
+    };
+    if (job.entry->cache) {
+        cache_resp_t* resp;
+        switch (cache_lookup(job.entry->cache, req, start, &resp)) {
+        case CACHE_HIT:
+            serv_get_answer(server, &job, req, start, resp, false);
+            cache_release(resp);
+            return;
+        case CACHE_WAIT:
+            // Answered along with the request generating the response
+            return;
+        case CACHE_BUSY:
+            serv_get_answer(server, &job, req, start, NULL, true);
+            return;
+        case CACHE_FILL:
+            job.fill = true;
+            break;
+        case CACHE_BYPASS:
+            break;
+        }
+    }
+
+#ifdef QWEB_HAS_ASYNC_REQ
+    // Slow callbacks run on the worker tasks, the client is told to come
+    // back later when they are all busy
+    if (job.entry->async) {
+        esp_err_t err = serv_get_async(server, &job);
+        if (err == ESP_OK) {
+            return;
+        }
+        if (err == ESP_ERR_NO_MEM) {
+            if (job.fill) {
+                serv_get_done(server, &job, NULL, 0, NULL, NULL, NULL, 0, NULL, true);
+            } else {
+                serv_get_answer(server, &job, req, start, NULL, true);
+            }
+            return;
+        }
+    }
+#endif
+    serv_get_generate(server, &job);
 }
 
 /**
@@ -77,37 +1023,66 @@ static const char* uri_get_fpath_end( const char* uri ) {
  *  and send it to the client.
  */
 static esp_err_t serv_get_handler(httpd_req_t* req) {
+    SERV_START(start);
+    qweb_server_t* server = (qweb_server_t*) req->user_ctx;
     
-    const char* fpath_beg = req->uri;
-    const char* fpath_end = uri_get_fpath_end(fpath_beg);
-    size_t fpath_size = fpath_end - fpath_beg;
+    const char* fpath = req->uri;
+    size_t fpath_len = uri_fpath_len(fpath);
+
+    http_file_ent_t* content;
 
-    ESP_LOGI(TAG, "GET: %s", req->uri);
-    char* fpath = malloc(fpath_size+1);
-    strncpy(fpath, fpath_beg, fpath_size);
-    fpath[fpath_size] = '\0';
+    // Entries found stay valid until the end of the section, whatever writers do
+    uint32_t files_epoch = table_read_lock(server->files);
 
-    qweb_server_t* server = (qweb_server_t*) req->user_ctx;
-    const http_file_ent_t* content;
-    lcl_any_t content_any = NULL;
-    lcl_hmap_get( server->files, fpath, &content_any ); // error handled later
-    free(fpath);
-    content = lcl_any2ptr(content_any);
+    // Files built into the manifest come first
+    serv_manifest_t* manifest = atomic_load_explicit(&server->manifest, memory_order_acquire);
+    http_file_ent_t manifest_ent;
+    size_t manifest_idx = 0;
+    if (manifest && manifest_get(manifest->manifest, fpath, fpath_len, &manifest_ent, &manifest_idx)) {
+        content = &manifest_ent;
+    } else {
+        content = table_get_n(server->files, fpath, fpath_len);
+    }
+
+    if (!content || !content->supress_log) {
+        REQ_LOGI("GET: %s", req->uri);
+    }
+
+    // Computed on request, possibly answered later by another task
+    if (content && content->get) {
+        serv_get_cb(req, server, content, SERV_STARTED(start));
+        table_read_unlock(server->files, files_epoch);
+        return ESP_OK;
+    }
 
     // If the file exists
     if (content) {
-        // Construct reply
-        httpd_resp_set_status(req, HTTPD_200);
-        httpd_resp_set_type(req, content->type);
-        httpd_resp_set_hdr(req, "Connection", "keep-alive");
-        ESP_LOGI(TAG,"HTTP 200 OK: %ub", content->content_length);
-
-        // Send reply
-        ESP_ERROR_CHECK( httpd_resp_send(req, content->content, content->content_length));
+        size_t sent;
+        const char* status = HTTPD_500;
+        esp_err_t err = serv_get_file(req, server, content, &sent, &status);
+        METRICS_RECORD(content == &manifest_ent ? &manifest->metrics[manifest_idx] : &content->metrics,
+            start, 0, sent, err != ESP_OK);
+        ACCESS_LOG_PUSH(server->access_log, content->supress_log, HTTP_GET, req->uri, status, 0, sent, start);
+        table_read_unlock(server->files, files_epoch);
+        return err;
+    }
+    table_read_unlock(server->files, files_epoch);
 
+#ifdef CONFIG_QWEB_METRICS
+    if (server->metrics_path && strncmp(fpath, server->metrics_path, fpath_len) == 0 && server->metrics_path[fpath_len] == '\0') {
+        metrics_send(server->metrics, req);
+        ACCESS_LOG_PUSH(server->access_log, false, HTTP_GET, req->uri, HTTPD_200, 0, 0, start);
+        return ESP_OK;
+    }
+#endif
+    if (sse_handle(server->sse, req, fpath, fpath_len)) {
+        // An event stream was opened
+        ACCESS_LOG_PUSH(server->access_log, false, HTTP_GET, req->uri, HTTPD_200, 0, 0, start);
     } else {
         // 404 for files that don't exist
         httpd_resp_send_404(req);
+        METRICS_RECORD(metrics_unmatched(server->metrics, HTTP_GET), start, 0, 0, true);
+        ACCESS_LOG_PUSH(server->access_log, false, HTTP_GET, req->uri, HTTPD_404, 0, 0, start);
     }
 
     return ESP_OK;
@@ -137,72 +1112,668 @@ static esp_err_t httpd_req_recv_all(httpd_req_t* req, char** dest) {
     return ESP_OK;
 }
 
+/**
+ * @brief Send the response described by a `qweb_post_cb_ret_t`,
+ *  and free its data if it is dynamic.
+ * @param sent set to the amount of content sent
+ * @param status set to the status line of the response
+ * @returns true if the response was a success
+ */
+static bool serv_post_send_ret(httpd_req_t* req, qweb_post_cb_ret_t ret, size_t* sent, const char** status) {
+    // Use the `qweb_post_cb_ret_t` to construct a response
+    *status = ret.success ? HTTPD_200 : HTTPD_500;
+    httpd_resp_set_status( req, *status );
+    httpd_resp_set_type(req, ret.resp_type);
+    
+    // Send the response
+    // (determine if we need to provide the data size or use the null terminator)
+    const char* data = ret.dynamic ? ret.d_data : ret.s_data;
+    *sent = ret.nullterm ? strlen(data) : ret.size;
+    
+    esp_err_t send_err = httpd_resp_send(req, data, *sent);
+
+    if (send_err != ESP_OK) {
+        ESP_LOGE(TAG, "Could not send resonse, got ESP_ERROR: (%d)", send_err);
+    }
+
+    // For qweb_post_cb_ret_t responses with a dynamic buffer, it needs to be freed 
+    if (ret.dynamic) {
+        free(ret.d_data);
+    }
+    return ret.success && send_err == ESP_OK;
+}
+
+/**
+ * @brief Whether the body of a request is an urlencoded form
+ */
+static bool serv_post_is_form(httpd_req_t* req) {
+    char ctype[sizeof(HTTP_MIME_FORM_URLENCODED) + 1];
+    // Only the start matters, a cut value is fine
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Content-Type", ctype, sizeof(ctype));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+    size_t len = sizeof(HTTP_MIME_FORM_URLENCODED) - 1;
+    return strncasecmp(ctype, HTTP_MIME_FORM_URLENCODED, len) == 0 && (ctype[len] == '\0' || ctype[len] == ';' || ctype[len] == ' ');
+}
+
+/**
+ * @brief Parse the parameters given to a params_cb: those of the query
+ *  string, decoded in a copy since the uri is logged afterwards, then
+ *  those of an urlencoded form, decoded in place
+ * @param query buffer for the query string, longer ones are cut
+ * @param form true if data is an urlencoded form
+ */
+static void serv_post_params(const char* uri, char* query, size_t query_size, char* data, size_t data_len, bool form, qweb_params_t* params) {
+    params->count = 0;
+    const char* start = strchr(uri, '?');
+    esp_err_t err = ESP_OK;
+    if (start) {
+        size_t len = LEN_MIN(strcspn(start + 1, "#"), query_size - 1);
+        memcpy(query, start + 1, len);
+        err = qweb_params_parse(params, query, len);
+    }
+    if (form && err == ESP_OK) {
+        err = qweb_params_parse(params, data, data_len);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "More than %u parameters in POST %s, the rest are left out", QWEB_PARAMS_MAX, uri);
+    }
+}
+
+/**
+ * @brief Run a post callback on the data of a request, and answer it
+ * @param cb callback returning the response
+ * @param writer_cb callback writing the response, used instead of cb when set
+ * @param params_cb callback given the parameters, used instead of cb when set
+ * @param data data of the request, null terminated (a form is decoded in place for params_cb)
+ * @param sent set to the amount of content sent
+ * @param status set to the status line of the response
+ * @returns true if the response was a success
+ */
+static bool serv_post_run(httpd_req_t* req, qweb_post_cb_t cb, qweb_post_writer_cb_t writer_cb, qweb_post_params_cb_t params_cb,
+    char* data, size_t* sent, const char** status) {
+    if (params_cb) {
+        char query[sizeof(req->uri)];
+        qweb_params_t params;
+        serv_post_params(req->uri, query, sizeof(query), data, req->content_len, serv_post_is_form(req), &params);
+        return serv_post_send_ret(req, params_cb(req->uri, &params, data, req->content_len), sent, status);
+    }
+    if (writer_cb) {
+        char buf[QWEB_RESP_WRITER_BUF];
+        qweb_resp_writer_t writer;
+        resp_writer_init(&writer, req, buf, sizeof(buf));
+        esp_err_t result = writer_cb(req->uri, data, req->content_len, &writer);
+        esp_err_t err = resp_writer_finish(&writer, result);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Could not send resonse, got ESP_ERROR: (%d)", err);
+        }
+        *sent = writer.sent;
+        *status = writer.status;
+        return result == ESP_OK && err == ESP_OK;
+    }
+    return serv_post_send_ret(req, cb(req->uri, data, req->content_len), sent, status);
+}
+
+/**
+ * @brief Handle a post request with a streamed handler, or a form handler.
+ *  The data is passed to the handler through a fixed buffer on the stack,
+ *  so memory use does not depend on the content length. Forms go through
+ *  a parser that splits the parts as they arrive.
+ */
+static esp_err_t serv_post_stream(httpd_req_t* req, const qweb_server_t* server, http_post_cb_entry_t* cbent) {
+    SERV_START(start);
+    qweb_post_stream_begin_cb_t begin = cbent->multipart ? cbent->form.begin : cbent->stream.begin;
+    qweb_post_stream_end_cb_t end = cbent->multipart ? cbent->form.end : cbent->stream.end;
+
+    if (!cbent->supress_log) {
+        REQ_LOGI("POST (%s): %s %ub", cbent->multipart ? "form" : "stream", req->uri, req->content_len);
+    }
+
+    // The boundary of a form comes with its content type
+    form_parser_t* form = NULL;
+    if (cbent->multipart) {
+        char ctype[FORM_BOUNDARY_MAX + 64];
+        esp_err_t err = httpd_req_get_hdr_value_str(req, "Content-Type", ctype, sizeof(ctype));
+        if (err == ESP_OK) {
+            err = form_init(&form, ctype, &cbent->form);
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Could not parse form POST %s", req->uri);
+            bool no_mem = err == ESP_ERR_NO_MEM;
+            httpd_resp_send_err(req, no_mem ? HTTPD_500_INTERNAL_SERVER_ERROR : HTTPD_400_BAD_REQUEST, NULL);
+            METRICS_RECORD(&cbent->metrics, start, 0, 0, true);
+            ACCESS_LOG_PUSH(server->access_log, cbent->supress_log, HTTP_POST, req->uri, no_mem ? HTTPD_500 : HTTPD_400, 0, 0, start);
+            return ESP_FAIL;
+        }
+    }
+
+    void* ctx = NULL;
+    if (begin && begin(req->uri, req->content_len, &ctx) != ESP_OK) {
+        ESP_LOGE(TAG, "Stream handler rejected POST %s of length %ub", req->uri, req->content_len);
+        form_free(form);
+        httpd_resp_send_500(req);
+        METRICS_RECORD(&cbent->metrics, start, 0, 0, true);
+        ACCESS_LOG_PUSH(server->access_log, cbent->supress_log, HTTP_POST, req->uri, HTTPD_500, 0, 0, start);
+        return ESP_OK;
+    }
+
+    char buf[QWEB_STREAM_RECV_CHUNK];
+    size_t remaining = req->content_len;
+    esp_err_t status = ESP_OK;
+    while (remaining > 0) {
+        int recv_amt = httpd_req_recv(req, buf, LEN_MIN(remaining, sizeof(buf)));
+        if (recv_amt == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if (recv_amt <= 0) {
+            status = ESP_FAIL;
+            break;
+        }
+        remaining -= recv_amt;
+        status = form ? form_feed(form, ctx, buf, recv_amt) : cbent->stream.chunk(ctx, buf, recv_amt);
+        if (status != ESP_OK) {
+            break;
+        }
+    }
+    if (form) {
+        if (status == ESP_OK) {
+            status = form_finish(form);
+        }
+        form_free(form);
+    }
+
+    // The end callback always runs so that the handler can release ctx
+    size_t sent;
+    const char* resp_status;
+    bool success = serv_post_send_ret(req, end(ctx, status), &sent, &resp_status);
+    METRICS_RECORD(&cbent->metrics, start, req->content_len - remaining, sent, !success);
+    ACCESS_LOG_PUSH(server->access_log, cbent->supress_log, HTTP_POST, req->uri, resp_status, req->content_len - remaining, sent, start);
+
+    // Close the connection instead of draining what the handler refused
+    return remaining ? ESP_FAIL : ESP_OK;
+}
+
+/**
+ * @brief A call of a batch, pointing into the received data
+ */
+typedef struct serv_batch_call {
+    char* uri;                      // uri of the call, not terminated
+    size_t uri_len;
+    char* data;
+    size_t data_len;
+} serv_batch_call_t;
+
+/**
+ * @brief The result of a call of a batch
+ */
+typedef struct serv_batch_result {
+    const char* status;             // status line
+    const char* type;               // content type
+    const char* data;
+    size_t data_len;
+    char* owned;                    // buffer to free once written, if any
+} serv_batch_result_t;
+
+/**
+ * @brief Parse the header line of the next call of a batch, "<uri> <length>\n"
+ * @returns the start of the following call, or NULL if the framing is malformed
+ */
+static char* serv_batch_next(char* pos, const char* end, serv_batch_call_t* call) {
+    char* nl = memchr(pos, '\n', end - pos);
+    if (!nl || *pos != '/') {
+        return NULL;
+    }
+    char* sp = nl;
+    while (sp > pos && *sp != ' ') {
+        sp--;
+    }
+    char* len_end;
+    unsigned long len = strtoul(sp + 1, &len_end, 10);
+    if (sp == pos || len_end == sp + 1 || len_end != nl || len > (size_t) (end - nl - 1)) {
+        return NULL;
+    }
+    *call = (serv_batch_call_t) { .uri = pos, .uri_len = sp - pos, .data = nl + 1, .data_len = len };
+    return call->data + len;
+}
+
+static void serv_batch_ret(serv_batch_result_t* res, qweb_post_cb_ret_t ret) {
+    res->status = ret.success ? HTTPD_200 : HTTPD_500;
+    res->type = ret.resp_type ? ret.resp_type : HTTPD_TYPE_TEXT;
+    res->data = ret.dynamic ? ret.d_data : ret.s_data;
+    res->data_len = ret.nullterm ? strlen(res->data) : ret.size;
+    res->owned = ret.dynamic ? ret.d_data : NULL;
+}
+
+/**
+ * @brief The handler a call of a batch goes to
+ */
+typedef struct serv_batch_target {
+    http_post_cb_entry_t* cbent;
+    http_post_route_entry_t* route;
+    qweb_route_params_t params;     // parameters of the route, pointing into the uri
+} serv_batch_target_t;
+
+/**
+ * @brief Find the handler of a call of a batch
+ * @param call call, with its uri null terminated
+ */
+static void serv_batch_find(qweb_server_t* server, const serv_batch_call_t* call, serv_batch_target_t* target) {
+    target->route = NULL;
+    // The post callbacks are keyed by null terminated paths, the uri is cut for a while
+    size_t fpath_len = uri_fpath_len(call->uri);
+    char cut = call->uri[fpath_len];
+    call->uri[fpath_len] = '\0';
+    lcl_any_t cbent_any = NULL;
+    lcl_hmap_get(server->post_cbs, call->uri, &cbent_any);
+    call->uri[fpath_len] = cut;
+    target->cbent = lcl_any2ptr(cbent_any);
+    if (!target->cbent) {
+        target->route = router_match(server->post_routes, call->uri, fpath_len, &target->params);
+    }
+}
+
+/**
+ * @brief Run the handler of a call of a batch
+ * @param call call, with its uri and data null terminated
+ * @param res set to the result of the call
+ */
+static void serv_batch_call(httpd_req_t* req, const serv_batch_call_t* call, serv_batch_target_t* target, serv_batch_result_t* res) {
+    http_post_cb_entry_t* cbent = target->cbent;
+    if (!cbent && !target->route) {
+        ESP_LOGE(TAG, "Could not find post callback for batched POST %s", call->uri);
+    } else if (target->route) {
+        serv_batch_ret(res, target->route->cb(call->uri, &target->params, call->data, call->data_len));
+    } else if (cbent->batch) {
+        ESP_LOGE(TAG, "Batches cannot contain batches (%s)", call->uri);
+        res->status = HTTPD_400;
+    } else if (cbent->multipart) {
+        ESP_LOGE(TAG, "Batches cannot contain form uploads (%s)", call->uri);
+        res->status = HTTPD_400;
+    } else if (cbent->streaming) {
+        // The data is all there already, it makes a single chunk
+        void* ctx = NULL;
+        if (cbent->stream.begin && cbent->stream.begin(call->uri, call->data_len, &ctx) != ESP_OK) {
+            ESP_LOGE(TAG, "Stream handler rejected batched POST %s of length %ub", call->uri, call->data_len);
+            res->status = HTTPD_500;
+        } else {
+            esp_err_t status = call->data_len ? cbent->stream.chunk(ctx, call->data, call->data_len) : ESP_OK;
+            serv_batch_ret(res, cbent->stream.end(ctx, status));
+        }
+    } else if (cbent->params_cb) {
+        // The calls of a batch carry no content type, only the query is parsed
+        char query[sizeof(req->uri)];
+        qweb_params_t params;
+        serv_post_params(call->uri, query, sizeof(query), call->data, call->data_len, false, &params);
+        serv_batch_ret(res, cbent->params_cb(call->uri, &params, call->data, call->data_len));
+    } else if (cbent->writer_cb) {
+        qweb_resp_writer_t writer;
+        if (resp_writer_init_capture(&writer, req, false) == ESP_OK) {
+            resp_writer_finish(&writer, cbent->writer_cb(call->uri, call->data, call->data_len, &writer));
+            *res = (serv_batch_result_t) { .status = writer.status, .type = writer.type, .data = writer.buf, .data_len = writer.len, .owned = writer.buf };
+        } else {
+            res->status = HTTPD_500;
+        }
+    } else {
+        serv_batch_ret(res, cbent->cb(call->uri, call->data, call->data_len));
+    }
+}
+
+#ifdef QWEB_HAS_ASYNC_REQ
+
+/**
+ * @brief A call of a batch handed back to the httpd task by a worker task
+ */
+typedef struct serv_batch_work {
+    httpd_req_t* req;
+    const serv_batch_call_t* call;
+    serv_batch_target_t* target;
+    serv_batch_result_t* res;
+    SemaphoreHandle_t done;         // given once the call ran
+} serv_batch_work_t;
+
+static void serv_batch_work(void* arg) {
+    serv_batch_work_t* work = (serv_batch_work_t*) arg;
+    serv_batch_call(work->req, work->call, work->target, work->res);
+    xSemaphoreGive(work->done);
+}
+
+/**
+ * @brief Run a call of a batch on the httpd task, from the worker task
+ *  running the batch, and wait for it
+ * @param done semaphore given once the call ran
+ */
+static void serv_batch_handback(httpd_req_t* req, const serv_batch_call_t* call, serv_batch_target_t* target, serv_batch_result_t* res,
+    SemaphoreHandle_t done) {
+    serv_batch_work_t work = { .req = req, .call = call, .target = target, .res = res, .done = done };
+    if (httpd_queue_work(req->handle, serv_batch_work, &work) == ESP_OK) {
+        xSemaphoreTake(done, portMAX_DELAY);
+    } else {
+        ESP_LOGE(TAG, "Could not hand batched POST %s back to the httpd task", call->uri);
+        res->status = HTTPD_503;
+    }
+}
+
+/**
+ * @brief Whether a batch calls an async handler, it then runs on a worker task
+ */
+static bool serv_batch_async(qweb_server_t* server, char* data, size_t len) {
+    const char* end = data + len;
+    serv_batch_call_t call;
+    serv_batch_target_t target;
+    for (char* pos = data; pos < end && (pos = serv_batch_next(pos, end, &call));) {
+        // The uri ends at the space before the length
+        call.uri[call.uri_len] = '\0';
+        serv_batch_find(server, &call, &target);
+        call.uri[call.uri_len] = ' ';
+        if (target.cbent && target.cbent->async) {
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+/**
+ * @brief Run a call of a batch with the handler of its path, and write its result
+ * @param call call, with its uri and data null terminated
+ * @param out response of the batch
+ * @param handback set when a worker task runs the batch: the handlers that
+ *  are not async are run by the httpd task, and the semaphore is given once they are done
+ */
+static void serv_batch_run(httpd_req_t* req, qweb_server_t* server, const serv_batch_call_t* call, qweb_resp_writer_t* out,
+    SemaphoreHandle_t handback) {
+    SERV_START(start);
+    serv_batch_result_t res = { .status = HTTPD_404, .type = HTTPD_TYPE_TEXT, .data = "", .data_len = 0, .owned = NULL };
+
+    serv_batch_target_t target;
+    serv_batch_find(server, call, &target);
+    http_post_cb_entry_t* cbent = target.cbent;
+    http_post_route_entry_t* route = target.route;
+    bool quiet = cbent ? cbent->supress_log : route ? route->supress_log : false;
+    if (!quiet) {
+        REQ_LOGI("POST (batch): %s", call->uri);
+    }
+
+#ifdef QWEB_HAS_ASYNC_REQ
+    if (handback && !(cbent && cbent->async)) {
+        serv_batch_handback(req, call, &target, &res, handback);
+    } else {
+        serv_batch_call(req, call, &target, &res);
+    }
+#else
+    serv_batch_call(req, call, &target, &res);
+#endif
+
+    // The status code is the start of the status line
+    qweb_resp_printf(out, "%.3s %u %s\n", res.status, (unsigned) res.data_len, res.type);
+    qweb_resp_write(out, res.data, res.data_len);
+    free(res.owned);
+
+    bool success = strcmp(res.status, HTTPD_200) == 0;
+    METRICS_RECORD(cbent ? &cbent->metrics : route ? &route->metrics : metrics_unmatched(server->metrics, HTTP_POST),
+        start, call->data_len, res.data_len, !success);
+    ACCESS_LOG_PUSH(server->access_log, quiet, HTTP_POST, call->uri, res.status, call->data_len, res.data_len, start);
+}
+
+/**
+ * @brief Run the calls of a batch in order, answering with their results.
+ *  The whole batch is checked before the first call runs.
+ * @param data batch, null terminated
+ * @param worker true on a worker task, which hands the handlers that are not async back to the httpd task
+ * @param sent set to the amount of content sent
+ * @param status set to the status line of the response
+ * @returns true if the response was a success
+ */
+static bool serv_post_batch(httpd_req_t* req, qweb_server_t* server, char* data, size_t* sent, const char** status, bool worker) {
+    const char* end = data + req->content_len;
+    serv_batch_call_t call;
+    size_t count = 0;
+    for (char* pos = data; pos < end; count++) {
+        if (!(pos = serv_batch_next(pos, end, &call))) {
+            ESP_LOGE(TAG, "Malformed batch after %u calls", count);
+            *sent = 0;
+            *status = HTTPD_400;
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
+            return false;
+        }
+    }
+
+    SemaphoreHandle_t handback = NULL;
+    if (worker && !(handback = xSemaphoreCreateBinary())) {
+        ESP_LOGE(TAG, "Could not run a batch of %u calls", count);
+        *sent = 0;
+        *status = HTTPD_500;
+        httpd_resp_send_500(req);
+        return false;
+    }
+
+    char buf[QWEB_RESP_WRITER_BUF];
+    qweb_resp_writer_t out;
+    resp_writer_init(&out, req, buf, sizeof(buf));
+    qweb_resp_set_type(&out, HTTP_MIME_BINARY);
+    for (char* pos = data; pos < end;) {
+        pos = serv_batch_next(pos, end, &call);
+
+        // Handlers get null terminated strings, as with single requests. The
+        // terminator of the data overwrites the start of the next call for a while.
+        char next = call.data[call.data_len];
+        call.uri[call.uri_len] = '\0';
+        call.data[call.data_len] = '\0';
+        serv_batch_run(req, server, &call, &out, handback);
+        call.data[call.data_len] = next;
+    }
+    if (handback) {
+        vSemaphoreDelete(handback);
+    }
+    esp_err_t err = resp_writer_finish(&out, ESP_OK);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Could not send the results of %u calls (%d)", count, err);
+    }
+    *sent = out.sent;
+    *status = out.status;
+    return err == ESP_OK;
+}
+
+#ifdef QWEB_HAS_ASYNC_REQ
+
+/**
+ * @brief Worker task running async post handlers and GET callbacks
+ */
+static void serv_async_worker(void* arg) {
+    qweb_server_t* server = (qweb_server_t*) arg;
+    serv_async_job_t job;
+    while (xQueueReceive(server->async_queue, &job, portMAX_DELAY) == pdTRUE && job.req) {
+        if (job.get.entry) {
+            serv_get_generate(server, &job.get);
+            table_read_unlock(server->files, job.files_epoch);
+            httpd_req_async_handler_complete(job.req);
+            continue;
+        }
+        // A batch was received to find its async calls
+        char* data = job.batch;
+        if (data || httpd_req_recv_all(job.req, &data) == ESP_OK) {
+            size_t sent;
+            const char* status;
+            bool success = job.batch ? serv_post_batch(job.req, server, data, &sent, &status, true)
+                : serv_post_run(job.req, job.cb, job.writer_cb, job.params_cb, data, &sent, &status);
+            free(data);
+            METRICS_RECORD(job.metrics, job.start, job.req->content_len, sent, !success);
+            ACCESS_LOG_PUSH(server->access_log, job.supress_log, HTTP_POST, job.req->uri, status, job.req->content_len, sent, job.start);
+        } else {
+            ESP_LOGE(TAG, "Could not receive POST %s", job.req->uri);
+            METRICS_RECORD(job.metrics, job.start, 0, 0, true);
+        }
+        httpd_req_async_handler_complete(job.req);
+    }
+    xSemaphoreGive(server->async_done);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Start the worker tasks of async post handlers
+ */
+static esp_err_t serv_async_start(qweb_server_t* server) {
+    if (server->async_queue) {
+        return ESP_OK;
+    }
+    server->async_queue = xQueueCreate(server->async_queue_len, sizeof(serv_async_job_t));
+    server->async_done = xSemaphoreCreateCounting(server->async_workers, 0);
+    if (!server->async_queue || !server->async_done) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < server->async_workers; i++) {
+        if (xTaskCreate(serv_async_worker, "qweb-async", server->async_stack_size, server, ASYNC_TASK_PRIORITY, NULL) != pdPASS) {
+            ESP_LOGE(TAG, "Could not start async worker %u", i);
+            server->async_workers = i;
+            break;
+        }
+    }
+    ESP_LOGI(TAG, "started %u async workers", server->async_workers);
+    return ESP_OK;
+}
+
+/**
+ * @brief Stop the worker tasks of async post handlers,
+ *  after they finish the requests already queued
+ */
+static void serv_async_stop(qweb_server_t* server) {
+    if (!server->async_queue) {
+        return;
+    }
+    serv_async_job_t stop = { .req = NULL, .cb = NULL, .writer_cb = NULL, .params_cb = NULL };
+    for (size_t i = 0; i < server->async_workers; i++) {
+        xQueueSend(server->async_queue, &stop, portMAX_DELAY);
+    }
+    for (size_t i = 0; i < server->async_workers; i++) {
+        xSemaphoreTake(server->async_done, portMAX_DELAY);
+    }
+    vQueueDelete(server->async_queue);
+    vSemaphoreDelete(server->async_done);
+    server->async_queue = NULL;
+}
+
+/**
+ * @brief Hand a post request over to the worker tasks.
+ *  When they are all busy and the queue is full, the client is
+ *  told to come back later rather than stalling the httpd task.
+ * @param batch received batch, taken over once the request is handled; NULL for other handlers
+ * @returns ESP_OK if the request was handled (queued or turned away)
+ */
+static esp_err_t serv_post_async(httpd_req_t* req, qweb_server_t* server, http_post_cb_entry_t* cbent, char* batch) {
+    if (!server->async_queue || !server->async_workers) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    serv_async_job_t job = { .req = NULL, .cb = cbent->cb, .writer_cb = cbent->writer_cb, .params_cb = cbent->params_cb,
+        .batch = batch, .supress_log = cbent->supress_log };
+#ifdef CONFIG_QWEB_METRICS
+    job.metrics = &cbent->metrics;
+#endif
+#ifdef SERV_TIMED
+    job.start = esp_timer_get_time();
+#endif
+    if (httpd_req_async_handler_begin(req, &job.req) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (xQueueSend(server->async_queue, &job, 0) != pdTRUE) {
+        httpd_req_async_handler_complete(job.req);
+        free(batch);
+        ESP_LOGW(TAG, "Async workers busy, turning away POST %s", req->uri);
+        httpd_resp_set_status(req, HTTPD_503);
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        httpd_resp_send(req, NULL, 0);
+        METRICS_RECORD(job.metrics, job.start, 0, 0, true);
+        ACCESS_LOG_PUSH(server->access_log, cbent->supress_log, HTTP_POST, req->uri, HTTPD_503, 0, 0, job.start);
+    }
+    return ESP_OK;
+}
+#endif
+
 /**
  * @brief global handler for all post requests.
  *  This function distributes incoming post requests to
  *  their registered handler functions.
  */
 static esp_err_t serv_post_handler(httpd_req_t* req) {
-    const char* fpath_beg = req->uri;
-    const char* fpath_end = uri_get_fpath_end(fpath_beg);
-    size_t fpath_size = fpath_end - fpath_beg;
-
+    SERV_START(start);
     qweb_server_t* server = (qweb_server_t*) req->user_ctx;
     
-    char* fpath = malloc(fpath_size+1);
-    strncpy(fpath, fpath_beg, fpath_size);
-    fpath[fpath_size] = '\0';
+    // The post callbacks are keyed by null terminated paths, any path fits the copy
+    char fpath[sizeof(req->uri)];
+    size_t fpath_len = uri_fpath_len(req->uri);
+    memcpy(fpath, req->uri, fpath_len);
+    fpath[fpath_len] = '\0';
 
-    const http_post_cb_entry_t* cbent;
+    http_post_cb_entry_t* cbent;
     lcl_any_t cbent_any = NULL;
     lcl_hmap_get( server->post_cbs, fpath, &cbent_any ); // error handling done later
-    free(fpath);
 
     cbent = lcl_any2ptr(cbent_any);
 
     // Search file system for a post request handler with the correct fpath
     // const http_post_cb_entry_t* cbent = http_post_cb_get_entry(fpath_beg, fpath_size);
     
+    // Streamed and form handlers take any content length
+    if (cbent && (cbent->streaming || cbent->multipart)) {
+        return serv_post_stream(req, server, cbent);
+    }
+
+    // Otherwise try the route patterns, parameters point into the uri
+    qweb_route_params_t params;
+    http_post_route_entry_t* route = NULL;
+    if (!cbent) {
+        route = router_match(server->post_routes, req->uri, fpath_len, &params);
+    }
+
     // If found...
-    if (cbent) {
+    if (cbent || route) {
+        bool quiet = cbent ? cbent->supress_log : route->supress_log;
         // Ensure that the maximum data content size is not exceeded
         if (req->content_len < server->max_recvlen) {
             
-            if (!cbent->supress_log) {
-                ESP_LOGI(TAG, "POST: %s", req->uri);
+            if (!quiet) {
+                REQ_LOGI("POST: %s", req->uri);
             }
 
+#ifdef QWEB_HAS_ASYNC_REQ
+            // Slow handlers run on the worker tasks
+            if (cbent && cbent->async && serv_post_async(req, server, cbent, NULL) == ESP_OK) {
+                return ESP_OK;
+            }
+#endif
+
             // Load the entire data
             char *data;
-            httpd_req_recv_all( req, &data);
+            if (httpd_req_recv_all( req, &data) != ESP_OK) {
+                ESP_LOGE(TAG, "Could not receive POST %s", req->uri);
+                METRICS_RECORD(cbent ? &cbent->metrics : &route->metrics, start, 0, 0, true);
+                return ESP_FAIL;
+            }
             
             // Call the post handler providing the data
-            qweb_post_cb_ret_t ret = cbent->cb(req->uri, data, req->content_len);
+            size_t sent;
+            const char* status;
+            bool success;
+            if (cbent && cbent->batch) {
+#ifdef QWEB_HAS_ASYNC_REQ
+                // A batch calling async handlers runs on a worker task, which hands the other calls back
+                if (serv_batch_async(server, data, req->content_len) && serv_post_async(req, server, cbent, data) == ESP_OK) {
+                    return ESP_OK;
+                }
+#endif
+                success = serv_post_batch(req, server, data, &sent, &status, false);
+            } else if (cbent) {
+                success = serv_post_run(req, cbent->cb, cbent->writer_cb, cbent->params_cb, data, &sent, &status);
+            } else {
+                success = serv_post_send_ret(req, route->cb(req->uri, &params, data, req->content_len), &sent, &status);
+            }
 
             // Free the data immediately because it my be very large
             free(data);
 
-            // Use the `qweb_post_cb_ret_t` to construct a response
-            httpd_resp_set_status( req, ret.success ? HTTPD_200 : HTTPD_500 );
-            httpd_resp_set_type(req, ret.resp_type);
-            
-            // Send the response
-            // (determine if we need to provide the data size or use the null terminator)
-            
-            esp_err_t send_err = httpd_resp_send(
-                req, 
-                ret.dynamic ? ret.d_data : ret.s_data , 
-                ret.nullterm ? HTTPD_RESP_USE_STRLEN : ret.size 
-            );
-
-            if (send_err != ESP_OK) {
-                ESP_LOGE(TAG, "Could not send resonse, got ESP_ERROR: (%d)", send_err);
-            }
-
-            // For qweb_post_cb_ret_t responses with a dynamic buffer, it needs to be freed 
-            if (ret.dynamic) {
-                free(ret.d_data);
-            }
+            METRICS_RECORD(cbent ? &cbent->metrics : &route->metrics, start, req->content_len, sent, !success);
+            ACCESS_LOG_PUSH(server->access_log, quiet, HTTP_POST, req->uri, status, req->content_len, sent, start);
 
             return ESP_OK;
         } else {
@@ -212,9 +1783,13 @@ static esp_err_t serv_post_handler(httpd_req_t* req) {
                 req->content_len, 
                 server->max_recvlen
             );
+            METRICS_RECORD(cbent ? &cbent->metrics : &route->metrics, start, 0, 0, true);
+            ACCESS_LOG_PUSH(server->access_log, quiet, HTTP_POST, req->uri, HTTPD_500, 0, 0, start);
         }
     } else {
-        ESP_LOGE(TAG, "Could not find post callback for POST %s", fpath_beg);
+        ESP_LOGE(TAG, "Could not find post callback for POST %s", req->uri);
+        METRICS_RECORD(metrics_unmatched(server->metrics, HTTP_POST), start, 0, 0, true);
+        ACCESS_LOG_PUSH(server->access_log, false, HTTP_POST, req->uri, HTTPD_500, 0, 0, start);
     } 
 
     // Reply error to the client
@@ -224,8 +1799,15 @@ static esp_err_t serv_post_handler(httpd_req_t* req) {
 }
 
 
-bool qweb_uri_match_always(const char*, const char*, size_t) {
-    return true;
+/**
+ * @brief Match the catch-all handlers against every uri,
+ *  and other handlers (WebSocket endpoints) against their exact path
+ */
+bool qweb_uri_match(const char* reference, const char* uri, size_t len) {
+    if (strcmp(reference, "/*") == 0) {
+        return true;
+    }
+    return strlen(reference) == len && strncmp(reference, uri, len) == 0;
 }
 
 
@@ -235,7 +1817,8 @@ esp_err_t qweb_start_ssl(qweb_server_t* server, const qweb_server_config_t *qweb
     httpd_ssl_config_t ssl_cfg = HTTPD_SSL_CONFIG_DEFAULT();
     
     ssl_cfg.httpd.lru_purge_enable = true;
-    ssl_cfg.httpd.uri_match_fn = qweb_uri_match_always;
+    ssl_cfg.httpd.uri_match_fn = qweb_uri_match;
+    ssl_cfg.httpd.max_uri_handlers = 2 + QWEB_WS_MAX_ENDPOINTS;
     ssl_cfg.httpd.server_port = qweb_cfg->port;
     ssl_cfg.httpd.max_open_sockets = qweb_cfg->max_sockets;
     ssl_cfg.httpd.stack_size = qweb_cfg->stack_size;
@@ -247,9 +1830,55 @@ esp_err_t qweb_start_ssl(qweb_server_t* server, const qweb_server_config_t *qweb
 
     server->ssl = true;
 
-    return httpd_ssl_start(&server->httpd, &ssl_cfg);
+    return httpd_ssl_start(&server->httpd, &ssl_cfg);
+}
+#endif
+
+/**
+ * @brief A file entry left the file table
+ */
+static void serv_file_unlink(void* value, void* ctx) {
+    METRICS_REMOVE(((qweb_server_t*) ctx)->metrics, &((http_file_ent_t*) value)->metrics);
+}
+
+/**
+ * @brief Copy a file entry for an update, along with the strings of
+ *  directory files kept after it
+ */
+static void* serv_file_copy(const void* value, const char** key, void* ctx) {
+    const http_file_ent_t* ent = (const http_file_ent_t*) value;
+    size_t size = sizeof(http_file_ent_t);
+    if (ent->fs_path) {
+        size += strlen(ent->fname) + 1 + strlen(ent->fs_path) + 1;
+        size += ent->fs_gz_path ? strlen(ent->fs_gz_path) + 1 : 0;
+    }
+    http_file_ent_t* copy = (http_file_ent_t*) malloc(size);
+    if (!copy) {
+        return NULL;
+    }
+    // The counters are being updated by requests, they start over and
+    // serv_file_replace adds the original's once the copy is published
+#ifdef CONFIG_QWEB_METRICS
+    memcpy(copy, ent, offsetof(http_file_ent_t, metrics));
+#else
+    memcpy(copy, ent, sizeof(http_file_ent_t));
+#endif
+    memcpy(copy + 1, ent + 1, size - sizeof(http_file_ent_t));
+    if (ent->fs_path) {
+        copy->fname = (const char*) copy + (ent->fname - (const char*) ent);
+        copy->fs_path = (const char*) copy + (ent->fs_path - (const char*) ent);
+        if (ent->fs_gz_path) {
+            copy->fs_gz_path = (const char*) copy + (ent->fs_gz_path - (const char*) ent);
+        }
+    }
+    METRICS_CLEAR(&copy->metrics, ent->metrics.method, copy->fname);
+    *key = copy->fname;
+    return copy;
+}
+
+static void serv_file_replace(const void* old, void* value, void* ctx) {
+    METRICS_REPLACE(((qweb_server_t*) ctx)->metrics, &((const http_file_ent_t*) old)->metrics, &((http_file_ent_t*) value)->metrics);
 }
-#endif
 
 qweb_server_t* qweb_init(const qweb_server_config_t* cfg) {
 
@@ -257,7 +1886,8 @@ qweb_server_t* qweb_init(const qweb_server_config_t* cfg) {
     esp_err_t err;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.lru_purge_enable = true;
-    config.uri_match_fn = qweb_uri_match_always;
+    config.uri_match_fn = qweb_uri_match;
+    config.max_uri_handlers = 2 + QWEB_WS_MAX_ENDPOINTS;
     config.server_port = cfg->port;
     config.max_open_sockets = cfg->max_sockets;
     config.stack_size = cfg->stack_size;
@@ -266,6 +1896,12 @@ qweb_server_t* qweb_init(const qweb_server_config_t* cfg) {
 
     server->name = cfg->name;
     server->max_recvlen = cfg->max_recvlen;
+    server->stream_threshold = cfg->stream_threshold;
+    server->stream_chunk = cfg->stream_chunk ? cfg->stream_chunk : QWEB_STREAM_SEND_CHUNK;
+    server->cache_control = cfg->cache_control;
+    server->async_workers = cfg->async_workers;
+    server->async_queue_len = cfg->async_queue_len ? cfg->async_queue_len : QWEB_ASYNC_QUEUE_LEN;
+    server->async_stack_size = cfg->async_stack_size ? cfg->async_stack_size : cfg->stack_size;
     
 
     httpd_uri_t get_uri = {
@@ -284,8 +1920,19 @@ qweb_server_t* qweb_init(const qweb_server_config_t* cfg) {
 
     server->get_uri = get_uri;
     server->post_uri = post_uri;
-    lcl_hmap_init(&server->files, lcl_hash_djb2, lcl_streq);
+    table_ops_t files_ops = { .unlink = serv_file_unlink, .copy = serv_file_copy, .replace = serv_file_replace, .ctx = server };
+    server->files = table_init(&files_ops);
     lcl_hmap_init(&server->post_cbs, lcl_hash_djb2, lcl_streq);
+    server->post_routes = router_init();
+#ifdef CONFIG_QWEB_METRICS
+    server->metrics = metrics_init();
+#endif
+#ifdef CONFIG_QWEB_ACCESS_LOG
+    // Requests are still served without it, only not logged
+    if (!(server->access_log = access_log_init())) {
+        ESP_LOGE(TAG, "Could not start the access log");
+    }
+#endif
     
 
     ESP_LOGI(TAG, "starting server on port: '%d'", config.server_port);
@@ -302,6 +1949,10 @@ qweb_server_t* qweb_init(const qweb_server_config_t* cfg) {
         ESP_ERROR_CHECK(err);
     }
 
+
+    if (!(server->sse = sse_init(server->httpd))) {
+        ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+    }
     
     // Register handler for all files
     httpd_register_uri_handler(server->httpd, &server->get_uri);
@@ -314,83 +1965,714 @@ qweb_server_t* qweb_init(const qweb_server_config_t* cfg) {
 
 
 void qweb_register_file(qweb_server_t* server, const char* fpath, const char* ctype, const char* content, size_t content_length) {
+    qweb_register_file_etag(server, fpath, ctype, content, content_length, NULL);
+}
+
+void qweb_register_file_etag(qweb_server_t* server, const char* fpath, const char* ctype, const char* content, size_t content_length, const char* etag) {
     http_file_ent_t entry = {
         .fname = fpath,
         .type = ctype,
         .content = content,
-        .content_length = content_length
+        .content_length = content_length,
+        .gz_content = NULL,
+        .gz_length = 0,
+        .br_content = NULL,
+        .br_length = 0,
+        .cache_control = NULL,
+        .stream = false,
+        .supress_log = false
     };
     ESP_LOGI(TAG, "Registering file \"%s\" -> \"%s\"", fpath, ctype);
     http_file_ent_t *ent_alloc = (http_file_ent_t*) malloc(sizeof(http_file_ent_t));
     *ent_alloc = entry;
+
+    // Use the tag computed at build time if there is a well-formed one
+    if (etag && strlen(etag) == ETAG_SIZE - 1) {
+        strcpy(ent_alloc->etag, etag);
+    } else {
+        etag_compute(ent_alloc->etag, content, content_length);
+    }
+    
+    METRICS_ADD(server->metrics, &ent_alloc->metrics, "GET", fpath);
+    
+    // The entry replaced is freed once the requests using it are done
+    if (table_insert(server->files, fpath, ent_alloc) != ESP_OK) {
+        ESP_LOGE(TAG, "Could not register file \"%s\"", fpath);
+        METRICS_REMOVE(server->metrics, &ent_alloc->metrics);
+        free(ent_alloc);
+    }
+
+}
+
+qweb_dyn_t* qweb_register_dyn(qweb_server_t* server, const char* fpath, const char* ctype, size_t capacity) {
+    char etag[ETAG_SIZE];
+    etag_compute(etag, NULL, 0);
+    qweb_dyn_t* dyn = dyn_init(capacity, etag, server->dyns);
+    http_file_ent_t* ent_alloc = (http_file_ent_t*) malloc(sizeof(http_file_ent_t));
+    if (!dyn || !ent_alloc) {
+        ESP_LOGE(TAG, "Could not register dynamic file \"%s\"", fpath);
+        free(dyn);
+        free(ent_alloc);
+        return NULL;
+    }
+    // Kept even if it cannot be served, the caller gets it either way
+    server->dyns = dyn;
+
+    *ent_alloc = (http_file_ent_t) {
+        .fname = fpath,
+        .type = ctype,
+        .content = NULL,
+        .content_length = 0,
+        .dyn = dyn,
+        .stream = false,
+        .supress_log = false
+    };
+    strcpy(ent_alloc->etag, etag);
+    ESP_LOGI(TAG, "Registering dynamic file \"%s\" -> \"%s\" (%u x %ub)", fpath, ctype, QWEB_DYN_BUFFERS, capacity);
+
+    METRICS_ADD(server->metrics, &ent_alloc->metrics, "GET", fpath);
+    if (table_insert(server->files, fpath, ent_alloc) != ESP_OK) {
+        ESP_LOGE(TAG, "Could not register file \"%s\"", fpath);
+        METRICS_REMOVE(server->metrics, &ent_alloc->metrics);
+        free(ent_alloc);
+    }
+    return dyn;
+}
+
+void qweb_register_get_cb(qweb_server_t* server, const char* fpath, qweb_get_handler_t handler) {
+    http_get_cb_entry_t* get = (http_get_cb_entry_t*) malloc(sizeof(http_get_cb_entry_t));
+    http_file_ent_t* ent_alloc = (http_file_ent_t*) malloc(sizeof(http_file_ent_t));
+    cache_t* cache = handler.ttl_ms ? cache_init(handler.ttl_ms) : NULL;
+    if (!get || !ent_alloc || (handler.ttl_ms && !cache)) {
+        ESP_LOGE(TAG, "Could not register GET callback \"%s\"", fpath);
+        free(get);
+        free(ent_alloc);
+        cache_free(cache);
+        return;
+    }
+    *get = (http_get_cb_entry_t) {
+        .next = server->get_cbs,
+        .cb = handler.cb,
+        .cache = cache,
+        .async = handler.async
+    };
+    server->get_cbs = get;
+
+    *ent_alloc = (http_file_ent_t) {
+        .fname = fpath,
+        .type = NULL,
+        .content = NULL,
+        .content_length = 0,
+        .get = get,
+        .stream = false,
+        .supress_log = handler.supress_log
+    };
+    ESP_LOGI(TAG, "Registering GET callback \"%s\" (ttl %ums)", fpath, handler.ttl_ms);
+
+    // Workers are only started once something needs them
+    if (handler.async) {
+#ifdef QWEB_HAS_ASYNC_REQ
+        if (!server->async_workers || serv_async_start(server) != ESP_OK) {
+            ESP_LOGW(TAG, "No async workers, \"%s\" runs in the httpd task", fpath);
+        }
+#else
+        ESP_LOGW(TAG, "Async GET callbacks need ESP-IDF v5.2, \"%s\" runs in the httpd task", fpath);
+#endif
+    }
+
+    METRICS_ADD(server->metrics, &ent_alloc->metrics, "GET", fpath);
+    if (table_insert(server->files, fpath, ent_alloc) != ESP_OK) {
+        ESP_LOGE(TAG, "Could not register file \"%s\"", fpath);
+        METRICS_REMOVE(server->metrics, &ent_alloc->metrics);
+        free(ent_alloc);
+    }
+}
+
+void qweb_register_template(qweb_server_t* server, const char* fpath, const qweb_template_t* tpl, qweb_template_slot_cb_t cb, void* ctx) {
+    http_file_ent_t* ent_alloc = (http_file_ent_t*) malloc(sizeof(http_file_ent_t));
+    if (!ent_alloc) {
+        ESP_LOGE(TAG, "Could not register template \"%s\"", fpath);
+        return;
+    }
+    *ent_alloc = (http_file_ent_t) {
+        .fname = fpath,
+        .type = tpl->type,
+        .content = NULL,
+        .content_length = 0,
+        .tpl = tpl,
+        .tpl_cb = cb,
+        .tpl_ctx = ctx,
+        .stream = false,
+        .supress_log = false
+    };
+    ESP_LOGI(TAG, "Registering template \"%s\" -> \"%s\" (%u segments, %u slots)", fpath, tpl->type,
+        (unsigned) tpl->segment_count, (unsigned) tpl->slot_count);
+
+    METRICS_ADD(server->metrics, &ent_alloc->metrics, "GET", fpath);
+    if (table_insert(server->files, fpath, ent_alloc) != ESP_OK) {
+        ESP_LOGE(TAG, "Could not register file \"%s\"", fpath);
+        METRICS_REMOVE(server->metrics, &ent_alloc->metrics);
+        free(ent_alloc);
+    }
+}
+
+char* qweb_dyn_acquire(qweb_dyn_t* dyn, size_t* capacity) {
+    if (capacity) {
+        *capacity = dyn_capacity(dyn);
+    }
+    return dyn_acquire(dyn);
+}
+
+esp_err_t qweb_dyn_commit(qweb_dyn_t* dyn, char* buf, size_t length) {
+    if (length > dyn_capacity(dyn)) {
+        dyn_cancel(dyn, buf);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // Hashed before publishing, readers only ever see complete versions
+    char etag[ETAG_SIZE];
+    etag_compute(etag, buf, length);
+    dyn_publish(dyn, buf, length, etag);
+    return ESP_OK;
+}
+
+void qweb_dyn_cancel(qweb_dyn_t* dyn, char* buf) {
+    dyn_cancel(dyn, buf);
+}
+
+esp_err_t qweb_dyn_set(qweb_dyn_t* dyn, const char* content, size_t content_length) {
+    if (content_length > dyn_capacity(dyn)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    char* buf = dyn_acquire(dyn);
+    if (!buf) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    memcpy(buf, content, content_length);
+    return qweb_dyn_commit(dyn, buf, content_length);
+}
+void qweb_register_post_cb(qweb_server_t* server, const char *path, qweb_post_handler_t handler)
+{
+    http_post_cb_entry_t entry = {
+        .fpath = path,
+        .cb = handler.cb,
+        .writer_cb = handler.writer_cb,
+        .params_cb = handler.params_cb,
+        .streaming = false,
+        .supress_log = handler.supress_log,
+        .async = handler.async
+    };
+
+    ESP_LOGI(TAG, "registering post callback: { \"%s\" } ", path);
+
+    // Workers are only started once something needs them
+    if (handler.async) {
+#ifdef QWEB_HAS_ASYNC_REQ
+        if (!server->async_workers || serv_async_start(server) != ESP_OK) {
+            ESP_LOGW(TAG, "No async workers, \"%s\" runs in the httpd task", path);
+        }
+#else
+        ESP_LOGW(TAG, "Async post handlers need ESP-IDF v5.2, \"%s\" runs in the httpd task", path);
+#endif
+    }
+    
+    http_post_cb_entry_t *ent_alloc = (http_post_cb_entry_t*) malloc(sizeof(http_post_cb_entry_t));
+    *ent_alloc = entry;
+    
+    METRICS_ADD(server->metrics, &ent_alloc->metrics, "POST", path);
     
     bool old_w;
     lcl_any_t old;
-    lcl_hmap_insert( server->files, (lcl_any_t) fpath, ent_alloc, &old, &old_w );
+    lcl_hmap_insert( server->post_cbs, (lcl_any_t) path, ent_alloc, &old, &old_w );
     if (old_w) {
+        METRICS_REMOVE(server->metrics, &((http_post_cb_entry_t*) old)->metrics);
         free(old);
     }
-    
+
+
 }
-void qweb_register_post_cb(qweb_server_t* server, const char *path, qweb_post_handler_t handler)
+
+void qweb_register_post_stream(qweb_server_t* server, const char *path, qweb_post_stream_handler_t handler)
 {
     http_post_cb_entry_t entry = {
         .fpath = path,
-        .cb = handler.cb,
-        .supress_log = handler.supress_log
+        .stream = handler,
+        .streaming = true,
+        .supress_log = handler.supress_log,
+        .async = false
     };
 
-    ESP_LOGI(TAG, "registering post callback: { \"%s\" } ", path);
+    ESP_LOGI(TAG, "registering post stream: { \"%s\" } ", path);
     
     http_post_cb_entry_t *ent_alloc = (http_post_cb_entry_t*) malloc(sizeof(http_post_cb_entry_t));
     *ent_alloc = entry;
     
+    METRICS_ADD(server->metrics, &ent_alloc->metrics, "POST", path);
+    
+    bool old_w;
+    lcl_any_t old;
+    lcl_hmap_insert( server->post_cbs, (lcl_any_t) path, ent_alloc, &old, &old_w );
+    if (old_w) {
+        METRICS_REMOVE(server->metrics, &((http_post_cb_entry_t*) old)->metrics);
+        free(old);
+    }
+}
+
+void qweb_register_post_form(qweb_server_t* server, const char *path, qweb_post_form_handler_t handler)
+{
+    http_post_cb_entry_t entry = {
+        .fpath = path,
+        .form = handler,
+        .multipart = true,
+        .supress_log = handler.supress_log,
+        .async = false
+    };
+
+    ESP_LOGI(TAG, "registering post form: { \"%s\" } ", path);
+
+    http_post_cb_entry_t *ent_alloc = (http_post_cb_entry_t*) malloc(sizeof(http_post_cb_entry_t));
+    *ent_alloc = entry;
+
+    METRICS_ADD(server->metrics, &ent_alloc->metrics, "POST", path);
+
+    bool old_w;
+    lcl_any_t old;
+    lcl_hmap_insert( server->post_cbs, (lcl_any_t) path, ent_alloc, &old, &old_w );
+    if (old_w) {
+        METRICS_REMOVE(server->metrics, &((http_post_cb_entry_t*) old)->metrics);
+        free(old);
+    }
+}
+
+esp_err_t qweb_register_batch(qweb_server_t* server, const char* path)
+{
+    ESP_LOGI(TAG, "registering post batch: { \"%s\" } ", path);
+
+    http_post_cb_entry_t *ent_alloc = (http_post_cb_entry_t*) malloc(sizeof(http_post_cb_entry_t));
+    if (!ent_alloc) {
+        return ESP_ERR_NO_MEM;
+    }
+    *ent_alloc = (http_post_cb_entry_t) {
+        .fpath = path,
+        .cb = NULL,
+        .writer_cb = NULL,
+        .batch = true,
+        .supress_log = false,
+        .async = false
+    };
+
+    METRICS_ADD(server->metrics, &ent_alloc->metrics, "POST", path);
+
     bool old_w;
     lcl_any_t old;
     lcl_hmap_insert( server->post_cbs, (lcl_any_t) path, ent_alloc, &old, &old_w );
     if (old_w) {
+        METRICS_REMOVE(server->metrics, &((http_post_cb_entry_t*) old)->metrics);
+        free(old);
+    }
+    return ESP_OK;
+}
+
+esp_err_t qweb_register_post_route(qweb_server_t* server, const char* pattern, qweb_post_route_handler_t handler)
+{
+    http_post_route_entry_t entry = {
+        .pattern = pattern,
+        .cb = handler.cb,
+        .supress_log = handler.supress_log
+    };
+
+    ESP_LOGI(TAG, "registering post route: { \"%s\" } ", pattern);
+
+    http_post_route_entry_t *ent_alloc = (http_post_route_entry_t*) malloc(sizeof(http_post_route_entry_t));
+    if (!ent_alloc) {
+        return ESP_ERR_NO_MEM;
+    }
+    *ent_alloc = entry;
+
+    void* old;
+    esp_err_t err = router_insert(server->post_routes, pattern, ent_alloc, &old);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Could not add route pattern \"%s\" (%s)", pattern, esp_err_to_name(err));
+        free(ent_alloc);
+        return err;
+    }
+    METRICS_ADD(server->metrics, &ent_alloc->metrics, "POST", pattern);
+    if (old) {
+        METRICS_REMOVE(server->metrics, &((http_post_route_entry_t*) old)->metrics);
         free(old);
     }
+    return ESP_OK;
+}
+
+esp_err_t qweb_register_ws(qweb_server_t* server, const char* path, qweb_ws_handler_t handler)
+{
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    if (server->ws_count == QWEB_WS_MAX_ENDPOINTS) {
+        ESP_LOGE(TAG, "No room for WebSocket endpoint \"%s\"", path);
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "registering websocket: { \"%s\" } ", path);
+
+    ws_endpoint_t* endpoint = ws_endpoint_new(path, handler, server->max_recvlen);
+    if (!endpoint) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    httpd_uri_t ws_uri = {
+        .method = HTTP_GET,
+        .uri = path,
+        .user_ctx = endpoint,
+        .handler = ws_handler,
+        .is_websocket = true
+    };
+
+    // Handlers are tried in order and the catch-all GET matches everything,
+    // so it goes back after the endpoint
+    httpd_unregister_uri_handler(server->httpd, server->get_uri.uri, HTTP_GET);
+    esp_err_t err = httpd_register_uri_handler(server->httpd, &ws_uri);
+    httpd_register_uri_handler(server->httpd, &server->get_uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Could not register WebSocket endpoint \"%s\" (%d)", path, err);
+        ws_endpoint_free(endpoint);
+        return err;
+    }
+
+    server->ws_paths[server->ws_count] = path;
+    server->ws_endpoints[server->ws_count] = endpoint;
+    server->ws_count++;
+    return ESP_OK;
+#else
+    ESP_LOGE(TAG, "WebSocket endpoint \"%s\" needs CONFIG_HTTPD_WS_SUPPORT", path);
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t qweb_register_metrics(qweb_server_t* server, const char* path)
+{
+#ifdef CONFIG_QWEB_METRICS
+    ESP_LOGI(TAG, "registering metrics: { \"%s\" } ", path);
+    server->metrics_path = path;
+    return ESP_OK;
+#else
+    ESP_LOGE(TAG, "Metrics at \"%s\" need CONFIG_QWEB_METRICS", path);
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t qweb_set_access_sink(qweb_server_t* server, qweb_access_sink_t sink, void* ctx)
+{
+#ifdef CONFIG_QWEB_ACCESS_LOG
+    if (!server->access_log) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    access_log_set_sink(server->access_log, sink, ctx);
+    return ESP_OK;
+#else
+    ESP_LOGE(TAG, "Access log sinks need CONFIG_QWEB_ACCESS_LOG");
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+uint32_t qweb_access_log_dropped(const qweb_server_t* server)
+{
+#ifdef CONFIG_QWEB_ACCESS_LOG
+    return server->access_log ? access_log_dropped(server->access_log) : 0;
+#else
+    return 0;
+#endif
+}
+
+esp_err_t qweb_register_sse(qweb_server_t* server, const char* path)
+{
+    ESP_LOGI(TAG, "registering event stream: { \"%s\" } ", path);
+    return sse_register(server->sse, path);
+}
+
+esp_err_t qweb_sse_publish(qweb_server_t* server, const char* path, const char* event, const char* data)
+{
+    return sse_publish(server->sse, path, event, data);
+}
 
+esp_err_t qweb_ws_send(qweb_server_t* server, int fd, const char* data, size_t data_len, bool binary)
+{
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    return ws_send(server->httpd, NULL, fd, data, data_len, binary);
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
 
+esp_err_t qweb_ws_broadcast(qweb_server_t* server, const char* path, const char* data, size_t data_len, bool binary)
+{
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    for (size_t i = 0; i < server->ws_count; i++) {
+        if (strcmp(server->ws_paths[i], path) == 0) {
+            return ws_send(server->httpd, server->ws_endpoints[i], -1, data, data_len, binary);
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
 }
 
 esp_err_t qweb_unregister_file(qweb_server_t *server, const char *path)
 {
-    lcl_any_t file_ent = NULL;
-    lcl_hmap_remove(server->files, path, NULL, &file_ent);
-    free(file_ent);
-    return LCL_OK;
+    // The entry is freed once the requests using it are done
+    table_remove(server->files, path);
+    return ESP_OK;
 }
 
 esp_err_t qweb_unregister_post_cb(qweb_server_t *server, const char *path)
 {
     lcl_any_t cb_ent = NULL;
     lcl_hmap_remove(server->post_cbs, path, NULL, &cb_ent);
-    free(cb_ent);
+    if (cb_ent) {
+        METRICS_REMOVE(server->metrics, &((http_post_cb_entry_t*) cb_ent)->metrics);
+        free(cb_ent);
+    }
     return LCL_OK;
 }
 
+void qweb_register_manifest(qweb_server_t* server, const qweb_manifest_t* manifest) {
+    serv_manifest_t* served = NULL;
+    if (manifest) {
+        ESP_LOGI(TAG, "Registering manifest of %u files", manifest->file_count);
+        size_t size = sizeof(serv_manifest_t);
+#ifdef CONFIG_QWEB_METRICS
+        // Manifest files are constant, their counters are kept on the side
+        size += manifest->file_count * sizeof(metrics_route_t);
+#endif
+        served = calloc(size, 1);
+        if (!served) {
+            ESP_LOGE(TAG, "Could not register manifest");
+            return;
+        }
+        served->manifest = manifest;
+#ifdef CONFIG_QWEB_METRICS
+        for (size_t i = 0; i < manifest->file_count; i++) {
+            metrics_add(server->metrics, &served->metrics[i], "GET", manifest->files[i].path);
+        }
+#endif
+    }
+
+    // Requests being served may still use the previous manifest
+    serv_manifest_t* old = atomic_exchange_explicit(&server->manifest, served, memory_order_acq_rel);
+    if (old) {
+#ifdef CONFIG_QWEB_METRICS
+        for (size_t i = 0; i < old->manifest->file_count; i++) {
+            metrics_remove(server->metrics, &old->metrics[i]);
+        }
+#endif
+        table_defer_free(server->files, old);
+    }
+}
+
+typedef struct serv_fs_index {
+    qweb_server_t* server;
+    size_t count;                   // files registered so far
+} serv_fs_index_t;
+
+/**
+ * @brief Register a file found by indexing an image or a directory,
+ *  replacing any file registered at its url
+ */
+static esp_err_t serv_register_fs_file(const fs_file_t* file, void* arg) {
+    serv_fs_index_t* index = (serv_fs_index_t*) arg;
+    qweb_server_t* server = index->server;
+
+    // The strings of directory files do not outlive the visit, they are kept after the entry
+    size_t url_size = 0, path_size = 0, gz_path_size = 0;
+    if (file->path) {
+        url_size = strlen(file->url) + 1;
+        path_size = strlen(file->path) + 1;
+        gz_path_size = file->gz_path ? strlen(file->gz_path) + 1 : 0;
+    }
+    http_file_ent_t* ent_alloc = (http_file_ent_t*) malloc(sizeof(http_file_ent_t) + url_size + path_size + gz_path_size);
+    if (!ent_alloc) {
+        return ESP_ERR_NO_MEM;
+    }
+    *ent_alloc = (http_file_ent_t) {
+        .fname = file->url,
+        .type = file->type,
+        .content = file->content,
+        .content_length = file->content_length,
+        .gz_content = file->gz_content,
+        .gz_length = file->gz_length,
+        .br_content = NULL,
+        .br_length = 0,
+        .cache_control = file->cache_control,
+        .fs_path = file->path,
+        .fs_gz_path = file->gz_path,
+        .stream = false,
+        .supress_log = false
+    };
+    if (file->path) {
+        char* strings = (char*) &ent_alloc[1];
+        ent_alloc->fname = memcpy(strings, file->url, url_size);
+        ent_alloc->fs_path = memcpy(&strings[url_size], file->path, path_size);
+        if (file->gz_path) {
+            ent_alloc->fs_gz_path = memcpy(&strings[url_size + path_size], file->gz_path, gz_path_size);
+        }
+    }
+    snprintf(ent_alloc->etag, ETAG_SIZE, "%s", file->etag);
+    ESP_LOGD(TAG, "Registering file \"%s\" -> \"%s\"", ent_alloc->fname, ent_alloc->type);
+
+    METRICS_ADD(server->metrics, &ent_alloc->metrics, "GET", ent_alloc->fname);
+    esp_err_t err = table_insert(server->files, ent_alloc->fname, ent_alloc);
+    if (err != ESP_OK) {
+        METRICS_REMOVE(server->metrics, &ent_alloc->metrics);
+        free(ent_alloc);
+        return err;
+    }
+    index->count++;
+    return ESP_OK;
+}
+
+esp_err_t qweb_register_dir(qweb_server_t* server, const char* dir, const char* url_prefix) {
+    serv_fs_index_t index = { .server = server, .count = 0 };
+    esp_err_t err = fs_dir_index(dir, url_prefix, serv_register_fs_file, &index);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Could not index %s: %s", dir, esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "Registered %u files from %s at %s", index.count, dir, url_prefix);
+    return ESP_OK;
+}
+
+esp_err_t qweb_register_image(qweb_server_t* server, const void* image, size_t image_len) {
+    serv_fs_index_t index = { .server = server, .count = 0 };
+    esp_err_t err = fs_image_index(image, image_len, serv_register_fs_file, &index);
+    ESP_LOGI(TAG, "Registered %u files from an image", index.count);
+    return err;
+}
+
+esp_err_t qweb_register_partition(qweb_server_t* server, const char* label) {
+    fs_map_t* map = fs_map_partition(label, server->fs_maps);
+    if (!map) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    // Kept even if the image turns out malformed, some files may refer to it
+    server->fs_maps = map;
+    size_t len;
+    const void* data = fs_map_data(map, &len);
+    return qweb_register_image(server, data, len);
+}
+
+esp_err_t qweb_unregister_post_route(qweb_server_t *server, const char *pattern)
+{
+    void* route_ent = router_remove(server->post_routes, pattern);
+    if (!route_ent) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    METRICS_REMOVE(server->metrics, &((http_post_route_entry_t*) route_ent)->metrics);
+    free(route_ent);
+    return ESP_OK;
+}
+
+// Entries are never changed in place, the setters publish edited copies
+
+static void serv_file_edit_length(void* value, void* arg) {
+    http_file_ent_t* content = (http_file_ent_t*) value;
+    if (!content->fs_path && !content->dyn && !content->tpl && !content->get) {
+        content->content_length = *(size_t*) arg;
+        etag_compute(content->etag, content->content, content->content_length);
+    }
+}
+
+static void serv_file_edit_stream(void* value, void* arg) {
+    ((http_file_ent_t*) value)->stream = *(bool*) arg;
+}
+
+static void serv_file_edit_cache_control(void* value, void* arg) {
+    ((http_file_ent_t*) value)->cache_control = (const char*) arg;
+}
+
+static void serv_file_edit_log(void* value, void* arg) {
+    ((http_file_ent_t*) value)->supress_log = !*(bool*) arg;
+}
+
+typedef struct serv_file_variant {
+    qweb_encoding_t encoding;
+    const char* content;
+    size_t content_length;
+} serv_file_variant_t;
+
+static void serv_file_edit_encoded(void* value, void* arg) {
+    http_file_ent_t* file = (http_file_ent_t*) value;
+    const serv_file_variant_t* variant = (const serv_file_variant_t*) arg;
+    if (variant->encoding == QWEB_ENCODING_GZIP) {
+        file->gz_content = variant->content;
+        file->gz_length = variant->content_length;
+    } else {
+        file->br_content = variant->content;
+        file->br_length = variant->content_length;
+    }
+}
+
 void qweb_file_trunc_path(qweb_server_t* server, const char* fpath, size_t length) {
-    http_file_ent_t* content;
-    lcl_any_t content_any = NULL;
-    lcl_hmap_get( server->files, (lcl_any_t) fpath, &content_any ); // error handled later
-    content = lcl_any2ptr(content_any);
-    if (content) {
-        content->content_length = length;
+    table_update(server->files, fpath, serv_file_edit_length, &length);
+}
+
+esp_err_t qweb_file_set_stream(qweb_server_t* server, const char* fpath, bool stream) {
+    return table_update(server->files, fpath, serv_file_edit_stream, &stream);
+}
+
+esp_err_t qweb_file_set_cache_control(qweb_server_t* server, const char* fpath, const char* cache_control) {
+    return table_update(server->files, fpath, serv_file_edit_cache_control, (void*) cache_control);
+}
+
+esp_err_t qweb_file_set_log(qweb_server_t* server, const char* fpath, bool log) {
+    return table_update(server->files, fpath, serv_file_edit_log, &log);
+}
+
+esp_err_t qweb_file_set_encoded(qweb_server_t* server, const char* fpath, qweb_encoding_t encoding, const char* content, size_t content_length) {
+    if (encoding != QWEB_ENCODING_GZIP && encoding != QWEB_ENCODING_BR) {
+        return ESP_ERR_INVALID_ARG;
     }
+    serv_file_variant_t variant = { .encoding = encoding, .content = content, .content_length = content_length };
+    return table_update(server->files, fpath, serv_file_edit_encoded, &variant);
 }
 
 
 
 void qweb_free(qweb_server_t* server) {
 
+#ifdef QWEB_HAS_ASYNC_REQ
+    // Let the workers finish their requests while the server still runs
+    serv_async_stop(server);
+#endif
 #ifdef CONFIG_QWEB_EN_SSL
     if (server->ssl) httpd_ssl_stop(server->httpd);
     else
 #endif
     httpd_stop(server->httpd);
-    lcl_hmap_free(&server->files, NULL, LCL_DEALLOC_FREE);
+    table_free(server->files);
+    free(atomic_load(&server->manifest));
     lcl_hmap_free(&server->post_cbs, NULL, LCL_DEALLOC_FREE);
-
+    router_free(server->post_routes, free);
+    sse_free(server->sse);
+    // The files pointing into the images are gone
+    fs_map_free(server->fs_maps);
+    dyn_free(server->dyns);
+    while (server->get_cbs) {
+        http_get_cb_entry_t* next = server->get_cbs->next;
+        cache_free(server->get_cbs->cache);
+        free(server->get_cbs);
+        server->get_cbs = next;
+    }
+#ifdef CONFIG_QWEB_ACCESS_LOG
+    // Nothing pushes records anymore, the last ones are written out
+    access_log_free(server->access_log);
+#endif
+#ifdef CONFIG_QWEB_METRICS
+    metrics_free(server->metrics);
+#endif
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    // Sessions are gone with the httpd, nothing refers to the endpoints anymore
+    for (size_t i = 0; i < server->ws_count; i++) {
+        ws_endpoint_free(server->ws_endpoints[i]);
+    }
+#endif
+    free(server);
 }
\ No newline at end of file
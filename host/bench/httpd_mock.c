@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "httpd_mock.h"
+
+/**
+ * @brief esp_http_server API without sockets: handlers are called
+ *  directly by mock_request and queued work runs immediately.
+ */
+
+typedef struct mock_httpd {
+    httpd_config_t config;
+    httpd_uri_t* handlers;      // max_uri_handlers slots, free when uri is NULL
+} mock_httpd_t;
+
+typedef struct mock_aux {
+    const char* body;
+    size_t pos;
+    const char* status;
+    size_t sent;
+    char* capture;              // start of the content sent, may be NULL
+    size_t capture_size;
+} mock_aux_t;
+
+static mock_httpd_t* last_started = NULL;
+static const char* content_type = NULL;
+
+
+void mock_set_content_type(const char* type) {
+    content_type = type;
+}
+
+int mock_request(httpd_method_t method, const char* uri, const char* body, size_t content_len, size_t* sent) {
+    return mock_request_capture(method, uri, body, content_len, NULL, 0, sent);
+}
+
+int mock_request_capture(httpd_method_t method, const char* uri, const char* body, size_t content_len,
+    char* resp, size_t resp_size, size_t* sent) {
+    mock_httpd_t* hd = last_started;
+    httpd_req_t req = {
+        .handle = hd,
+        .method = method,
+        .content_len = content_len
+    };
+    mock_aux_t aux = { .body = body, .capture = resp, .capture_size = resp_size };
+    req.aux = &aux;
+    snprintf((char*) req.uri, sizeof(req.uri), "%s", uri);
+
+    size_t uri_len = strcspn(uri, "?");
+    for (size_t i = 0; i < hd->config.max_uri_handlers; i++) {
+        const httpd_uri_t* handler = &hd->handlers[i];
+        if (handler->uri && handler->method == method && hd->config.uri_match_fn(handler->uri, uri, uri_len)) {
+            req.user_ctx = handler->user_ctx;
+            handler->handler(&req);
+            break;
+        }
+    }
+    if (req.sess_ctx && req.free_ctx) {
+        req.free_ctx(req.sess_ctx);
+    }
+    if (sent) {
+        *sent = aux.sent;
+    }
+    return aux.status ? atoi(aux.status) : 0;
+}
+
+
+esp_err_t httpd_start(httpd_handle_t* handle, const httpd_config_t* config) {
+    mock_httpd_t* hd = calloc(sizeof(mock_httpd_t), 1);
+    hd->config = *config;
+    hd->handlers = calloc(sizeof(httpd_uri_t), config->max_uri_handlers);
+    *handle = last_started = hd;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+    mock_httpd_t* hd = handle;
+    if (hd == last_started) {
+        last_started = NULL;
+    }
+    free(hd->handlers);
+    free(hd);
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t* uri_handler) {
+    mock_httpd_t* hd = handle;
+    for (size_t i = 0; i < hd->config.max_uri_handlers; i++) {
+        if (!hd->handlers[i].uri) {
+            hd->handlers[i] = *uri_handler;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_HTTPD_HANDLERS_FULL;
+}
+
+esp_err_t httpd_unregister_uri_handler(httpd_handle_t handle, const char* uri, httpd_method_t method) {
+    mock_httpd_t* hd = handle;
+    for (size_t i = 0; i < hd->config.max_uri_handlers; i++) {
+        httpd_uri_t* handler = &hd->handlers[i];
+        if (handler->uri && handler->method == method && strcmp(handler->uri, uri) == 0) {
+            memset(handler, 0, sizeof(*handler));
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+int httpd_req_recv(httpd_req_t* r, char* buf, size_t buf_len) {
+    mock_aux_t* aux = r->aux;
+    size_t left = r->content_len - aux->pos;
+    size_t amt = buf_len < left ? buf_len : left;
+    memcpy(buf, &aux->body[aux->pos], amt);
+    aux->pos += amt;
+    return amt;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t* r, const char* field) {
+    return content_type && strcasecmp(field, "Content-Type") == 0 ? strlen(content_type) : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t* r, const char* field, char* val, size_t val_size) {
+    if (!content_type || strcasecmp(field, "Content-Type") != 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    snprintf(val, val_size, "%s", content_type);
+    return strlen(content_type) < val_size ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t* r) {
+    const char* query = strchr(r->uri, '?');
+    return query ? strlen(query + 1) : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t* r, char* buf, size_t buf_len) {
+    const char* query = strchr(r->uri, '?');
+    if (!query) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    snprintf(buf, buf_len, "%s", query + 1);
+    return strlen(query + 1) < buf_len ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+int httpd_req_to_sockfd(httpd_req_t* r) {
+    return 0;
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t* r, httpd_req_t** out) {
+    // Async handlers are not benchmarked, the servers run without workers
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t* r) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t* r, const char* status) {
+    ((mock_aux_t*) r->aux)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t* r, const char* type) {
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t* r, const char* field, const char* value) {
+    return ESP_OK;
+}
+
+/**
+ * @brief Count content sent, and keep it while there is room
+ */
+static void mock_sent(mock_aux_t* aux, const char* buf, size_t len) {
+    if (aux->capture && len && aux->sent < aux->capture_size) {
+        size_t room = aux->capture_size - aux->sent;
+        memcpy(&aux->capture[aux->sent], buf, len < room ? len : room);
+    }
+    aux->sent += len;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t* r, const char* buf, ssize_t buf_len) {
+    mock_aux_t* aux = r->aux;
+    if (!aux->status) {
+        aux->status = HTTPD_200;
+    }
+    mock_sent(aux, buf, buf_len == HTTPD_RESP_USE_STRLEN ? strlen(buf) : (size_t) buf_len);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t* r, const char* buf, ssize_t buf_len) {
+    if (buf) {
+        return httpd_resp_send(r, buf, buf_len);
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t* req, httpd_err_code_t error, const char* msg) {
+    static const char* const statuses[HTTPD_ERR_CODE_MAX] = {
+        [HTTPD_500_INTERNAL_SERVER_ERROR] = "500",
+        [HTTPD_501_METHOD_NOT_IMPLEMENTED] = "501",
+        [HTTPD_505_VERSION_NOT_SUPPORTED] = "505",
+        [HTTPD_400_BAD_REQUEST] = "400",
+        [HTTPD_401_UNAUTHORIZED] = "401",
+        [HTTPD_403_FORBIDDEN] = "403",
+        [HTTPD_404_NOT_FOUND] = "404",
+        [HTTPD_405_METHOD_NOT_ALLOWED] = "405",
+        [HTTPD_408_REQ_TIMEOUT] = "408",
+        [HTTPD_411_LENGTH_REQUIRED] = "411",
+        [HTTPD_414_URI_TOO_LONG] = "414",
+        [HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE] = "431",
+    };
+    ((mock_aux_t*) req->aux)->status = statuses[error];
+    return ESP_OK;
+}
+
+int httpd_send(httpd_req_t* r, const char* buf, size_t buf_len) {
+    mock_sent(r->aux, buf, buf_len);
+    return buf_len;
+}
+
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char* buf, size_t buf_len, int flags) {
+    return buf_len;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void* arg) {
+    work(arg);
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+    return ESP_OK;
+}
+
+void* httpd_get_global_user_ctx(httpd_handle_t handle) {
+    return ((mock_httpd_t*) handle)->config.global_user_ctx;
+}
@@ -0,0 +1,30 @@
+#ifndef QWEB_HOST_HTTPD_MOCK_H
+#define QWEB_HOST_HTTPD_MOCK_H
+
+#include <stdlib.h>
+#include "esp_http_server.h"
+
+/**
+ * @brief Run a request through the handlers registered with the last
+ *  mocked httpd started, in the calling thread. The response is counted,
+ *  not kept.
+ * @param body content of the request (content_len bytes)
+ * @param sent set to the amount of content sent back, may be NULL
+ * @returns the HTTP status code of the response, 0 if none was sent
+ */
+int mock_request(httpd_method_t method, const char* uri, const char* body, size_t content_len, size_t* sent);
+
+/**
+ * @brief Run a request like mock_request, keeping the start of the response content
+ * @param resp set to the first resp_size bytes of content sent back
+ */
+int mock_request_capture(httpd_method_t method, const char* uri, const char* body, size_t content_len,
+    char* resp, size_t resp_size, size_t* sent);
+
+/**
+ * @brief Set the Content-Type header of the requests that follow, NULL for none
+ * @param type header value (not copied)
+ */
+void mock_set_content_type(const char* type);
+
+#endif
@@ -0,0 +1,419 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <malloc.h>
+#include "esp-qweb.h"
+#include "esp_log.h"
+#include "httpd_mock.h"
+
+/**
+ * @brief Microbenchmarks of the request dispatch, lookup and registration
+ *  paths, run against a mocked httpd. Reports the time per operation, the
+ *  allocations per operation and the peak heap while running.
+ *
+ *  qweb-bench [filter]     runs the benchmarks whose name contains filter
+ */
+
+// Minimum time each benchmark runs for
+#define BENCH_MIN_NS        (200 * 1000 * 1000ull)
+
+// Longest path registered by a benchmark
+#define BENCH_PATH_MAX      (32)
+
+static const size_t table_sizes[] = { 10, 100, 1000, 10000 };
+static const size_t body_sizes[] = { 0, 64, 1024, 8192 };
+static const size_t batch_sizes[] = { 1, 4, 16 };
+static const size_t form_sizes[] = { 8192, 65536, 1048576 };
+
+// Data of each call of a batch
+#define BENCH_BATCH_CALL    (64)
+
+// Boundary of the form uploads, as browsers make them
+#define BENCH_BOUNDARY      "----WebKitFormBoundary7MA4YWxkTrZu0gW"
+
+
+/////////////////////
+// Heap accounting, malloc and friends are wrapped by the linker
+/////////////////////
+
+static struct {
+    uint64_t allocs;
+    size_t live;
+    size_t peak;
+} heap;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+static void heap_add(void* ptr) {
+    if (ptr) {
+        heap.allocs++;
+        heap.live += malloc_usable_size(ptr);
+        if (heap.live > heap.peak) {
+            heap.peak = heap.live;
+        }
+    }
+}
+
+void* __wrap_malloc(size_t size) {
+    void* ptr = __real_malloc(size);
+    heap_add(ptr);
+    return ptr;
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+    void* ptr = __real_calloc(n, size);
+    heap_add(ptr);
+    return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    size_t old = ptr ? malloc_usable_size(ptr) : 0;
+    void* moved = __real_realloc(ptr, size);
+    if (moved || !size) {
+        heap.live -= old;
+        heap_add(moved);
+    }
+    return moved;
+}
+
+void __wrap_free(void* ptr) {
+    if (ptr) {
+        heap.live -= malloc_usable_size(ptr);
+    }
+    __real_free(ptr);
+}
+
+
+/////////////////////
+// Runner
+/////////////////////
+
+typedef struct bench {
+    qweb_server_t* server;
+    size_t count;                   // routes registered
+    char (*paths)[BENCH_PATH_MAX];  // registered paths (qweb does not copy them)
+    char (*misses)[BENCH_PATH_MAX]; // paths that are not registered
+    char* body;
+    size_t body_len;
+} bench_t;
+
+typedef void (*bench_fn_t)(bench_t* bench, size_t i);
+
+static const char* filter = NULL;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void bench_run(const char* name, bench_fn_t fn, bench_t* bench) {
+    // Warm up the caches and any lazily allocated state
+    for (size_t i = 0; i < 64; i++) {
+        fn(bench, i);
+    }
+
+    // Double the iterations until the run is long enough to time
+    uint64_t elapsed = 0;
+    uint64_t allocs = 0;
+    size_t peak = 0;
+    size_t iters;
+    for (iters = 1024; ; iters *= 2) {
+        uint64_t allocs_before = heap.allocs;
+        heap.peak = heap.live;
+        uint64_t start = now_ns();
+        for (size_t i = 0; i < iters; i++) {
+            fn(bench, i);
+        }
+        elapsed = now_ns() - start;
+        allocs = heap.allocs - allocs_before;
+        peak = heap.peak;
+        if (elapsed >= BENCH_MIN_NS) {
+            break;
+        }
+    }
+
+    printf("%-28s %12.1f ns/op %10.2f allocs/op %12zu B peak\n",
+        name, (double) elapsed / iters, (double) allocs / iters, peak);
+}
+
+static bool bench_selected(const char* name) {
+    return !filter || strstr(name, filter);
+}
+
+
+/////////////////////
+// Servers
+/////////////////////
+
+static const char file_content[] = "<html>qweb</html>";
+
+static qweb_post_cb_ret_t post_cb(const char* uri, const char* data, size_t data_len) {
+    return QWEB_POST_RET_OK;
+}
+
+static qweb_post_cb_ret_t route_cb(const char* uri, const qweb_route_params_t* params, const char* data, size_t data_len) {
+    return QWEB_POST_RET_OK;
+}
+
+static qweb_post_cb_ret_t params_cb(const char* uri, const qweb_params_t* params, const char* data, size_t data_len) {
+    long id;
+    float level;
+    bool on;
+    qweb_param_int(params, "id", &id);
+    qweb_param_float(params, "level", &level);
+    qweb_param_bool(params, "on", &on);
+    return qweb_param(params, "name", NULL) ? QWEB_POST_RET_OK : QWEB_POST_RET_FAIL;
+}
+
+static esp_err_t form_data(void* ctx, const char* data, size_t data_len) {
+    return ESP_OK;
+}
+
+static qweb_post_cb_ret_t form_end(void* ctx, esp_err_t status) {
+    return status == ESP_OK ? QWEB_POST_RET_OK : QWEB_POST_RET_FAIL;
+}
+
+// A page as qweb_template.py compiles it, a header and a table around three slots
+static char tpl_head[2048];
+static char tpl_tail[1024];
+static const qweb_template_segment_t tpl_segments[] = {
+    { .literal = tpl_head, .literal_len = sizeof(tpl_head), .slot = 0 },
+    { .literal = "</td></tr>\n<tr><td>Uptime</td><td>", .literal_len = 34, .slot = 1 },
+    { .literal = " s</td></tr>\n<tr><td>Heap</td><td>", .literal_len = 34, .slot = 2 },
+    { .literal = tpl_tail, .literal_len = sizeof(tpl_tail), .slot = -1 }
+};
+static const char* const tpl_slots[] = { "name", "uptime", "heap" };
+static const qweb_template_t tpl_page = {
+    .segments = tpl_segments,
+    .segment_count = sizeof(tpl_segments) / sizeof(tpl_segments[0]),
+    .slot_names = tpl_slots,
+    .slot_count = 3,
+    .type = HTTP_MIME_HTML
+};
+
+static esp_err_t tpl_slot(const char* uri, int slot, qweb_resp_writer_t* writer, void* ctx) {
+    switch (slot) {
+    case 0: return qweb_resp_write_html(writer, "Kitchen <sensor> \"A\"");
+    case 1: return qweb_resp_printf(writer, "%lu", 86400ul);
+    default: return qweb_resp_printf(writer, "%u", 182344u);
+    }
+}
+
+static esp_err_t get_cb(const char* uri, qweb_resp_writer_t* writer) {
+    qweb_resp_set_type(writer, HTTP_MIME_JSON);
+    return qweb_resp_printf(writer, "{\"temperature\":%.1f,\"humidity\":%d}", 21.5, 40);
+}
+
+static void bench_setup(bench_t* bench, size_t count) {
+    qweb_server_config_t cfg = QWEB_SERVER_CFG_DEFAULT("qweb bench");
+    cfg.async_workers = 0;
+    cfg.cache_control = NULL;
+    bench->server = qweb_init(&cfg);
+    bench->count = count;
+    bench->paths = calloc(count, BENCH_PATH_MAX);
+    bench->misses = calloc(count, BENCH_PATH_MAX);
+    for (size_t i = 0; i < count; i++) {
+        snprintf(bench->paths[i], BENCH_PATH_MAX, "/files/%zu.html", i);
+        snprintf(bench->misses[i], BENCH_PATH_MAX, "/missing/%zu.html", i);
+        qweb_register_file(bench->server, bench->paths[i], HTTP_MIME_HTML, file_content, sizeof(file_content) - 1);
+    }
+    bench->body = NULL;
+    bench->body_len = 0;
+}
+
+static void bench_teardown(bench_t* bench) {
+    qweb_free(bench->server);
+    free(bench->paths);
+    free(bench->misses);
+    free(bench->body);
+}
+
+
+/////////////////////
+// Benchmarks
+/////////////////////
+
+static void get_hit(bench_t* bench, size_t i) {
+    mock_request(HTTP_GET, bench->paths[i % bench->count], NULL, 0, NULL);
+}
+
+static void get_miss(bench_t* bench, size_t i) {
+    mock_request(HTTP_GET, bench->misses[i % bench->count], NULL, 0, NULL);
+}
+
+static void get_template(bench_t* bench, size_t i) {
+    mock_request(HTTP_GET, "/status.html", NULL, 0, NULL);
+}
+
+static void get_computed(bench_t* bench, size_t i) {
+    mock_request(HTTP_GET, "/sensors", NULL, 0, NULL);
+}
+
+static void post_body(bench_t* bench, size_t i) {
+    mock_request(HTTP_POST, "/post", bench->body, bench->body_len, NULL);
+}
+
+static void post_route(bench_t* bench, size_t i) {
+    mock_request(HTTP_POST, "/items/42/name", bench->body, bench->body_len, NULL);
+}
+
+static void post_batch(bench_t* bench, size_t i) {
+    mock_request(HTTP_POST, QWEB_BATCH_PATH, bench->body, bench->body_len, NULL);
+}
+
+static void post_params(bench_t* bench, size_t i) {
+    mock_request(HTTP_POST, "/led?id=42&on=yes", bench->body, bench->body_len, NULL);
+}
+
+static void post_form(bench_t* bench, size_t i) {
+    mock_request(HTTP_POST, "/upload", bench->body, bench->body_len, NULL);
+}
+
+static void churn(bench_t* bench, size_t i) {
+    qweb_register_file(bench->server, "/churn.html", HTTP_MIME_HTML, file_content, sizeof(file_content) - 1);
+    qweb_unregister_file(bench->server, "/churn.html");
+}
+
+static void churn_post(bench_t* bench, size_t i) {
+    qweb_register_post_cb(bench->server, "/churn", QWEB_POST_HANDLER_DEFAULT(post_cb));
+    qweb_unregister_post_cb(bench->server, "/churn");
+}
+
+
+int main(int argc, char** argv) {
+    filter = argc > 1 ? argv[1] : NULL;
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    char name[64];
+    bench_t bench;
+
+    for (size_t t = 0; t < sizeof(table_sizes) / sizeof(table_sizes[0]); t++) {
+        size_t count = table_sizes[t];
+        bench_setup(&bench, count);
+
+        snprintf(name, sizeof(name), "get/hit/%zu", count);
+        if (bench_selected(name)) {
+            bench_run(name, get_hit, &bench);
+        }
+        snprintf(name, sizeof(name), "get/miss/%zu", count);
+        if (bench_selected(name)) {
+            bench_run(name, get_miss, &bench);
+        }
+        snprintf(name, sizeof(name), "churn/file/%zu", count);
+        if (bench_selected(name)) {
+            bench_run(name, churn, &bench);
+        }
+        snprintf(name, sizeof(name), "churn/post/%zu", count);
+        if (bench_selected(name)) {
+            bench_run(name, churn_post, &bench);
+        }
+
+        bench_teardown(&bench);
+    }
+
+    for (size_t b = 0; b < sizeof(body_sizes) / sizeof(body_sizes[0]); b++) {
+        bench_setup(&bench, 10);
+        qweb_register_post_cb(bench.server, "/post", QWEB_POST_HANDLER_DEFAULT(post_cb));
+        qweb_register_post_route(bench.server, "/items/:id/name", QWEB_POST_ROUTE_HANDLER_DEFAULT(route_cb));
+        bench.body_len = body_sizes[b];
+        bench.body = malloc(bench.body_len + 1);
+        memset(bench.body, 'q', bench.body_len);
+
+        snprintf(name, sizeof(name), "post/cb/%zu", bench.body_len);
+        if (bench_selected(name)) {
+            bench_run(name, post_body, &bench);
+        }
+        snprintf(name, sizeof(name), "post/route/%zu", bench.body_len);
+        if (bench_selected(name)) {
+            bench_run(name, post_route, &bench);
+        }
+
+        bench_teardown(&bench);
+    }
+
+    // Batches of calls to /post, against the same number of post/cb/64 requests
+    // (the round trips saved are not part of the measure)
+    for (size_t b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); b++) {
+        bench_setup(&bench, 10);
+        qweb_register_post_cb(bench.server, "/post", QWEB_POST_HANDLER_DEFAULT(post_cb));
+        qweb_register_batch(bench.server, QWEB_BATCH_PATH);
+        bench.body = malloc(batch_sizes[b] * (BENCH_PATH_MAX + BENCH_BATCH_CALL) + 1);
+        for (size_t c = 0; c < batch_sizes[b]; c++) {
+            bench.body_len += sprintf(&bench.body[bench.body_len], "/post %u\n", BENCH_BATCH_CALL);
+            memset(&bench.body[bench.body_len], 'q', BENCH_BATCH_CALL);
+            bench.body_len += BENCH_BATCH_CALL;
+        }
+
+        snprintf(name, sizeof(name), "post/batch/%zu", batch_sizes[b]);
+        if (bench_selected(name)) {
+            bench_run(name, post_batch, &bench);
+        }
+
+        bench_teardown(&bench);
+    }
+
+    // A 3 KiB page rendered from a template with three slots
+    memset(tpl_head, 'h', sizeof(tpl_head));
+    memset(tpl_tail, 't', sizeof(tpl_tail));
+    bench_setup(&bench, 10);
+    qweb_register_template(bench.server, "/status.html", &tpl_page, tpl_slot, NULL);
+    if (bench_selected("get/template")) {
+        bench_run("get/template", get_template, &bench);
+    }
+    bench_teardown(&bench);
+
+    // A computed resource, run for each request or served from its cache
+    bench_setup(&bench, 10);
+    qweb_register_get_cb(bench.server, "/sensors", QWEB_GET_HANDLER_DEFAULT(get_cb));
+    if (bench_selected("get/cb")) {
+        bench_run("get/cb", get_computed, &bench);
+    }
+    qweb_register_get_cb(bench.server, "/sensors", QWEB_GET_HANDLER_CACHED(get_cb, 60 * 1000));
+    if (bench_selected("get/cached")) {
+        bench_run("get/cached", get_computed, &bench);
+    }
+    bench_teardown(&bench);
+
+    // Parameters from the query string and an urlencoded form
+    mock_set_content_type(HTTP_MIME_FORM_URLENCODED);
+    bench_setup(&bench, 10);
+    qweb_register_post_cb(bench.server, "/led", QWEB_POST_HANDLER_PARAMS(params_cb));
+    bench.body = strdup("level=0.75&name=desk+lamp%20%28left%29&color=%23ff8000");
+    bench.body_len = strlen(bench.body);
+    if (bench_selected("post/params")) {
+        bench_run("post/params", post_params, &bench);
+    }
+    bench_teardown(&bench);
+
+    // A file of S random bytes uploaded from a form, split as it is received
+    mock_set_content_type(HTTP_MIME_FORM_DATA "; boundary=" BENCH_BOUNDARY);
+    for (size_t b = 0; b < sizeof(form_sizes) / sizeof(form_sizes[0]); b++) {
+        bench_setup(&bench, 10);
+        qweb_register_post_form(bench.server, "/upload", QWEB_POST_FORM_HANDLER_DEFAULT(NULL, form_data, form_end));
+        bench.body = malloc(form_sizes[b] + 256);
+        bench.body_len = sprintf(bench.body, "--%s\r\nContent-Disposition: form-data; name=\"firmware\"; filename=\"fw.bin\"\r\n"
+            "Content-Type: application/octet-stream\r\n\r\n", BENCH_BOUNDARY);
+        uint32_t seed = 1;
+        for (size_t c = 0; c < form_sizes[b]; c++) {
+            seed = seed * 1103515245 + 12345;
+            bench.body[bench.body_len++] = seed >> 24;
+        }
+        bench.body_len += sprintf(&bench.body[bench.body_len], "\r\n--%s--\r\n", BENCH_BOUNDARY);
+
+        snprintf(name, sizeof(name), "post/form/%zu", form_sizes[b]);
+        if (bench_selected(name)) {
+            bench_run(name, post_form, &bench);
+        }
+
+        bench_teardown(&bench);
+    }
+    mock_set_content_type(NULL);
+
+    return 0;
+}
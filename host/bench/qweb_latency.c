@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "esp-qweb.h"
+#include "esp_log.h"
+
+/**
+ * @brief Latency of small requests served next to slow ones, over
+ *  loopback sockets on the POSIX httpd (a single thread runs the handlers,
+ *  like the httpd task). A small file is requested over and over, and the
+ *  time to its first byte measured, while a large file is downloaded by a
+ *  client that reads it slowly, or while clients post to a handler that
+ *  takes LATENCY_SLOW_US.
+ *  Exits with an error if a small request waits longer than LATENCY_MAX_US
+ *  while the large file is streamed, or while the handler runs async.
+ *
+ *  qweb-latency [port]
+ */
+
+#define LATENCY_SMALL_LEN       (512)
+#define LATENCY_BIG_LEN         (8 * 1024 * 1024)
+#define LATENCY_READ_CHUNK      (16 * 1024)     // read by the slow client at a time,
+#define LATENCY_READ_DELAY_US   (2000)          // every 2 ms (8 MB/s)
+#define LATENCY_SAMPLES         (50)
+#define LATENCY_GAP_US          (10 * 1000)     // between two small requests
+#define LATENCY_MAX_US          (50 * 1000)
+#define LATENCY_SLOW_US         (200 * 1000)    // run time of the slow post handler
+#define LATENCY_POSTERS         (2)             // clients posting to it
+
+static char small_content[LATENCY_SMALL_LEN];
+static char big_content[LATENCY_BIG_LEN];
+
+static uint16_t port = 18180;
+static atomic_size_t slow_running;
+
+/**
+ * @brief A slow request running in its own thread
+ */
+typedef struct {
+    const char* request;
+    atomic_bool started;        // the server is answering it
+    atomic_bool done;
+    size_t received;
+    int64_t duration_us;
+} slow_client_t;
+
+/**
+ * @brief Clients posting to the slow handler over and over
+ */
+typedef struct {
+    atomic_bool stop;
+    atomic_size_t posts;        // answered
+} slow_posts_t;
+
+typedef struct {
+    size_t count;
+    int64_t samples[LATENCY_SAMPLES];
+} latency_t;
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ll + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Connect to the server and send a request
+ * @param rcvbuf receive buffer size, 0 for the default
+ * @returns the socket, or -1
+ */
+static int client_send(const char* request, int rcvbuf) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (rcvbuf) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    size_t len = strlen(request);
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 ||
+        send(fd, request, len, MSG_NOSIGNAL) != (ssize_t) len) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Time a request until the first byte of its response, then read
+ *  the rest (requests are HTTP/1.0, the server closes the connection)
+ * @returns the time to first byte in us, or -1
+ */
+static int64_t client_ttfb(const char* request) {
+    int64_t start = now_us();
+    int fd = client_send(request, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    char buf[4096];
+    ssize_t len = recv(fd, buf, sizeof(buf), 0);
+    int64_t ttfb = now_us() - start;
+    while (len > 0) {
+        len = recv(fd, buf, sizeof(buf), 0);
+    }
+    close(fd);
+    return len < 0 ? -1 : ttfb;
+}
+
+static void* slow_get(void* arg) {
+    slow_client_t* client = arg;
+    int64_t start = now_us();
+    int fd = client_send(client->request, LATENCY_READ_CHUNK);
+    static char buf[LATENCY_READ_CHUNK];
+    ssize_t len = fd < 0 ? -1 : recv(fd, buf, sizeof(buf), 0);
+    atomic_store(&client->started, true);
+    while (len > 0) {
+        client->received += len;
+        usleep(LATENCY_READ_DELAY_US);
+        len = recv(fd, buf, sizeof(buf), 0);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    client->duration_us = now_us() - start;
+    atomic_store(&client->done, true);
+    return NULL;
+}
+
+static void* slow_post(void* arg) {
+    slow_posts_t* posts = arg;
+    while (!atomic_load(&posts->stop)) {
+        if (client_ttfb("POST /slow HTTP/1.0\r\nContent-Length: 4\r\n\r\nslow") < 0) {
+            break;
+        }
+        atomic_fetch_add(&posts->posts, 1);
+    }
+    return NULL;
+}
+
+static qweb_post_cb_ret_t slow_cb(const char* uri, const char* data, size_t data_len) {
+    atomic_fetch_add(&slow_running, 1);
+    usleep(LATENCY_SLOW_US);
+    return QWEB_POST_RET_OK_STAT_STR("done", HTTP_MIME_PLAIN);
+}
+
+/**
+ * @brief Request the small file until the slow client is done, or enough
+ *  samples were taken (all of them without a slow client)
+ */
+static bool sample_small(slow_client_t* slow, latency_t* latency) {
+    latency->count = 0;
+    while (latency->count < LATENCY_SAMPLES && !(slow && atomic_load(&slow->done))) {
+        int64_t ttfb = client_ttfb("GET /small HTTP/1.0\r\n\r\n");
+        if (ttfb < 0) {
+            return false;
+        }
+        latency->samples[latency->count++] = ttfb;
+        usleep(LATENCY_GAP_US);
+    }
+    return true;
+}
+
+static int cmp_int64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*) a, y = *(const int64_t*) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Print the median and slowest requests, followed by what they ran along
+ * @returns the slowest request in us
+ */
+static int64_t latency_report(const char* name, latency_t* latency, const char* during) {
+    qsort(latency->samples, latency->count, sizeof(int64_t), cmp_int64);
+    int64_t max = latency->count ? latency->samples[latency->count - 1] : 0;
+    printf("%-16s %9.2f ms p50 %9.2f ms max   %3zu requests%s\n",
+        name, latency->count ? latency->samples[latency->count / 2] / 1000.0 : 0.0, max / 1000.0, latency->count, during);
+    return max;
+}
+
+static qweb_server_t* server_start(size_t stream_threshold) {
+    qweb_server_config_t cfg = QWEB_SERVER_CFG_DEFAULT("qweb latency");
+    cfg.port = port;
+    cfg.stream_threshold = stream_threshold;
+    qweb_server_t* server = qweb_init(&cfg);
+    if (server) {
+        qweb_register_file(server, "/small", HTTP_MIME_PLAIN, small_content, sizeof(small_content));
+        qweb_register_file(server, "/big", HTTP_MIME_PLAIN, big_content, sizeof(big_content));
+    }
+    return server;
+}
+
+/**
+ * @brief Small requests while the large file is downloaded, sent at once
+ *  or streamed
+ * @returns the slowest small request in us, or -1
+ */
+static int64_t run_get(const char* name, size_t stream_threshold) {
+    qweb_server_t* server = server_start(stream_threshold);
+    if (!server) {
+        return -1;
+    }
+    slow_client_t slow = { .request = "GET /big HTTP/1.0\r\n\r\n" };
+    pthread_t thread;
+    pthread_create(&thread, NULL, slow_get, &slow);
+    while (!atomic_load(&slow.started)) {
+        usleep(1000);
+    }
+    latency_t latency;
+    bool ok = sample_small(&slow, &latency);
+    pthread_join(thread, NULL);
+    qweb_free(server);
+    if (!ok || slow.received < LATENCY_BIG_LEN) {
+        printf("%-16s failed\n", name);
+        return -1;
+    }
+    char during[64];
+    snprintf(during, sizeof(during), " during %zu bytes in %.0f ms", slow.received, slow.duration_us / 1000.0);
+    return latency_report(name, &latency, during);
+}
+
+/**
+ * @brief Small requests while clients post to the slow handler, run by the
+ *  httpd task or by the worker tasks
+ * @returns the slowest small request in us, or -1
+ */
+static int64_t run_post(const char* name, qweb_post_handler_t handler) {
+    qweb_server_t* server = server_start(QWEB_STREAM_THRESHOLD);
+    if (!server) {
+        return -1;
+    }
+    qweb_register_post_cb(server, "/slow", handler);
+    atomic_store(&slow_running, 0);
+    slow_posts_t posts = { 0 };
+    pthread_t threads[LATENCY_POSTERS];
+    for (size_t i = 0; i < LATENCY_POSTERS; i++) {
+        pthread_create(&threads[i], NULL, slow_post, &posts);
+    }
+    while (!atomic_load(&slow_running)) {
+        usleep(1000);
+    }
+    latency_t latency;
+    bool ok = sample_small(NULL, &latency);
+    atomic_store(&posts.stop, true);
+    for (size_t i = 0; i < LATENCY_POSTERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    qweb_free(server);
+    if (!ok) {
+        printf("%-16s failed\n", name);
+        return -1;
+    }
+    char during[64];
+    snprintf(during, sizeof(during), " during %zu posts of %d ms", atomic_load(&posts.posts), LATENCY_SLOW_US / 1000);
+    return latency_report(name, &latency, during);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        port = (uint16_t) atoi(argv[1]);
+    }
+    esp_log_level_set("*", ESP_LOG_NONE);
+    memset(small_content, 's', sizeof(small_content));
+    memset(big_content, 'b', sizeof(big_content));
+
+    qweb_server_t* server = server_start(QWEB_STREAM_THRESHOLD);
+    if (!server) {
+        return 1;
+    }
+    latency_t latency;
+    bool ok = sample_small(NULL, &latency);
+    qweb_free(server);
+    if (!ok) {
+        printf("idle             failed\n");
+        return 1;
+    }
+    latency_report("idle", &latency, "");
+
+    // A threshold of 0 only streams files marked with qweb_file_set_stream
+    run_get("get/send", 0);
+    int64_t max = run_get("get/stream", QWEB_STREAM_THRESHOLD);
+    if (max < 0 || max > LATENCY_MAX_US) {
+        printf("small requests waited for the streamed file\n");
+        return 1;
+    }
+
+    run_post("post/sync", QWEB_POST_HANDLER_DEFAULT(slow_cb));
+    max = run_post("post/async", QWEB_POST_HANDLER_ASYNC(slow_cb));
+    if (max < 0 || max > LATENCY_MAX_US) {
+        printf("small requests waited for the async post handler\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "esp-qweb.h"
+#include "esp_log.h"
+#include "httpd_mock.h"
+
+/**
+ * @brief Stress test of the file table: reader threads request files
+ *  through the mocked httpd while writer threads register, change and
+ *  unregister them, commit new versions of dynamic files, or replace the
+ *  route manifest. Every response must be a whole version of a file.
+ *  Meant to run under AddressSanitizer or ThreadSanitizer, which catch
+ *  entries freed too early.
+ *
+ *  qweb-stress [seconds]
+ */
+
+#define STRESS_READERS      (4)
+#define STRESS_WRITERS      (2)
+#define STRESS_PATHS        (32)
+#define STRESS_DYNS         (4)     // dynamic files, served after the paths
+#define STRESS_MANIFESTS    (4)     // manifests of a single file, served after the dynamic files
+#define STRESS_BULK         (64)    // files registered and unregistered at once, to grow the table
+#define STRESS_VERSIONS     (26)
+#define STRESS_MAX_LEN      (32 + (STRESS_VERSIONS - 1) * 8)
+
+// Version v of a file is its letter repeated version_len(v) times
+static char versions[STRESS_VERSIONS][STRESS_MAX_LEN];
+
+#define STRESS_READ_PATHS   (STRESS_PATHS + STRESS_DYNS + 1)
+static char paths[STRESS_READ_PATHS][32];
+static qweb_dyn_t* dyns[STRESS_DYNS];
+static qweb_manifest_file_t manifest_files[STRESS_MANIFESTS];
+static qweb_manifest_t manifests[STRESS_MANIFESTS];
+static const uint32_t manifest_seeds[1] = { 0 };
+static char bulk_paths[STRESS_WRITERS][STRESS_BULK][32];
+
+static qweb_server_t* server;
+static atomic_bool stop;
+static atomic_uint_least64_t reads, hits, writes, failures;
+
+static size_t version_len(size_t v) {
+    return 32 + v * 8;
+}
+
+/**
+ * @brief Check that a response is a prefix of a single version
+ */
+static bool response_valid(const char* resp, size_t sent) {
+    if (sent == 0 || sent > STRESS_MAX_LEN) {
+        return false;
+    }
+    size_t v = resp[0] - 'a';
+    if (v >= STRESS_VERSIONS || sent > version_len(v)) {
+        return false;
+    }
+    for (size_t i = 1; i < sent; i++) {
+        if (resp[i] != resp[0]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void* reader(void* arg) {
+    unsigned seed = (unsigned) (uintptr_t) arg;
+    char resp[STRESS_MAX_LEN];
+    while (!atomic_load(&stop)) {
+        const char* path = paths[rand_r(&seed) % STRESS_READ_PATHS];
+        size_t sent;
+        int status = mock_request_capture(HTTP_GET, path, NULL, 0, resp, sizeof(resp), &sent);
+        if (status == 200) {
+            atomic_fetch_add(&hits, 1);
+            if (!response_valid(resp, sent)) {
+                fprintf(stderr, "%s: torn response of %zub\n", path, sent);
+                atomic_fetch_add(&failures, 1);
+            }
+        } else if (status != 404) {
+            fprintf(stderr, "%s: unexpected status %d\n", path, status);
+            atomic_fetch_add(&failures, 1);
+        }
+        atomic_fetch_add(&reads, 1);
+    }
+    return NULL;
+}
+
+static void* writer(void* arg) {
+    size_t id = (size_t) (uintptr_t) arg;
+    unsigned seed = (unsigned) id * 7919;
+    while (!atomic_load(&stop)) {
+        const char* path = paths[rand_r(&seed) % STRESS_PATHS];
+        size_t v = rand_r(&seed) % STRESS_VERSIONS;
+        switch (rand_r(&seed) % 10) {
+        case 0:
+        case 1:
+            qweb_register_file(server, path, HTTP_MIME_PLAIN, versions[v], version_len(v));
+            break;
+        case 2:
+            qweb_unregister_file(server, path);
+            break;
+        case 3:
+            // Shorter than any version
+            qweb_file_trunc_path(server, path, 1 + rand_r(&seed) % version_len(0));
+            break;
+        case 4:
+            qweb_file_set_stream(server, path, rand_r(&seed) & 1);
+            break;
+        case 5:
+            qweb_file_set_cache_control(server, path, (rand_r(&seed) & 1) ? QWEB_CACHE_NO_CACHE : NULL);
+            break;
+        case 6:
+            qweb_file_set_log(server, path, rand_r(&seed) & 1);
+            break;
+        case 7:
+            for (size_t i = 0; i < STRESS_BULK; i++) {
+                qweb_register_file(server, bulk_paths[id][i], HTTP_MIME_PLAIN, versions[v], version_len(v));
+            }
+            for (size_t i = 0; i < STRESS_BULK; i++) {
+                qweb_unregister_file(server, bulk_paths[id][i]);
+            }
+            break;
+        case 8: {
+            // Written a byte at a time, a reader of the buffer would see it torn
+            qweb_dyn_t* dyn = dyns[rand_r(&seed) % STRESS_DYNS];
+            char* buf = qweb_dyn_acquire(dyn, NULL);
+            if (buf) {
+                for (size_t i = 0; i < version_len(v); i++) {
+                    ((volatile char*) buf)[i] = 'a' + v;
+                }
+                qweb_dyn_commit(dyn, buf, version_len(v));
+            }
+            break;
+        }
+        case 9: {
+            // Sometimes none, the file is then missing
+            size_t m = rand_r(&seed) % (STRESS_MANIFESTS + 1);
+            qweb_register_manifest(server, m < STRESS_MANIFESTS ? &manifests[m] : NULL);
+            break;
+        }
+        }
+        atomic_fetch_add(&writes, 1);
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    unsigned seconds = argc > 1 ? (unsigned) atoi(argv[1]) : 5;
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    for (size_t v = 0; v < STRESS_VERSIONS; v++) {
+        memset(versions[v], 'a' + v, version_len(v));
+    }
+    for (size_t i = 0; i < STRESS_PATHS; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "/stress/%zu", i);
+    }
+    for (size_t i = 0; i < STRESS_DYNS; i++) {
+        snprintf(paths[STRESS_PATHS + i], sizeof(paths[i]), "/dyn/%zu", i);
+    }
+    snprintf(paths[STRESS_PATHS + STRESS_DYNS], sizeof(paths[0]), "/manifest");
+    for (size_t m = 0; m < STRESS_MANIFESTS; m++) {
+        manifest_files[m] = (qweb_manifest_file_t) { .path = paths[STRESS_PATHS + STRESS_DYNS], .type = HTTP_MIME_PLAIN,
+            .content = versions[m], .content_length = version_len(m), .etag = "\"stress\"" };
+        // A single bucket and a single file, every path hashes to it
+        manifests[m] = (qweb_manifest_t) { .files = &manifest_files[m], .file_count = 1, .seeds = manifest_seeds, .bucket_count = 1 };
+    }
+    for (size_t w = 0; w < STRESS_WRITERS; w++) {
+        for (size_t i = 0; i < STRESS_BULK; i++) {
+            snprintf(bulk_paths[w][i], sizeof(bulk_paths[w][i]), "/bulk/%zu/%zu", w, i);
+        }
+    }
+
+    // Larger versions are streamed, in chunks small enough to interleave with writers
+    qweb_server_config_t cfg = QWEB_SERVER_CFG_DEFAULT("qweb stress");
+    cfg.async_workers = 0;
+    cfg.stream_threshold = 128;
+    cfg.stream_chunk = 32;
+    server = qweb_init(&cfg);
+    for (size_t i = 0; i < STRESS_DYNS; i++) {
+        dyns[i] = qweb_register_dyn(server, paths[STRESS_PATHS + i], HTTP_MIME_PLAIN, STRESS_MAX_LEN);
+        qweb_dyn_set(dyns[i], versions[0], version_len(0));
+    }
+
+    pthread_t readers[STRESS_READERS], writers[STRESS_WRITERS];
+    for (size_t i = 0; i < STRESS_READERS; i++) {
+        pthread_create(&readers[i], NULL, reader, (void*) (uintptr_t) (i + 1));
+    }
+    for (size_t i = 0; i < STRESS_WRITERS; i++) {
+        pthread_create(&writers[i], NULL, writer, (void*) (uintptr_t) i);
+    }
+
+    sleep(seconds);
+    atomic_store(&stop, true);
+    for (size_t i = 0; i < STRESS_READERS; i++) {
+        pthread_join(readers[i], NULL);
+    }
+    for (size_t i = 0; i < STRESS_WRITERS; i++) {
+        pthread_join(writers[i], NULL);
+    }
+    qweb_free(server);
+
+    printf("%llu requests (%llu hits), %llu updates, %llu failures\n",
+        (unsigned long long) reads, (unsigned long long) hits,
+        (unsigned long long) writes, (unsigned long long) failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include "esp-qweb.h"
+#include "esp_log.h"
+#include "qweb_template_info.h"
+
+static const char index_content[] =
+    "<!DOCTYPE html><html><body><h1>Hello World!</h1></body></html>";
+
+// Large enough to be streamed in chunks
+static char big_content[256 * 1024];
+
+static volatile sig_atomic_t stop = 0;
+static volatile int uptime = 0;
+
+static void on_signal(int sig) {
+    (void) sig;
+    stop = 1;
+}
+
+static qweb_post_cb_ret_t echo_cb(const char* uri, const char* data, size_t data_len) {
+    char* copy = malloc(data_len);
+    memcpy(copy, data, data_len);
+    return (qweb_post_cb_ret_t) {
+        .d_data = copy, .resp_type = HTTP_MIME_PLAIN, .success = true,
+        .dynamic = true, .nullterm = false, .size = data_len
+    };
+}
+
+static esp_err_t count_cb(const char* uri, const char* data, size_t data_len, qweb_resp_writer_t* writer) {
+    qweb_resp_set_type(writer, HTTP_MIME_JSON);
+    qweb_resp_write(writer, "[", 1);
+    for (int i = 0; i < 1000; i++) {
+        qweb_resp_printf(writer, i ? ",%d" : "%d", i);
+    }
+    return qweb_resp_write(writer, "]", 1);
+}
+
+static qweb_post_cb_ret_t slow_cb(const char* uri, const char* data, size_t data_len) {
+    usleep(100 * 1000);
+    return QWEB_POST_RET_OK_STAT_STR("done", HTTP_MIME_PLAIN);
+}
+
+// Slow to compute, kept for a few seconds and computed once for concurrent requests
+static esp_err_t report_cb(const char* uri, qweb_resp_writer_t* writer) {
+    static int runs = 0;
+    usleep(500 * 1000);
+    qweb_resp_set_type(writer, HTTP_MIME_JSON);
+    return qweb_resp_printf(writer, "{\"uri\":\"%s\",\"runs\":%d,\"uptime\":%d}", uri, ++runs, uptime);
+}
+
+static qweb_post_cb_ret_t item_cb(const char* uri, const qweb_route_params_t* params, const char* data, size_t data_len) {
+    size_t id_len;
+    qweb_route_param(params, "id", &id_len);
+    return id_len ? QWEB_POST_RET_OK : QWEB_POST_RET_FAIL;
+}
+
+static qweb_post_cb_ret_t led_cb(const char* uri, const qweb_params_t* params, const char* data, size_t data_len) {
+    long id;
+    float level = 1;
+    bool on = true;
+    if (qweb_param_int(params, "id", &id) != ESP_OK ||
+        qweb_param_float(params, "level", &level) == ESP_ERR_INVALID_ARG ||
+        qweb_param_bool(params, "on", &on) == ESP_ERR_INVALID_ARG) {
+        return QWEB_POST_RET_FAIL_STAT_STR("bad parameters", HTTP_MIME_PLAIN);
+    }
+    char* resp = malloc(64);
+    snprintf(resp, 64, "{\"id\":%ld,\"level\":%g,\"on\":%s}", id, level, on ? "true" : "false");
+    return QWEB_POST_RET_OK_DYN_STR(resp, HTTP_MIME_JSON);
+}
+
+// Form uploads, of any size: the parts are counted instead of being stored
+typedef struct upload {
+    char summary[512];              // JSON array of the parts received
+    size_t len;
+    size_t size;                    // of the current part
+} upload_t;
+
+static esp_err_t upload_begin(const char* uri, size_t content_len, void** ctx) {
+    upload_t* up = calloc(1, sizeof(upload_t));
+    *ctx = up;
+    return up ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static esp_err_t upload_part(void* ctx, const qweb_form_part_t* part) {
+    upload_t* up = ctx;
+    up->size = 0;
+    up->len += snprintf(&up->summary[up->len], sizeof(up->summary) - up->len, "%s{\"name\":\"%s\",\"filename\":\"%s\",",
+        up->len ? "," : "[", part->name, part->filename ? part->filename : "");
+    return up->len < sizeof(up->summary) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static esp_err_t upload_data(void* ctx, const char* data, size_t data_len) {
+    ((upload_t*) ctx)->size += data_len;
+    return ESP_OK;
+}
+
+static esp_err_t upload_part_end(void* ctx) {
+    upload_t* up = ctx;
+    up->len += snprintf(&up->summary[up->len], sizeof(up->summary) - up->len, "\"size\":%zu}", up->size);
+    return up->len < sizeof(up->summary) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static qweb_post_cb_ret_t upload_end(void* ctx, esp_err_t status) {
+    upload_t* up = ctx;
+    if (status != ESP_OK || up->len + 2 > sizeof(up->summary)) {
+        free(up);
+        return QWEB_POST_RET_FAIL;
+    }
+    if (!up->len) {
+        up->summary[up->len++] = '[';
+    }
+    up->summary[up->len++] = ']';
+    up->summary[up->len] = '\0';
+    // The summary is at the start of the context
+    return (qweb_post_cb_ret_t) {
+        .d_data = (char*) up, .resp_type = HTTP_MIME_JSON, .success = true,
+        .dynamic = true, .nullterm = true, .size = 0
+    };
+}
+
+static esp_err_t info_slot(const char* uri, int slot, qweb_resp_writer_t* writer, void* ctx) {
+    switch (slot) {
+    case INFO_SLOT_NAME:
+        return qweb_resp_write_html(writer, (const char*) ctx);
+    case INFO_SLOT_UPTIME:
+        return qweb_resp_printf(writer, "%d", uptime);
+    case INFO_SLOT_PID:
+        return qweb_resp_printf(writer, "%d", (int) getpid());
+    case INFO_SLOT_URI:
+        return qweb_resp_write_html(writer, uri);
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+int main(int argc, char** argv) {
+    esp_log_level_t level = ESP_LOG_WARN;
+    uint16_t port = 8080;
+    const char* dir = NULL;
+    const char* partition = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            level = ESP_LOG_INFO;
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            partition = argv[++i];
+        } else {
+            port = atoi(argv[i]);
+        }
+    }
+    esp_log_level_set("*", level);
+
+    memset(big_content, 'q', sizeof(big_content));
+
+    qweb_server_config_t cfg = QWEB_SERVER_CFG_DEFAULT("qweb host");
+    cfg.port = port;
+    qweb_server_t* server = qweb_init(&cfg);
+    if (!server) {
+        return 1;
+    }
+
+    qweb_register_file(server, "/", HTTP_MIME_HTML, index_content, sizeof(index_content) - 1);
+    qweb_register_file(server, "/big", HTTP_MIME_PLAIN, big_content, sizeof(big_content));
+    qweb_register_post_cb(server, "/echo", QWEB_POST_HANDLER_DEFAULT(echo_cb));
+    qweb_register_post_cb(server, "/count", QWEB_POST_HANDLER_WRITER(count_cb));
+    qweb_register_post_cb(server, "/slow", QWEB_POST_HANDLER_ASYNC(slow_cb));
+    qweb_register_post_cb(server, "/led", QWEB_POST_HANDLER_PARAMS(led_cb));
+    qweb_register_post_route(server, "/items/:id", QWEB_POST_ROUTE_HANDLER_DEFAULT(item_cb));
+    qweb_post_form_handler_t upload = QWEB_POST_FORM_HANDLER_DEFAULT(upload_part, upload_data, upload_end);
+    upload.begin = upload_begin;
+    upload.part_end = upload_part_end;
+    qweb_register_post_form(server, "/upload", upload);
+    qweb_register_batch(server, QWEB_BATCH_PATH);
+    qweb_register_sse(server, "/events");
+    qweb_register_metrics(server, "/metrics");
+    qweb_dyn_t* status = qweb_register_dyn(server, "/status", HTTP_MIME_JSON, 64);
+    QWEB_TEMPLATE(server, "/info", info, info_slot, "qweb <host>");
+    qweb_get_handler_t report = QWEB_GET_HANDLER_CACHED(report_cb, 5000);
+    report.async = true;
+    qweb_register_get_cb(server, "/report", report);
+    if (dir && qweb_register_dir(server, dir, "/fs") != ESP_OK) {
+        fprintf(stderr, "Could not serve %s\n", dir);
+    }
+    if (partition && qweb_register_partition(server, partition) != ESP_OK) {
+        fprintf(stderr, "Could not serve partition %s\n", partition);
+    }
+
+    printf("qweb listening on port %u\n", port);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    for (int tick = 0; !stop; tick++) {
+        sleep(1);
+        uptime = tick + 1;
+        char data[32];
+        snprintf(data, sizeof(data), "%d", tick);
+        qweb_sse_publish(server, "/events", "tick", data);
+
+        // Written in place, requests in progress keep the previous version
+        size_t capacity;
+        char* buf = status ? qweb_dyn_acquire(status, &capacity) : NULL;
+        if (buf) {
+            qweb_dyn_commit(status, buf, snprintf(buf, capacity, "{\"tick\":%d}", tick));
+        }
+    }
+
+    qweb_free(server);
+    return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef QWEB_HOST_ESP_IDF_VERSION_H
+#define QWEB_HOST_ESP_IDF_VERSION_H
+
+/**
+ * @brief The host port behaves like esp_http_server of ESP-IDF v5.2
+ *  (including async request handlers)
+ */
+#define ESP_IDF_VERSION_VAL(major, minor, patch)    (((major) << 16) | ((minor) << 8) | (patch))
+#define ESP_IDF_VERSION_MAJOR   5
+#define ESP_IDF_VERSION_MINOR   2
+#define ESP_IDF_VERSION_PATCH   0
+#define ESP_IDF_VERSION         ESP_IDF_VERSION_VAL(ESP_IDF_VERSION_MAJOR, ESP_IDF_VERSION_MINOR, ESP_IDF_VERSION_PATCH)
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef QWEB_HOST_ESP_TIMER_H
+#define QWEB_HOST_ESP_TIMER_H
+
+#include <stdint.h>
+
+/**
+ * @brief Microseconds of the monotonic clock
+ */
+int64_t esp_timer_get_time(void);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef QWEB_HOST_FREERTOS_H
+#define QWEB_HOST_FREERTOS_H
+
+#include <stdint.h>
+
+/**
+ * @brief Host stand-in for the FreeRTOS kernel types, on top of pthreads.
+ *  Ticks are milliseconds.
+ */
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE                 ((BaseType_t) 0)
+#define pdTRUE                  ((BaseType_t) 1)
+#define pdFAIL                  pdFALSE
+#define pdPASS                  pdTRUE
+
+#define portMAX_DELAY           ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS      ((TickType_t) 1)
+#define configTICK_RATE_HZ      (1000)
+#define pdMS_TO_TICKS(ms)       ((TickType_t) (ms))
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef QWEB_HOST_FREERTOS_TASK_H
+#define QWEB_HOST_FREERTOS_TASK_H
+
+#include <sched.h>
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_task* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+/**
+ * @brief Run a function on a new thread (the stack size and priority are ignored)
+ */
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stack_size, void* arg, UBaseType_t priority, TaskHandle_t* handle);
+
+/**
+ * @brief End the calling thread, only NULL (self) is supported on the host
+ */
+void vTaskDelete(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+
+#define taskYIELD()     sched_yield()
+
+#endif
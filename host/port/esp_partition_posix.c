@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "esp_partition.h"
+
+// Partitions found, and live mappings
+#define PARTITIONS_MAX      (8)
+#define MAPPINGS_MAX        (16)
+
+typedef struct host_partition {
+    esp_partition_t part;
+    char path[256];
+} host_partition_t;
+
+static struct {
+    void* addr;
+    size_t len;
+} mappings[MAPPINGS_MAX];
+
+static host_partition_t partitions[PARTITIONS_MAX];
+static size_t partition_count;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label) {
+    if (type != ESP_PARTITION_TYPE_DATA || !label) {
+        return NULL;
+    }
+    const char* dir = getenv("QWEB_PARTITION_DIR");
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s.bin", dir ? dir : ".", label);
+
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&lock);
+    host_partition_t* found = NULL;
+    for (size_t i = 0; i < partition_count && !found; i++) {
+        if (strcmp(partitions[i].path, path) == 0) {
+            found = &partitions[i];
+        }
+    }
+    if (!found && partition_count < PARTITIONS_MAX) {
+        found = &partitions[partition_count++];
+        snprintf(found->path, sizeof(found->path), "%s", path);
+        snprintf(found->part.label, sizeof(found->part.label), "%s", label);
+        found->part.type = ESP_PARTITION_TYPE_DATA;
+        found->part.subtype = ESP_PARTITION_SUBTYPE_ANY;
+        found->part.address = 0;
+    }
+    if (found) {
+        // The file may have been rewritten since
+        found->part.size = st.st_size;
+    }
+    pthread_mutex_unlock(&lock);
+    return found ? &found->part : NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size) {
+    const host_partition_t* host = (const host_partition_t*) partition;
+    if (src_offset > partition->size || size > partition->size - src_offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    int fd = open(host->path, O_RDONLY);
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+    ssize_t amt = pread(fd, dst, size, src_offset);
+    close(fd);
+    return amt == (ssize_t) size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t* partition, size_t offset, size_t size,
+    esp_partition_mmap_memory_t memory, const void** out_ptr, esp_partition_mmap_handle_t* out_handle) {
+    const host_partition_t* host = (const host_partition_t*) partition;
+    if (offset > partition->size || size > partition->size - offset || size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Offsets into the file have to be page aligned, like flash mappings
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t skip = offset % page;
+    int fd = open(host->path, O_RDONLY);
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+    void* addr = mmap(NULL, size + skip, PROT_READ, MAP_PRIVATE, fd, offset - skip);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    pthread_mutex_lock(&lock);
+    uint32_t handle = MAPPINGS_MAX;
+    for (uint32_t i = 0; i < MAPPINGS_MAX && handle == MAPPINGS_MAX; i++) {
+        if (!mappings[i].addr) {
+            handle = i;
+            mappings[i].addr = addr;
+            mappings[i].len = size + skip;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    if (handle == MAPPINGS_MAX) {
+        munmap(addr, size + skip);
+        return ESP_ERR_NO_MEM;
+    }
+
+    *out_ptr = (const char*) addr + skip;
+    *out_handle = handle;
+    return ESP_OK;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle) {
+    if (handle >= MAPPINGS_MAX) {
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    if (mappings[handle].addr) {
+        munmap(mappings[handle].addr, mappings[handle].len);
+        mappings[handle].addr = NULL;
+    }
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,966 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "esp_http_server.h"
+#include "esp_log.h"
+
+// Largest request line and headers
+#define HOST_HEAD_MAX       (HTTPD_MAX_URI_LEN + HTTPD_MAX_REQ_HDR_LEN)
+
+// Most request headers kept
+#define HOST_REQ_HDRS_MAX   (32)
+
+// Most response headers, over max_resp_headers
+#define HOST_RESP_HDRS_MAX  (32)
+
+// Status line and headers of a response
+#define HOST_RESP_HEAD_MAX  (2048)
+
+// Buffer used to drop unread content
+#define HOST_PURGE_BUF      (512)
+
+// Send buffer of each session. lwIP's TCP_SND_BUF is a few KiB, the kernel's
+// grows to megabytes and a blocked send then waits until a third of it drains.
+#define HOST_SNDBUF         (16 * 1024)
+
+static const char* TAG = "httpd-host";
+
+/**
+ * @brief A function queued to run in the server thread
+ */
+typedef struct host_work {
+    httpd_work_fn_t fn;
+    void* arg;
+    struct host_work* next;
+} host_work_t;
+
+/**
+ * @brief A client connection
+ */
+typedef struct host_sess {
+    int fd;                         // -1 when the slot is free
+    atomic_bool async;              // an async request owns the socket, it is not polled
+    uint64_t lru;                   // last use, to purge the oldest session
+    void* ctx;                      // session context, set by handlers
+    httpd_free_ctx_fn_t free_ctx;
+    char buf[HOST_HEAD_MAX];        // received, not consumed yet
+    size_t buf_len;
+} host_sess_t;
+
+/**
+ * @brief Private state of a request (httpd_req_t::aux)
+ */
+typedef struct host_aux {
+    host_sess_t* sess;
+    char head[HOST_HEAD_MAX + 1];   // request line and headers, split in null terminated strings
+    size_t hdr_names[HOST_REQ_HDRS_MAX];    // offsets in head
+    size_t hdr_values[HOST_REQ_HDRS_MAX];
+    size_t hdr_count;
+    size_t remaining;               // content not received yet
+    bool keep_alive;
+
+    const char* status;
+    const char* type;
+    const char* resp_fields[HOST_RESP_HDRS_MAX];
+    const char* resp_values[HOST_RESP_HDRS_MAX];
+    size_t resp_count;
+    bool chunked: 1;                // headers sent, the content goes out in chunks
+    bool done: 1;                   // the response is complete
+} host_aux_t;
+
+typedef struct host_httpd {
+    httpd_config_t config;
+    int listen_fd;
+    int wake[2];                    // pipe waking the server thread
+    pthread_t thread;
+    atomic_bool running;
+
+    httpd_uri_t* handlers;          // max_uri_handlers slots, free when uri is NULL
+    host_sess_t* sessions;          // max_open_sockets slots
+    uint64_t lru_clock;
+
+    pthread_mutex_t work_lock;
+    host_work_t* work_head;
+    host_work_t* work_tail;
+} host_httpd_t;
+
+
+static const struct {
+    const char* status;
+    const char* msg;
+} err_table[HTTPD_ERR_CODE_MAX] = {
+    [HTTPD_500_INTERNAL_SERVER_ERROR]       = { "500 Internal Server Error", "Server has encountered an unexpected error" },
+    [HTTPD_501_METHOD_NOT_IMPLEMENTED]      = { "501 Method Not Implemented", "Server does not support this method" },
+    [HTTPD_505_VERSION_NOT_SUPPORTED]       = { "505 Version Not Supported", "HTTP version not supported by server" },
+    [HTTPD_400_BAD_REQUEST]                 = { "400 Bad Request", "Bad request syntax" },
+    [HTTPD_401_UNAUTHORIZED]                = { "401 Unauthorized", "No permission -- see authorization schemes" },
+    [HTTPD_403_FORBIDDEN]                   = { "403 Forbidden", "Request forbidden -- authorization will not help" },
+    [HTTPD_404_NOT_FOUND]                   = { "404 Not Found", "Nothing matches the given URI" },
+    [HTTPD_405_METHOD_NOT_ALLOWED]          = { "405 Method Not Allowed", "Specified method is invalid for this resource" },
+    [HTTPD_408_REQ_TIMEOUT]                 = { "408 Request Timeout", "Server closed this connection" },
+    [HTTPD_411_LENGTH_REQUIRED]             = { "411 Length Required", "Chunked encoding not supported" },
+    [HTTPD_414_URI_TOO_LONG]                = { "414 URI Too Long", "URI is too long" },
+    [HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE]    = { "431 Request Header Fields Too Large", "Header fields are too long" },
+};
+
+static const struct {
+    const char* name;
+    httpd_method_t method;
+} method_table[] = {
+    { "DELETE", HTTP_DELETE },
+    { "GET", HTTP_GET },
+    { "HEAD", HTTP_HEAD },
+    { "POST", HTTP_POST },
+    { "PUT", HTTP_PUT },
+    { "OPTIONS", HTTP_OPTIONS },
+    { "PATCH", HTTP_PATCH },
+};
+
+
+static int sock_send_all(int fd, struct iovec* iov, int iovcnt) {
+    while (iovcnt) {
+        ssize_t sent = writev(fd, iov, iovcnt);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+        }
+        while (iovcnt && (size_t) sent >= iov->iov_len) {
+            sent -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt) {
+            iov->iov_base = (char*) iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
+    return 0;
+}
+
+static void wake_server(host_httpd_t* hd) {
+    char c = 0;
+    while (write(hd->wake[1], &c, 1) < 0 && errno == EINTR) {
+    }
+}
+
+/**
+ * @brief Receive some content, from what was read with the headers first
+ */
+static int sess_recv(host_sess_t* sess, char* buf, size_t len) {
+    if (sess->buf_len) {
+        size_t amt = len < sess->buf_len ? len : sess->buf_len;
+        memcpy(buf, sess->buf, amt);
+        memmove(sess->buf, &sess->buf[amt], sess->buf_len - amt);
+        sess->buf_len -= amt;
+        return amt;
+    }
+    for (;;) {
+        ssize_t received = recv(sess->fd, buf, len, 0);
+        if (received > 0) {
+            return received;
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return HTTPD_SOCK_ERR_TIMEOUT;
+        }
+        // The peer closed the connection
+        return HTTPD_SOCK_ERR_FAIL;
+    }
+}
+
+/**
+ * @brief Drop the content the handler did not read
+ */
+static bool req_purge(httpd_req_t* r) {
+    host_aux_t* aux = r->aux;
+    char dummy[HOST_PURGE_BUF];
+    while (aux->remaining) {
+        int received = httpd_req_recv(r, dummy, sizeof(dummy));
+        if (received < 0 && received != HTTPD_SOCK_ERR_TIMEOUT) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void sess_close(host_httpd_t* hd, host_sess_t* sess) {
+    if (sess->ctx) {
+        if (sess->free_ctx) {
+            sess->free_ctx(sess->ctx);
+        } else {
+            free(sess->ctx);
+        }
+    }
+    if (hd->config.close_fn) {
+        hd->config.close_fn(hd, sess->fd);
+    } else {
+        close(sess->fd);
+    }
+    sess->fd = -1;
+    sess->ctx = NULL;
+    sess->free_ctx = NULL;
+    sess->buf_len = 0;
+    atomic_store(&sess->async, false);
+}
+
+typedef struct host_close {
+    host_httpd_t* hd;
+    int fd;
+} host_close_t;
+
+static void sess_close_work(void* arg) {
+    host_close_t* close_req = arg;
+    host_httpd_t* hd = close_req->hd;
+    for (size_t i = 0; i < hd->config.max_open_sockets; i++) {
+        if (hd->sessions[i].fd == close_req->fd) {
+            sess_close(hd, &hd->sessions[i]);
+            break;
+        }
+    }
+    free(close_req);
+}
+
+static bool sess_has_head(const host_sess_t* sess) {
+    return memmem(sess->buf, sess->buf_len, "\r\n\r\n", 4) != NULL;
+}
+
+/**
+ * @brief Read the request line and headers of a session
+ * @returns the length of the head, 0 if the connection is closed,
+ *  or -1 if the head is too large
+ */
+static int sess_read_head(host_sess_t* sess) {
+    for (;;) {
+        char* end = memmem(sess->buf, sess->buf_len, "\r\n\r\n", 4);
+        if (end) {
+            return end - sess->buf + 4;
+        }
+        if (sess->buf_len == sizeof(sess->buf)) {
+            return -1;
+        }
+        ssize_t received = recv(sess->fd, &sess->buf[sess->buf_len], sizeof(sess->buf) - sess->buf_len, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return 0;
+        }
+        sess->buf_len += received;
+    }
+}
+
+/**
+ * @brief Split the head of a request into its request line and headers
+ * @returns false if it is malformed
+ */
+static bool req_parse(httpd_req_t* r, host_aux_t* aux, size_t head_len, httpd_err_code_t* err) {
+    char* head = aux->head;
+    head[head_len] = '\0';
+    *err = HTTPD_400_BAD_REQUEST;
+
+    // Request line
+    char* line_end = strstr(head, "\r\n");
+    *line_end = '\0';
+    char* method = head;
+    char* uri = strchr(method, ' ');
+    if (!uri) {
+        return false;
+    }
+    *uri++ = '\0';
+    char* version = strchr(uri, ' ');
+    if (!version) {
+        return false;
+    }
+    *version++ = '\0';
+
+    r->method = -1;
+    for (size_t i = 0; i < sizeof(method_table) / sizeof(method_table[0]); i++) {
+        if (strcmp(method, method_table[i].name) == 0) {
+            r->method = method_table[i].method;
+        }
+    }
+    if (r->method < 0) {
+        *err = HTTPD_501_METHOD_NOT_IMPLEMENTED;
+        return false;
+    }
+    if (strncmp(version, "HTTP/1.", 7) != 0) {
+        *err = HTTPD_505_VERSION_NOT_SUPPORTED;
+        return false;
+    }
+    if (strlen(uri) > HTTPD_MAX_URI_LEN) {
+        *err = HTTPD_414_URI_TOO_LONG;
+        return false;
+    }
+    strcpy((char*) r->uri, uri);
+    aux->keep_alive = strcmp(version, "HTTP/1.1") == 0;
+
+    // Headers
+    aux->hdr_count = 0;
+    r->content_len = 0;
+    for (char* line = line_end + 2; *line && strncmp(line, "\r\n", 2) != 0; ) {
+        char* end = strstr(line, "\r\n");
+        *end = '\0';
+        char* colon = strchr(line, ':');
+        if (!colon) {
+            return false;
+        }
+        *colon = '\0';
+        char* value = colon + 1;
+        while (*value == ' ' || *value == '\t') {
+            value++;
+        }
+
+        if (strcasecmp(line, "Content-Length") == 0) {
+            r->content_len = strtoul(value, NULL, 10);
+        } else if (strcasecmp(line, "Transfer-Encoding") == 0 && strcasecmp(value, "identity") != 0) {
+            *err = HTTPD_411_LENGTH_REQUIRED;
+            return false;
+        } else if (strcasecmp(line, "Connection") == 0) {
+            aux->keep_alive = strcasecmp(value, "close") != 0 &&
+                (aux->keep_alive || strcasecmp(value, "keep-alive") == 0);
+        }
+
+        if (aux->hdr_count < HOST_REQ_HDRS_MAX) {
+            aux->hdr_names[aux->hdr_count] = line - head;
+            aux->hdr_values[aux->hdr_count] = value - head;
+            aux->hdr_count++;
+        }
+        line = end + 2;
+    }
+    aux->remaining = r->content_len;
+    return true;
+}
+
+static const httpd_uri_t* find_handler(host_httpd_t* hd, httpd_req_t* r, bool* uri_matched) {
+    size_t uri_len = strcspn(r->uri, "?");
+    *uri_matched = false;
+    for (size_t i = 0; i < hd->config.max_uri_handlers; i++) {
+        const httpd_uri_t* handler = &hd->handlers[i];
+        if (!handler->uri) {
+            continue;
+        }
+        bool match = hd->config.uri_match_fn ?
+            hd->config.uri_match_fn(handler->uri, r->uri, uri_len) :
+            strlen(handler->uri) == uri_len && strncmp(handler->uri, r->uri, uri_len) == 0;
+        if (match) {
+            *uri_matched = true;
+            if (handler->method == (httpd_method_t) r->method) {
+                return handler;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Handle the next request of a session
+ * @returns false if the session must be closed
+ */
+static bool sess_process(host_httpd_t* hd, host_sess_t* sess) {
+    int head_len = sess_read_head(sess);
+    if (head_len == 0) {
+        return false;
+    }
+
+    httpd_req_t req = {
+        .handle = hd,
+        .sess_ctx = sess->ctx,
+        .free_ctx = sess->free_ctx
+    };
+    host_aux_t aux = {
+        .sess = sess,
+        .status = HTTPD_200,
+        .type = HTTPD_TYPE_TEXT
+    };
+    req.aux = &aux;
+
+    if (head_len < 0) {
+        httpd_resp_send_err(&req, HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE, NULL);
+        return false;
+    }
+
+    // The head moves to the request, the rest stays for the content
+    memcpy(aux.head, sess->buf, head_len);
+    memmove(sess->buf, &sess->buf[head_len], sess->buf_len - head_len);
+    sess->buf_len -= head_len;
+    sess->lru = ++hd->lru_clock;
+
+    httpd_err_code_t err;
+    if (!req_parse(&req, &aux, head_len, &err)) {
+        httpd_resp_send_err(&req, err, NULL);
+        return false;
+    }
+
+    bool uri_matched;
+    const httpd_uri_t* handler = find_handler(hd, &req, &uri_matched);
+    if (!handler) {
+        ESP_LOGW(TAG, "No handler for %s", req.uri);
+        httpd_resp_send_err(&req, uri_matched ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND, NULL);
+        return req_purge(&req) && aux.keep_alive;
+    }
+
+    req.user_ctx = handler->user_ctx;
+    esp_err_t ret = handler->handler(&req);
+
+    // Keep the context set by the handler for the next requests
+    if (!req.ignore_sess_ctx_changes) {
+        if (sess->ctx && sess->ctx != req.sess_ctx) {
+            if (sess->free_ctx) {
+                sess->free_ctx(sess->ctx);
+            } else {
+                free(sess->ctx);
+            }
+        }
+        sess->ctx = req.sess_ctx;
+        sess->free_ctx = req.free_ctx;
+    }
+
+    if (ret != ESP_OK) {
+        return false;
+    }
+
+    // An async request now owns the socket and the content
+    if (atomic_load(&sess->async)) {
+        return true;
+    }
+    return req_purge(&req) && aux.keep_alive;
+}
+
+static void sess_accept(host_httpd_t* hd) {
+    int fd = accept(hd->listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+
+    host_sess_t* slot = NULL;
+    host_sess_t* oldest = NULL;
+    for (size_t i = 0; i < hd->config.max_open_sockets; i++) {
+        host_sess_t* sess = &hd->sessions[i];
+        if (sess->fd < 0) {
+            slot = sess;
+            break;
+        }
+        if (!atomic_load(&sess->async) && (!oldest || sess->lru < oldest->lru)) {
+            oldest = sess;
+        }
+    }
+    if (!slot && hd->config.lru_purge_enable && oldest) {
+        ESP_LOGW(TAG, "Purging least recently used session %d", oldest->fd);
+        sess_close(hd, oldest);
+        slot = oldest;
+    }
+    if (!slot) {
+        ESP_LOGW(TAG, "No free session, closing %d", fd);
+        close(fd);
+        return;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    int sndbuf = HOST_SNDBUF;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    struct timeval recv_timeout = { .tv_sec = hd->config.recv_wait_timeout };
+    struct timeval send_timeout = { .tv_sec = hd->config.send_wait_timeout };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout, sizeof(recv_timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+    if (hd->config.open_fn && hd->config.open_fn(hd, fd) != ESP_OK) {
+        close(fd);
+        return;
+    }
+
+    slot->fd = fd;
+    slot->lru = ++hd->lru_clock;
+    slot->buf_len = 0;
+    atomic_store(&slot->async, false);
+}
+
+static void run_work(host_httpd_t* hd) {
+    pthread_mutex_lock(&hd->work_lock);
+    host_work_t* work = hd->work_head;
+    hd->work_head = hd->work_tail = NULL;
+    pthread_mutex_unlock(&hd->work_lock);
+
+    while (work) {
+        host_work_t* next = work->next;
+        work->fn(work->arg);
+        free(work);
+        work = next;
+    }
+}
+
+/**
+ * @brief The server thread, like the httpd task
+ */
+static void* httpd_thread(void* arg) {
+    host_httpd_t* hd = arg;
+    int* polled = malloc(sizeof(int) * hd->config.max_open_sockets);
+
+    while (atomic_load(&hd->running)) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(hd->listen_fd, &readable);
+        FD_SET(hd->wake[0], &readable);
+        int max_fd = hd->listen_fd > hd->wake[0] ? hd->listen_fd : hd->wake[0];
+        bool buffered = false;
+        for (size_t i = 0; i < hd->config.max_open_sockets; i++) {
+            host_sess_t* sess = &hd->sessions[i];
+            polled[i] = -1;
+            if (sess->fd >= 0 && !atomic_load(&sess->async)) {
+                polled[i] = sess->fd;
+                FD_SET(sess->fd, &readable);
+                max_fd = sess->fd > max_fd ? sess->fd : max_fd;
+                buffered |= sess_has_head(sess);
+            }
+        }
+
+        // Requests pipelined behind an async one are already buffered, do not wait for them
+        struct timeval no_wait = { 0 };
+        if (select(max_fd + 1, &readable, NULL, NULL, buffered ? &no_wait : NULL) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "select failed (%d)", errno);
+            break;
+        }
+
+        if (FD_ISSET(hd->wake[0], &readable)) {
+            char drain[64];
+            while (read(hd->wake[0], drain, sizeof(drain)) == sizeof(drain)) {
+            }
+            run_work(hd);
+        }
+        if (!atomic_load(&hd->running)) {
+            break;
+        }
+
+        for (size_t i = 0; i < hd->config.max_open_sockets; i++) {
+            host_sess_t* sess = &hd->sessions[i];
+            // Skip sessions closed or handed off since the select
+            if (polled[i] < 0 || sess->fd != polled[i] || atomic_load(&sess->async) ||
+                (!FD_ISSET(polled[i], &readable) && !sess_has_head(sess))) {
+                continue;
+            }
+            // Pipelined requests are handled one after the other
+            bool open;
+            do {
+                open = sess_process(hd, sess);
+            } while (open && !atomic_load(&sess->async) && sess_has_head(sess));
+            if (!open) {
+                sess_close(hd, sess);
+            }
+        }
+
+        if (FD_ISSET(hd->listen_fd, &readable)) {
+            sess_accept(hd);
+        }
+    }
+
+    free(polled);
+    return NULL;
+}
+
+
+esp_err_t httpd_start(httpd_handle_t* handle, const httpd_config_t* config) {
+    host_httpd_t* hd = calloc(sizeof(host_httpd_t), 1);
+    if (!hd) {
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    hd->config = *config;
+    hd->handlers = calloc(sizeof(httpd_uri_t), config->max_uri_handlers);
+    hd->sessions = calloc(sizeof(host_sess_t), config->max_open_sockets);
+    for (size_t i = 0; i < config->max_open_sockets; i++) {
+        hd->sessions[i].fd = -1;
+    }
+    pthread_mutex_init(&hd->work_lock, NULL);
+
+    hd->listen_fd = socket(AF_INET6, SOCK_STREAM, 0);
+    int one = 1;
+    int zero = 0;
+    setsockopt(hd->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(hd->listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+    struct sockaddr_in6 addr = {
+        .sin6_family = AF_INET6,
+        .sin6_addr = in6addr_any,
+        .sin6_port = htons(config->server_port)
+    };
+    if (hd->listen_fd < 0 ||
+        bind(hd->listen_fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 ||
+        listen(hd->listen_fd, config->backlog_conn ? config->backlog_conn : 5) < 0 ||
+        pipe(hd->wake) < 0) {
+        ESP_LOGE(TAG, "Could not listen on port %u (%d)", config->server_port, errno);
+        if (hd->listen_fd >= 0) {
+            close(hd->listen_fd);
+        }
+        free(hd->handlers);
+        free(hd->sessions);
+        free(hd);
+        return ESP_ERR_HTTPD_TASK;
+    }
+
+    atomic_store(&hd->running, true);
+    if (pthread_create(&hd->thread, NULL, httpd_thread, hd) != 0) {
+        close(hd->listen_fd);
+        close(hd->wake[0]);
+        close(hd->wake[1]);
+        free(hd->handlers);
+        free(hd->sessions);
+        free(hd);
+        return ESP_ERR_HTTPD_TASK;
+    }
+
+    *handle = hd;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+    host_httpd_t* hd = handle;
+    if (!hd) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    atomic_store(&hd->running, false);
+    wake_server(hd);
+    pthread_join(hd->thread, NULL);
+
+    for (size_t i = 0; i < hd->config.max_open_sockets; i++) {
+        if (hd->sessions[i].fd >= 0) {
+            sess_close(hd, &hd->sessions[i]);
+        }
+    }
+    for (size_t i = 0; i < hd->config.max_uri_handlers; i++) {
+        free((char*) hd->handlers[i].uri);
+    }
+    // Work that never ran is dropped, like the httpd's control socket would
+    for (host_work_t* work = hd->work_head; work; ) {
+        host_work_t* next = work->next;
+        free(work);
+        work = next;
+    }
+    if (hd->config.global_user_ctx) {
+        if (hd->config.global_user_ctx_free_fn) {
+            hd->config.global_user_ctx_free_fn(hd->config.global_user_ctx);
+        } else {
+            free(hd->config.global_user_ctx);
+        }
+    }
+
+    close(hd->listen_fd);
+    close(hd->wake[0]);
+    close(hd->wake[1]);
+    pthread_mutex_destroy(&hd->work_lock);
+    free(hd->handlers);
+    free(hd->sessions);
+    free(hd);
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t* uri_handler) {
+    host_httpd_t* hd = handle;
+    if (!hd || !uri_handler || !uri_handler->uri) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    httpd_uri_t* slot = NULL;
+    for (size_t i = 0; i < hd->config.max_uri_handlers; i++) {
+        httpd_uri_t* handler = &hd->handlers[i];
+        if (!handler->uri) {
+            slot = slot ? slot : handler;
+        } else if (handler->method == uri_handler->method && strcmp(handler->uri, uri_handler->uri) == 0) {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    if (!slot) {
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+    *slot = *uri_handler;
+    slot->uri = strdup(uri_handler->uri);
+    return ESP_OK;
+}
+
+esp_err_t httpd_unregister_uri_handler(httpd_handle_t handle, const char* uri, httpd_method_t method) {
+    host_httpd_t* hd = handle;
+    for (size_t i = 0; i < hd->config.max_uri_handlers; i++) {
+        httpd_uri_t* handler = &hd->handlers[i];
+        if (handler->uri && handler->method == method && strcmp(handler->uri, uri) == 0) {
+            free((char*) handler->uri);
+            memset(handler, 0, sizeof(*handler));
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+int httpd_req_recv(httpd_req_t* r, char* buf, size_t buf_len) {
+    host_aux_t* aux = r->aux;
+    if (!aux->remaining) {
+        return 0;
+    }
+    int received = sess_recv(aux->sess, buf, buf_len < aux->remaining ? buf_len : aux->remaining);
+    if (received > 0) {
+        aux->remaining -= received;
+    }
+    return received;
+}
+
+static const char* req_hdr(httpd_req_t* r, const char* field) {
+    host_aux_t* aux = r->aux;
+    for (size_t i = 0; i < aux->hdr_count; i++) {
+        if (strcasecmp(&aux->head[aux->hdr_names[i]], field) == 0) {
+            return &aux->head[aux->hdr_values[i]];
+        }
+    }
+    return NULL;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t* r, const char* field) {
+    const char* value = req_hdr(r, field);
+    return value ? strlen(value) : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t* r, const char* field, char* val, size_t val_size) {
+    const char* value = req_hdr(r, field);
+    if (!value) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (!val_size) {
+        return ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+    snprintf(val, val_size, "%s", value);
+    return strlen(value) < val_size ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t* r) {
+    const char* query = strchr(r->uri, '?');
+    return query ? strcspn(query + 1, "#") : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t* r, char* buf, size_t buf_len) {
+    const char* query = strchr(r->uri, '?');
+    if (!query) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    size_t len = strcspn(query + 1, "#");
+    if (!buf_len) {
+        return ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+    size_t amt = len < buf_len - 1 ? len : buf_len - 1;
+    memcpy(buf, query + 1, amt);
+    buf[amt] = '\0';
+    return len < buf_len ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+int httpd_req_to_sockfd(httpd_req_t* r) {
+    host_aux_t* aux = r->aux;
+    return aux->sess->fd;
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t* r, httpd_req_t** out) {
+    httpd_req_t* async = malloc(sizeof(httpd_req_t));
+    host_aux_t* aux = malloc(sizeof(host_aux_t));
+    if (!async || !aux) {
+        free(async);
+        free(aux);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(async, r, sizeof(httpd_req_t));
+    memcpy(aux, r->aux, sizeof(host_aux_t));
+    async->aux = aux;
+
+    // The copy owns the content and the socket until it completes
+    ((host_aux_t*) r->aux)->remaining = 0;
+    atomic_store(&aux->sess->async, true);
+    *out = async;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t* r) {
+    host_aux_t* aux = r->aux;
+    host_sess_t* sess = aux->sess;
+    host_httpd_t* hd = r->handle;
+
+    // A session that cannot go on is closed by the server thread
+    if (!req_purge(r) || !aux->keep_alive) {
+        httpd_sess_trigger_close(hd, sess->fd);
+    }
+    atomic_store(&sess->async, false);
+    wake_server(hd);
+
+    free(aux);
+    free(r);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t* r, const char* status) {
+    ((host_aux_t*) r->aux)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t* r, const char* type) {
+    ((host_aux_t*) r->aux)->type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t* r, const char* field, const char* value) {
+    host_aux_t* aux = r->aux;
+    host_httpd_t* hd = r->handle;
+    if (aux->resp_count == hd->config.max_resp_headers || aux->resp_count == HOST_RESP_HDRS_MAX) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    aux->resp_fields[aux->resp_count] = field;
+    aux->resp_values[aux->resp_count] = value;
+    aux->resp_count++;
+    return ESP_OK;
+}
+
+/**
+ * @brief Format the status line and headers of a response
+ * @param framing Content-Length or Transfer-Encoding header
+ * @returns the length, or -1 if it does not fit
+ */
+static int resp_head(httpd_req_t* r, char head[HOST_RESP_HEAD_MAX], const char* framing) {
+    host_aux_t* aux = r->aux;
+    int len = snprintf(head, HOST_RESP_HEAD_MAX, "HTTP/1.1 %s\r\nContent-Type: %s\r\n%s\r\n",
+        aux->status, aux->type, framing);
+    for (size_t i = 0; i < aux->resp_count && len < HOST_RESP_HEAD_MAX; i++) {
+        len += snprintf(&head[len], HOST_RESP_HEAD_MAX - len, "%s: %s\r\n", aux->resp_fields[i], aux->resp_values[i]);
+    }
+    if (len < HOST_RESP_HEAD_MAX && !aux->keep_alive) {
+        len += snprintf(&head[len], HOST_RESP_HEAD_MAX - len, "Connection: close\r\n");
+    }
+    if (len < HOST_RESP_HEAD_MAX) {
+        len += snprintf(&head[len], HOST_RESP_HEAD_MAX - len, "\r\n");
+    }
+    return len < HOST_RESP_HEAD_MAX ? len : -1;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t* r, const char* buf, ssize_t buf_len) {
+    host_aux_t* aux = r->aux;
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf ? strlen(buf) : 0;
+    }
+
+    char framing[48];
+    snprintf(framing, sizeof(framing), "Content-Length: %zd", buf_len);
+    char head[HOST_RESP_HEAD_MAX];
+    int head_len = resp_head(r, head, framing);
+    if (head_len < 0) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+
+    struct iovec iov[] = {
+        { .iov_base = head, .iov_len = head_len },
+        { .iov_base = (char*) buf, .iov_len = buf_len }
+    };
+    aux->done = true;
+    return sock_send_all(aux->sess->fd, iov, buf_len ? 2 : 1) == 0 ? ESP_OK : ESP_ERR_HTTPD_RESP_SEND;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t* r, const char* buf, ssize_t buf_len) {
+    host_aux_t* aux = r->aux;
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf ? strlen(buf) : 0;
+    }
+
+    struct iovec iov[4];
+    int iovcnt = 0;
+
+    char head[HOST_RESP_HEAD_MAX];
+    if (!aux->chunked) {
+        int head_len = resp_head(r, head, "Transfer-Encoding: chunked");
+        if (head_len < 0) {
+            return ESP_ERR_HTTPD_RESP_HDR;
+        }
+        iov[iovcnt++] = (struct iovec) { .iov_base = head, .iov_len = head_len };
+        aux->chunked = true;
+    }
+
+    char size[16];
+    if (buf && buf_len) {
+        iov[iovcnt++] = (struct iovec) { .iov_base = size, .iov_len = snprintf(size, sizeof(size), "%zx\r\n", buf_len) };
+        iov[iovcnt++] = (struct iovec) { .iov_base = (char*) buf, .iov_len = buf_len };
+        iov[iovcnt++] = (struct iovec) { .iov_base = "\r\n", .iov_len = 2 };
+    } else {
+        iov[iovcnt++] = (struct iovec) { .iov_base = "0\r\n\r\n", .iov_len = 5 };
+        aux->done = true;
+    }
+    return sock_send_all(aux->sess->fd, iov, iovcnt) == 0 ? ESP_OK : ESP_ERR_HTTPD_RESP_SEND;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t* req, httpd_err_code_t error, const char* msg) {
+    if (error >= HTTPD_ERR_CODE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    httpd_resp_set_status(req, err_table[error].status);
+    httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
+    return httpd_resp_send(req, msg ? msg : err_table[error].msg, HTTPD_RESP_USE_STRLEN);
+}
+
+int httpd_send(httpd_req_t* r, const char* buf, size_t buf_len) {
+    host_aux_t* aux = r->aux;
+    struct iovec iov = { .iov_base = (char*) buf, .iov_len = buf_len };
+    int err = sock_send_all(aux->sess->fd, &iov, 1);
+    return err ? err : (int) buf_len;
+}
+
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char* buf, size_t buf_len, int flags) {
+    (void) hd;
+    (void) flags;
+    struct iovec iov = { .iov_base = (char*) buf, .iov_len = buf_len };
+    int err = sock_send_all(sockfd, &iov, 1);
+    return err ? err : (int) buf_len;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void* arg) {
+    host_httpd_t* hd = handle;
+    host_work_t* item = malloc(sizeof(host_work_t));
+    if (!item) {
+        return ESP_ERR_NO_MEM;
+    }
+    item->fn = work;
+    item->arg = arg;
+    item->next = NULL;
+
+    pthread_mutex_lock(&hd->work_lock);
+    if (hd->work_tail) {
+        hd->work_tail->next = item;
+    } else {
+        hd->work_head = item;
+    }
+    hd->work_tail = item;
+    pthread_mutex_unlock(&hd->work_lock);
+
+    wake_server(hd);
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+    host_close_t* close_req = malloc(sizeof(host_close_t));
+    if (!close_req) {
+        return ESP_ERR_NO_MEM;
+    }
+    close_req->hd = handle;
+    close_req->fd = sockfd;
+    esp_err_t err = httpd_queue_work(handle, sess_close_work, close_req);
+    if (err != ESP_OK) {
+        free(close_req);
+    }
+    return err;
+}
+
+void* httpd_get_global_user_ctx(httpd_handle_t handle) {
+    return ((host_httpd_t*) handle)->config.global_user_ctx;
+}
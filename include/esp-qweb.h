@@ -10,6 +10,97 @@
  */
 #define QWEB_MAX_CONTENT_RECEIVE     (10240)
 
+/**
+ * @brief Size of the fixed buffer used to receive streamed POST bodies
+ */
+#ifdef CONFIG_QWEB_STREAM_RECV_CHUNK
+#define QWEB_STREAM_RECV_CHUNK      CONFIG_QWEB_STREAM_RECV_CHUNK
+#else
+#define QWEB_STREAM_RECV_CHUNK      (512)
+#endif
+
+/**
+ * @brief Size of the buffer collecting the output of a response writer
+ */
+#ifdef CONFIG_QWEB_RESP_WRITER_BUF
+#define QWEB_RESP_WRITER_BUF        CONFIG_QWEB_RESP_WRITER_BUF
+#else
+#define QWEB_RESP_WRITER_BUF        (512)
+#endif
+
+/**
+ * @brief Default size above which files are sent to the client in chunks
+ */
+#define QWEB_STREAM_THRESHOLD       (16384)
+
+/**
+ * @brief Default size of each chunk of a streamed file
+ */
+#define QWEB_STREAM_SEND_CHUNK      (4096)
+
+/**
+ * @brief Default number of worker tasks running async post handlers
+ */
+#define QWEB_ASYNC_WORKERS          (2)
+
+/**
+ * @brief Default number of async post requests waiting for a worker
+ *  before new ones are turned away with 503
+ */
+#define QWEB_ASYNC_QUEUE_LEN        (4)
+
+/**
+ * @brief Maximum number of WebSocket endpoints of a server
+ *  (each takes one of the httpd's uri handler slots)
+ */
+#define QWEB_WS_MAX_ENDPOINTS       (4)
+
+/**
+ * @brief Number of past events kept by each Server-Sent Events channel,
+ *  to be replayed to clients reconnecting with a Last-Event-ID
+ */
+#define QWEB_SSE_RING_LEN           (16)
+
+/**
+ * @brief Number of buffers of each versioned dynamic file: the current
+ *  version, the one being written, and older ones still being sent
+ */
+#define QWEB_DYN_BUFFERS            (3)
+
+/**
+ * @brief Maximum number of parameters parsed from a query string or form
+ */
+#define QWEB_PARAMS_MAX             (16)
+
+/**
+ * @brief Path qweb.js sends batched calls to (see qweb_register_batch)
+ */
+#define QWEB_BATCH_PATH             "/qweb/batch"
+
+/**
+ * @brief Number of requests the access log holds before dropping them
+ *  (a power of two)
+ */
+#ifdef CONFIG_QWEB_ACCESS_LOG_RING
+#define QWEB_ACCESS_LOG_RING        CONFIG_QWEB_ACCESS_LOG_RING
+#else
+#define QWEB_ACCESS_LOG_RING        (64)
+#endif
+
+/**
+ * @brief Most requests written out by the access log per second
+ */
+#ifdef CONFIG_QWEB_ACCESS_LOG_RATE
+#define QWEB_ACCESS_LOG_RATE        CONFIG_QWEB_ACCESS_LOG_RATE
+#else
+#define QWEB_ACCESS_LOG_RATE        (50)
+#endif
+
+/**
+ * @brief Length of the uri kept by access log records, with terminator
+ */
+#define QWEB_ACCESS_LOG_URI_LEN     (48)
+
 /////////////////////
 // MIME types
 /////////////////////
@@ -60,11 +151,90 @@
  * @param type mime type
  * @param embed_name the identifier generated for the embedded data
  *  (see https://docs.espressif.com/projects/esp-idf/en/v5.1.4/esp32/api-guides/build-system.html#embedding-binary-data)
+ * @note files embedded with qweb_embed_files (project_include.cmake) use the
+ *  ETag computed at build time, others are hashed when registered
  */
 #define QWEB_FILE(server, path, type, embed_name) do {\
     extern const char embed_name##_start[] asm("_binary_" __STRING(embed_name) "_start");\
     extern const char embed_name##_end[] asm("_binary_" __STRING(embed_name) "_end");\
-    qweb_register_file(server, path, type, embed_name##_start, embed_name##_end - embed_name##_start);}\
+    extern const char embed_name##_etag_start[] asm("_binary_" __STRING(embed_name) "_etag_start") __attribute__((weak));\
+    qweb_register_file_etag(server, path, type, embed_name##_start, embed_name##_end - embed_name##_start, embed_name##_etag_start);}\
+    while (0)
+
+
+/**
+ * @brief Attach a precompressed variant of an embedded file to a registered file
+ * @param server server the file is registered to
+ * @param path path the file is registered at
+ * @param encoding a qweb_encoding_t
+ * @param embed_name the identifier generated for the embedded original,
+ *  the variant is looked up as embed_name_gz or embed_name_br
+ *  (see qweb_embed_compressed in project_include.cmake)
+ */
+#define QWEB_FILE_ENCODED(server, path, encoding, embed_name, suffix) do {\
+    extern const char embed_name##_##suffix##_start[] asm("_binary_" __STRING(embed_name) "_" #suffix "_start");\
+    extern const char embed_name##_##suffix##_end[] asm("_binary_" __STRING(embed_name) "_" #suffix "_end");\
+    qweb_file_set_encoded(server, path, encoding, embed_name##_##suffix##_start, embed_name##_##suffix##_end - embed_name##_##suffix##_start);}\
+    while (0)
+
+/**
+ * @brief Register an embedded file along with its gzip variant, which is
+ *  sent instead to clients accepting it
+ * @param server server to register to
+ * @param path path to register the file at
+ * @param type mime type
+ * @param embed_name the identifier generated for the embedded original
+ */
+#define QWEB_FILE_GZ(server, path, type, embed_name) do {\
+    QWEB_FILE(server, path, type, embed_name);\
+    QWEB_FILE_ENCODED(server, path, QWEB_ENCODING_GZIP, embed_name, gz);}\
+    while (0)
+
+/**
+ * @brief Register an embedded file along with its gzip and brotli variants
+ * @param server server to register to
+ * @param path path to register the file at
+ * @param type mime type
+ * @param embed_name the identifier generated for the embedded original
+ */
+#define QWEB_FILE_GZ_BR(server, path, type, embed_name) do {\
+    QWEB_FILE_GZ(server, path, type, embed_name);\
+    QWEB_FILE_ENCODED(server, path, QWEB_ENCODING_BR, embed_name, br);}\
+    while (0)
+
+
+/**
+ * @brief Serve a template compiled by qweb_add_template, rendered on each request
+ * @param server server to register to
+ * @param path path to register the page at
+ * @param name the NAME given to qweb_add_template
+ * @param cb slot callback (qweb_template_slot_cb_t)
+ * @param ctx context passed to the callback
+ */
+#define QWEB_TEMPLATE(server, path, name, cb, ctx) do {\
+    extern const qweb_template_t qweb_template_##name;\
+    qweb_register_template(server, path, &qweb_template_##name, cb, ctx);}\
+    while (0)
+
+
+/**
+ * @brief Serve the qweb.js browser client, embedded with qweb_embed_client
+ *  (project_include.cmake), along with its gzip variant
+ * @param server server to register to
+ * @param path path to register the client at, e.g. "/qweb.js"
+ */
+#define QWEB_CLIENT(server, path) \
+    QWEB_FILE_GZ(server, path, HTTP_MIME_JS, qweb_min_js)
+
+
+/**
+ * @brief Serve a route manifest generated by qweb_add_manifest
+ * @param server server to register to
+ * @param name the NAME given to qweb_add_manifest
+ */
+#define QWEB_MANIFEST(server, name) do {\
+    extern const qweb_manifest_t qweb_manifest_##name;\
+    qweb_register_manifest(server, &qweb_manifest_##name);}\
     while (0)
 
 
@@ -75,6 +245,8 @@
  * @param type mime type
  * @param databuffer buffer pointer
  * @param starting_len length of data
+ * @note clients may get a mix of two versions if the buffer changes while
+ *  it is sent, see qweb_register_dyn for files updated at run time
  */
 #define QWEB_FILE_DYN(server, path, type, databuffer, starting_len) \
     qweb_register_file(server, path, type, databuffer, starting_len)
@@ -148,11 +320,64 @@
 
 
 typedef struct qweb_server qweb_server_t;
+
+/**
+ * @brief A versioned dynamic file (see qweb_register_dyn)
+ */
+typedef struct qweb_dyn qweb_dyn_t;
+
+/////////////////////
+// Cache-Control policies
+/////////////////////
+#define QWEB_CACHE_NO_CACHE     "no-cache"                              // always revalidate with the ETag
+#define QWEB_CACHE_NO_STORE     "no-store"                              // never cache
+#define QWEB_CACHE_IMMUTABLE    "public, max-age=31536000, immutable"   // never revalidate
+
+/**
+ * @brief Content codings of precompressed file variants
+ */
+typedef enum qweb_encoding {
+    QWEB_ENCODING_GZIP,
+    QWEB_ENCODING_BR,
+} qweb_encoding_t;
+
+/**
+ * @brief A file of a route manifest
+ */
+typedef struct qweb_manifest_file {
+    const char* path;               // path used to GET this file
+    const char* type;               // MIME type
+    const char* content;            // data content
+    size_t content_length;          // data length
+    const char* gz_content;         // gzip encoded content (optional)
+    size_t gz_length;               // gzip encoded length
+    const char* etag;               // quoted strong entity tag
+    const char* cache_control;      // Cache-Control policy, NULL for the server default
+} qweb_manifest_file_t;
+
+/**
+ * @brief A constant table of files generated at build time
+ *  (see qweb_add_manifest in project_include.cmake), indexed by
+ *  a minimal perfect hash so that it can stay in flash
+ */
+typedef struct qweb_manifest {
+    const qweb_manifest_file_t* files;  // files, in hash order
+    size_t file_count;
+    const uint32_t* seeds;              // second level hash seed for each bucket
+    size_t bucket_count;
+} qweb_manifest_t;
+
 typedef struct qweb_server_config {
     uint16_t port;
     size_t stack_size;
     uint16_t max_sockets;
     size_t max_recvlen;
+    size_t stream_threshold;    // files larger than this are streamed (0: only files marked with qweb_file_set_stream)
+    size_t stream_chunk;        // chunk size for streamed files (0: QWEB_STREAM_SEND_CHUNK)
+    const char* cache_control;  // default Cache-Control for files (NULL: none)
+    size_t async_workers;       // worker tasks for async post handlers (0: run them in the httpd task)
+    size_t async_queue_len;     // async post requests waiting for a worker
+    size_t async_stack_size;    // stack size of each worker task
     const char* name;
 #ifdef CONFIG_QWEB_EN_SSL
     bool ssl;
@@ -166,11 +391,17 @@ typedef struct qweb_server_config {
 } qweb_server_config_t;
 
 #define QWEB_SERVER_CFG_DEFAULT(_name) (qweb_server_config_t)\
-    { .port = 80, .stack_size = 4096, .max_sockets = 7, .max_recvlen = QWEB_MAX_CONTENT_RECEIVE, .name = _name }
+    { .port = 80, .stack_size = 4096, .max_sockets = 7, .max_recvlen = QWEB_MAX_CONTENT_RECEIVE,\
+      .stream_threshold = QWEB_STREAM_THRESHOLD, .stream_chunk = QWEB_STREAM_SEND_CHUNK,\
+      .cache_control = QWEB_CACHE_NO_CACHE, .async_workers = QWEB_ASYNC_WORKERS,\
+      .async_queue_len = QWEB_ASYNC_QUEUE_LEN, .async_stack_size = 4096, .name = _name }
 
 #ifdef CONFIG_QWEB_EN_SSL
 #define QWEB_SSL_SERVER_CFG_DEFAULT(_name)  (qweb_server_config_t)\
-    { .port = 0, .stack_size = 10240, .max_sockets = 4, .max_recvlen = QWEB_MAX_CONTENT_RECEIVE, .name = _name, .ssl = true }
+    { .port = 0, .stack_size = 10240, .max_sockets = 4, .max_recvlen = QWEB_MAX_CONTENT_RECEIVE,\
+      .stream_threshold = QWEB_STREAM_THRESHOLD, .stream_chunk = QWEB_STREAM_SEND_CHUNK,\
+      .cache_control = QWEB_CACHE_NO_CACHE, .async_workers = QWEB_ASYNC_WORKERS,\
+      .async_queue_len = QWEB_ASYNC_QUEUE_LEN, .async_stack_size = 4096, .name = _name, .ssl = true }
 #endif
 
 #define QWEB_ASSIGN_EMBEDDED(destbegin, destlen, embed_name) do {\
@@ -214,17 +445,440 @@ typedef struct qweb_post_cb_ret {
 typedef qweb_post_cb_ret_t (*qweb_post_cb_t)(const char* uri, const char* data, size_t data_len);
 
 
+/**
+ * @brief A parameter of a query string or of an urlencoded form.
+ *  Both key and value point into the parsed buffer, decoded and null
+ *  terminated (a value may still contain a decoded "%00").
+ */
+typedef struct qweb_param {
+    const char* key;
+    size_t key_len;
+    const char* value;              // empty if the key has no '='
+    size_t value_len;
+} qweb_param_t;
+
+/**
+ * @brief Parameters of a query string or of an urlencoded form, in order
+ */
+typedef struct qweb_params {
+    size_t count;
+    qweb_param_t params[QWEB_PARAMS_MAX];
+} qweb_params_t;
+
+/**
+ * @brief Parse a query string or an application/x-www-form-urlencoded
+ *  body ("a=1&b=x%20y"), adding its parameters to `params` (which starts
+ *  with a count of 0). Percent-escapes and '+' are decoded in place, so
+ *  data is modified, and nothing is copied or allocated.
+ * @param data parameters, writable up to data[len] where a terminator is written
+ * @param len length of the parameters
+ * @returns ESP_ERR_NO_MEM if there are more than QWEB_PARAMS_MAX
+ *  parameters, the first ones are kept
+ */
+esp_err_t qweb_params_parse(qweb_params_t* params, char* data, size_t len);
+
+/**
+ * @brief Get the value of a parameter, the first one if it repeats
+ * @param value_len set to the value length, may be NULL
+ * @returns the value, or NULL if there is no such parameter
+ */
+const char* qweb_param(const qweb_params_t* params, const char* key, size_t* value_len);
+
+/**
+ * @brief Get the value of a parameter as a decimal integer
+ * @returns ESP_ERR_NOT_FOUND if there is no such parameter, ESP_ERR_INVALID_ARG
+ *  if its value is not a whole integer in the range of long
+ */
+esp_err_t qweb_param_int(const qweb_params_t* params, const char* key, long* value);
+
+/**
+ * @brief Get the value of a parameter as a number
+ * @returns ESP_ERR_NOT_FOUND if there is no such parameter, ESP_ERR_INVALID_ARG
+ *  if its value is not a whole number
+ */
+esp_err_t qweb_param_float(const qweb_params_t* params, const char* key, float* value);
+
+/**
+ * @brief Get the value of a parameter as a boolean: "1", "true", "on", "yes"
+ *  or no value at all (as in "?verbose") are true, "0", "false", "off" and
+ *  "no" are false, whatever their case
+ * @returns ESP_ERR_NOT_FOUND if there is no such parameter, ESP_ERR_INVALID_ARG
+ *  for other values
+ */
+esp_err_t qweb_param_bool(const qweb_params_t* params, const char* key, bool* value);
+
+/**
+ * @brief A post request callback handler receiving the parameters of the request
+ * @param uri the uri from the client
+ * @param params parameters of the query string, followed by those of the body
+ *  if it is an HTTP_MIME_FORM_URLENCODED form
+ * @param data data from the client (a form is decoded in place)
+ * @param data_len content length (data size)
+ * @returns a post request return value struct to indicate a response to the client
+ */
+typedef qweb_post_cb_ret_t (*qweb_post_params_cb_t)(const char* uri, const qweb_params_t* params, const char* data, size_t data_len);
+
+
+
+/**
+ * @brief A response written to the client piece by piece
+ *  (see qweb_post_writer_cb_t)
+ */
+typedef struct qweb_resp_writer qweb_resp_writer_t;
+
+/**
+ * @brief Set the status of a written response (HTTPD_200 by default)
+ * @note the status, type and headers must be set before any data is sent,
+ *  and their strings must stay valid until then
+ * @return ESP_ERR_INVALID_STATE if data was already sent
+ */
+esp_err_t qweb_resp_set_status(qweb_resp_writer_t* writer, const char* status);
+
+/**
+ * @brief Set the content type of a written response
+ * @return ESP_ERR_INVALID_STATE if data was already sent
+ */
+esp_err_t qweb_resp_set_type(qweb_resp_writer_t* writer, const char* type);
+
+/**
+ * @brief Add a header to a written response. Cached GET callbacks keep
+ *  their headers with the response (field and value are copied).
+ * @return ESP_ERR_INVALID_STATE if data was already sent,
+ *  ESP_ERR_NOT_SUPPORTED for a call of a batch, which has no headers of its own
+ */
+esp_err_t qweb_resp_set_hdr(qweb_resp_writer_t* writer, const char* field, const char* value);
+
+/**
+ * @brief Write data to a response. Data is collected in a buffer of
+ *  QWEB_RESP_WRITER_BUF bytes and sent as a chunk when it is full.
+ * @return the first error encountered while sending
+ */
+esp_err_t qweb_resp_write(qweb_resp_writer_t* writer, const char* data, size_t len);
+
+/**
+ * @brief Write formatted text to a response
+ * @note a single call producing more than QWEB_RESP_WRITER_BUF bytes
+ *  is formatted in a temporary heap buffer
+ * @return the first error encountered while sending
+ */
+esp_err_t qweb_resp_printf(qweb_resp_writer_t* writer, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Send the data written so far to the client
+ * @return the first error encountered while sending
+ */
+esp_err_t qweb_resp_flush(qweb_resp_writer_t* writer);
+
+/**
+ * @brief Write text to a response, escaping the characters that are
+ *  special in HTML (& < > " ') so that it shows as is in a page
+ * @return the first error encountered while sending
+ */
+esp_err_t qweb_resp_write_html(qweb_resp_writer_t* writer, const char* text);
+
+
+/**
+ * @brief A literal piece of a compiled template, followed by a slot
+ */
+typedef struct qweb_template_segment {
+    const char* literal;            // text sent as is, from flash
+    size_t literal_len;
+    int slot;                       // id of the slot after the text, -1 for the last segment
+} qweb_template_segment_t;
+
+/**
+ * @brief A page template compiled at build time (see qweb_add_template in
+ *  project_include.cmake), made of literal segments and slots filled in
+ *  when the page is rendered, so that nothing is parsed at run time
+ */
+typedef struct qweb_template {
+    const qweb_template_segment_t* segments;
+    size_t segment_count;
+    const char* const* slot_names;  // slot names, by id
+    size_t slot_count;
+    const char* type;               // MIME type, from the template's file extension
+} qweb_template_t;
+
+/**
+ * @brief Fill a slot of a template being rendered
+ * @param uri the uri from the client
+ * @param slot id of the slot (<NAME>_SLOT_<SLOT> in the generated header)
+ * @param writer response to write the value to, e.g. with qweb_resp_printf or qweb_resp_write_html
+ * @param ctx context given when the template was registered
+ * @returns ESP_OK, or an error to answer with 500 if nothing was sent yet
+ */
+typedef esp_err_t (*qweb_template_slot_cb_t)(const char* uri, int slot, qweb_resp_writer_t* writer, void* ctx);
+
+/**
+ * @brief Render a template to a response: its literal segments are written
+ *  straight from flash, in chunks, with the slots filled by a callback in between.
+ *  Also usable from a qweb_post_writer_cb_t.
+ * @returns the first error of the callback or of the writer
+ */
+esp_err_t qweb_template_render(qweb_resp_writer_t* writer, const qweb_template_t* tpl, const char* uri, qweb_template_slot_cb_t cb, void* ctx);
+
+/**
+ * @brief A post request callback handler writing its response as it goes,
+ *  instead of building it in one buffer. A response that fits in
+ *  QWEB_RESP_WRITER_BUF is sent whole, larger ones are sent in chunks.
+ * @param uri the uri from the client
+ * @param data data from the client
+ * @param data_len content length (data size)
+ * @param writer response to write to
+ * @returns ESP_OK, or an error to answer with 500 if nothing was sent yet
+ */
+typedef esp_err_t (*qweb_post_writer_cb_t)(const char* uri, const char* data, size_t data_len, qweb_resp_writer_t* writer);
+
 
 typedef struct qweb_post_handler {
     qweb_post_cb_t cb;
+    qweb_post_writer_cb_t writer_cb;    // used instead of cb when set
+    qweb_post_params_cb_t params_cb;    // used instead of cb when set
     bool supress_log: 1;
+    bool async: 1;          // run on a worker task, so that slow callbacks do not stall the server
 } qweb_post_handler_t;
 
-#define QWEB_POST_HANDLER_DEFAULT(_cb)   (qweb_post_handler_t) { .cb=_cb, .supress_log = false }
+#define QWEB_POST_HANDLER_DEFAULT(_cb)   (qweb_post_handler_t) { .cb=_cb, .writer_cb = NULL, .params_cb = NULL, .supress_log = false, .async = false }
+
+/**
+ * @brief A post handler writing its response through a qweb_resp_writer_t
+ */
+#define QWEB_POST_HANDLER_WRITER(_cb)    (qweb_post_handler_t) { .cb=NULL, .writer_cb = _cb, .params_cb = NULL, .supress_log = false, .async = false }
 
+/**
+ * @brief A post handler given the parameters of the query string and of an urlencoded form,
+ *  parsed with qweb_params_parse
+ */
+#define QWEB_POST_HANDLER_PARAMS(_cb)    (qweb_post_handler_t) { .cb=NULL, .writer_cb = NULL, .params_cb = _cb, .supress_log = false, .async = false }
 
 /**
- * @brief Register a file with the server's internal file system
+ * @brief A post handler run by the server's pool of worker tasks
+ *  (see async_workers in qweb_server_config_t). The callback may then
+ *  block without holding up other requests, but must be thread safe.
+ */
+#define QWEB_POST_HANDLER_ASYNC(_cb)     (qweb_post_handler_t) { .cb=_cb, .writer_cb = NULL, .params_cb = NULL, .supress_log = false, .async = true }
+
+
+/**
+ * @brief A GET callback, computing a resource when it is requested
+ * @param uri the uri from the client, with its query string
+ * @param writer response to write to. The response of a cached handler is
+ *  collected whole, only its status, type and content are kept (copied, so
+ *  the strings given to qweb_resp_set_status/qweb_resp_set_type may be temporary).
+ * @returns ESP_OK, or an error to answer with 500 if nothing was sent yet
+ *  (the response is not cached then)
+ */
+typedef esp_err_t (*qweb_get_cb_t)(const char* uri, qweb_resp_writer_t* writer);
+
+typedef struct qweb_get_handler {
+    qweb_get_cb_t cb;
+    uint32_t ttl_ms;        // serve each response for this long without running cb again, 0 to run it for every request
+    bool supress_log: 1;
+    bool async: 1;          // run on a worker task, so that slow callbacks do not stall the server
+} qweb_get_handler_t;
+
+#define QWEB_GET_HANDLER_DEFAULT(_cb)    (qweb_get_handler_t) { .cb = _cb, .ttl_ms = 0, .supress_log = false, .async = false }
+
+/**
+ * @brief A GET handler whose responses are kept for _ttl_ms milliseconds.
+ *  One response is kept, for the uri (query included) it was generated for.
+ *  Requests for that uri arriving while it is generated wait for it instead
+ *  of running the callback again, up to a few of them (others get a 503).
+ */
+#define QWEB_GET_HANDLER_CACHED(_cb, _ttl_ms)   (qweb_get_handler_t) { .cb = _cb, .ttl_ms = _ttl_ms, .supress_log = false, .async = false }
+
+
+/**
+ * @brief Maximum number of parameters captured from a route pattern
+ */
+#define QWEB_ROUTE_MAX_PARAMS       (4)
+
+/**
+ * @brief A parameter captured from a path by a route pattern.
+ *  Both name and value point into existing strings (the registered
+ *  pattern and the request uri), and are not null terminated.
+ */
+typedef struct qweb_route_param {
+    const char* name;               // parameter name ("*" for the wildcard)
+    size_t name_len;
+    const char* value;              // path segment matched
+    size_t value_len;
+} qweb_route_param_t;
+
+/**
+ * @brief Parameters captured from a path by a route pattern
+ */
+typedef struct qweb_route_params {
+    size_t count;
+    qweb_route_param_t params[QWEB_ROUTE_MAX_PARAMS];
+} qweb_route_params_t;
+
+/**
+ * @brief Get the value of a route parameter
+ * @param name parameter name, "*" for the wildcard
+ * @param value_len set to the value length, may be NULL
+ * @returns the value (not null terminated), or NULL if there is no such parameter
+ */
+const char* qweb_route_param(const qweb_route_params_t* params, const char* name, size_t* value_len);
+
+/**
+ * @brief A post request callback handler for a route pattern
+ * @param uri the uri from the client
+ * @param params parameters captured from the path
+ * @param data data from the client
+ * @param data_len content length (data size)
+ * @returns a post request return value struct to indicate a response to the client
+ */
+typedef qweb_post_cb_ret_t (*qweb_post_route_cb_t)(const char* uri, const qweb_route_params_t* params, const char* data, size_t data_len);
+
+typedef struct qweb_post_route_handler {
+    qweb_post_route_cb_t cb;
+    bool supress_log: 1;
+} qweb_post_route_handler_t;
+
+#define QWEB_POST_ROUTE_HANDLER_DEFAULT(_cb)   (qweb_post_route_handler_t) { .cb=_cb, .supress_log = false }
+
+
+/**
+ * @brief Called when a streamed post request arrives, before any data is received
+ * @param uri the uri from the client
+ * @param content_len total content length announced by the client
+ * @param ctx per-request context, set by the callback and passed to the chunk and end callbacks
+ * @returns ESP_OK to accept the request, anything else to reject it
+ */
+typedef esp_err_t (*qweb_post_stream_begin_cb_t)(const char* uri, size_t content_len, void** ctx);
+
+/**
+ * @brief Called for each piece of a streamed post request's data
+ * @param ctx per-request context
+ * @param data data from the client (only valid for the duration of the call)
+ * @param data_len size of this piece, at most QWEB_STREAM_RECV_CHUNK
+ * @returns ESP_OK to continue receiving, anything else to abort the request
+ */
+typedef esp_err_t (*qweb_post_stream_chunk_cb_t)(void* ctx, const char* data, size_t data_len);
+
+/**
+ * @brief Called once a streamed post request is over, whenever begin succeeded
+ * @param ctx per-request context, to be released by the callback
+ * @param status ESP_OK if all data was received and accepted, otherwise the error that stopped it
+ * @returns a post request return value struct to indicate a response to the client
+ */
+typedef qweb_post_cb_ret_t (*qweb_post_stream_end_cb_t)(void* ctx, esp_err_t status);
+
+/**
+ * @brief A post request handler which receives the data in pieces
+ *  through a small fixed buffer, instead of all at once.
+ *  The content length is not limited by max_recvlen, begin can
+ *  reject requests the handler cannot take.
+ */
+typedef struct qweb_post_stream_handler {
+    qweb_post_stream_begin_cb_t begin;  // optional
+    qweb_post_stream_chunk_cb_t chunk;
+    qweb_post_stream_end_cb_t end;
+    bool supress_log: 1;
+} qweb_post_stream_handler_t;
+
+#define QWEB_POST_STREAM_HANDLER_DEFAULT(_begin, _chunk, _end)   (qweb_post_stream_handler_t) \
+    { .begin=_begin, .chunk=_chunk, .end=_end, .supress_log = false }
+
+
+/**
+ * @brief A part of a multipart/form-data request, as described by its headers.
+ *  Values longer than 127 bytes are cut.
+ */
+typedef struct qweb_form_part {
+    const char* name;               // name of the form field, empty if not given
+    const char* filename;           // file name of a file input, NULL for other fields
+    const char* type;               // content type of the part, NULL if not given
+} qweb_form_part_t;
+
+/**
+ * @brief Called when a part of a form starts, before its data
+ * @param ctx per-request context, from the begin callback
+ * @param part headers of the part (only valid for the duration of the call)
+ * @returns ESP_OK to continue receiving, anything else to abort the request
+ */
+typedef esp_err_t (*qweb_form_part_cb_t)(void* ctx, const qweb_form_part_t* part);
+
+/**
+ * @brief Called when the data of a part is complete
+ * @param ctx per-request context
+ * @returns ESP_OK to continue receiving, anything else to abort the request
+ */
+typedef esp_err_t (*qweb_form_part_end_cb_t)(void* ctx);
+
+/**
+ * @brief A post request handler for multipart/form-data uploads, such as
+ *  from an <input type="file">. The body is split into parts as it is
+ *  received through the stream buffer: the data of each part goes to the
+ *  data callback in pieces (at most QWEB_STREAM_RECV_CHUNK bytes), which
+ *  can write it to a sink such as an OTA partition or a file. The content
+ *  length is not limited by max_recvlen.
+ *  Requests without a multipart content type and boundary are answered
+ *  with a 400, without calling the handler. When the body is malformed or
+ *  cut short, end gets ESP_ERR_INVALID_ARG or ESP_ERR_INVALID_SIZE, and
+ *  part_end is not called for the unfinished part.
+ */
+typedef struct qweb_post_form_handler {
+    qweb_post_stream_begin_cb_t begin;  // optional
+    qweb_form_part_cb_t part;           // optional
+    qweb_post_stream_chunk_cb_t data;   // data of the current part
+    qweb_form_part_end_cb_t part_end;   // optional
+    qweb_post_stream_end_cb_t end;
+    bool supress_log: 1;
+} qweb_post_form_handler_t;
+
+#define QWEB_POST_FORM_HANDLER_DEFAULT(_part, _data, _end)   (qweb_post_form_handler_t) \
+    { .begin=NULL, .part=_part, .data=_data, .part_end=NULL, .end=_end, .supress_log = false }
+
+
+/**
+ * @brief Called when a client opens a WebSocket
+ * @param path endpoint path
+ * @param fd socket of the connection, identifies it in the other callbacks and qweb_ws_send
+ * @returns ESP_OK to accept the connection, anything else to close it
+ */
+typedef esp_err_t (*qweb_ws_open_cb_t)(const char* path, int fd);
+
+/**
+ * @brief Called for each message received on a WebSocket
+ * @param path endpoint path
+ * @param fd socket of the connection
+ * @param data message payload, null terminated (only valid for the duration of the call)
+ * @param data_len payload size
+ * @param binary true for a binary message, false for text
+ * @returns ESP_OK to keep the connection, anything else to close it
+ */
+typedef esp_err_t (*qweb_ws_message_cb_t)(const char* path, int fd, const char* data, size_t data_len, bool binary);
+
+/**
+ * @brief Called when a WebSocket that was accepted is closed
+ * @param path endpoint path
+ * @param fd socket of the connection (no longer usable)
+ */
+typedef void (*qweb_ws_close_cb_t)(const char* path, int fd);
+
+/**
+ * @brief Callbacks of a WebSocket endpoint, all optional.
+ *  They run in the httpd task.
+ */
+typedef struct qweb_ws_handler {
+    qweb_ws_open_cb_t open;
+    qweb_ws_message_cb_t message;
+    qweb_ws_close_cb_t close;
+    bool supress_log: 1;
+} qweb_ws_handler_t;
+
+#define QWEB_WS_HANDLER_DEFAULT(_open, _message, _close)   (qweb_ws_handler_t) \
+    { .open=_open, .message=_message, .close=_close, .supress_log = false }
+
+
+/**
+ * @brief Register a file with the server's internal file system.
+ * @note files can be registered, changed and unregistered from any task
+ *  while the server runs: requests never wait for it, and see either the
+ *  old or the new file. Entries replaced are freed once the requests
+ *  using them are done.
  * 
  * @param fpath path to register to
  * @param ctype mime type
@@ -233,14 +887,191 @@ typedef struct qweb_post_handler {
  */
 void qweb_register_file(qweb_server_t* server, const char* fpath, const char* ctype, const char* content, size_t content_length);
 
+/**
+ * @brief Register a file with the server's internal file system,
+ *  along with an entity tag computed ahead of time
+ * 
+ * @param fpath path to register to
+ * @param ctype mime type
+ * @param content file contents
+ * @param content_length file size
+ * @param etag quoted strong entity tag, or NULL to hash the content
+ */
+void qweb_register_file_etag(qweb_server_t* server, const char* fpath, const char* ctype, const char* content, size_t content_length, const char* etag);
+
+/**
+ * @brief Serve the files of a constant route manifest. The manifest is
+ *  searched before the files registered with qweb_register_file, and
+ *  takes no memory beyond the pointer kept by the server (and the counters
+ *  of its files with CONFIG_QWEB_METRICS). It may be replaced while the
+ *  server runs, requests see either manifest.
+ * 
+ * @param manifest manifest to use (replacing any previous one), or NULL for none
+ */
+void qweb_register_manifest(qweb_server_t* server, const qweb_manifest_t* manifest);
+
+/**
+ * @brief Serve every file below a directory of a mounted filesystem
+ *  (LittleFS, FAT, ...). The directory is indexed once, at "<url_prefix>/<relative path>",
+ *  and the files are read on each request, through a buffer of the server's
+ *  stream chunk size. `name.gz` next to `name` is served as its gzip variant,
+ *  and index.html files are also served at their directory. Files added or
+ *  changed later are picked up by registering the directory again.
+ *
+ * @param dir directory to index, e.g. the base path of the mount
+ * @param url_prefix prefix of the urls, "" or "/" for the root
+ * @returns ESP_ERR_NOT_FOUND if the directory cannot be opened
+ */
+esp_err_t qweb_register_dir(qweb_server_t* server, const char* dir, const char* url_prefix);
+
+/**
+ * @brief Serve the files of a qweb image (see qweb_add_image in project_include.cmake).
+ *  Contents are sent straight from the image, which must outlive the server.
+ *
+ * @returns ESP_ERR_INVALID_ARG if the image is malformed
+ */
+esp_err_t qweb_register_image(qweb_server_t* server, const void* image, size_t image_len);
+
+/**
+ * @brief Map a data partition holding a qweb image and serve its files,
+ *  without copying them to RAM. The partition stays mapped until qweb_free.
+ *
+ * @param label partition label
+ * @returns ESP_ERR_NOT_FOUND if there is no image in such a partition
+ */
+esp_err_t qweb_register_partition(qweb_server_t* server, const char* label);
+
 /**
  * @brief Adjust the content length of a file
+ * @note this also updates the file's ETag, call it after
+ *  changing the content of a dynamic file, even with the same length
  * 
  * @param fpath file path
  * @param length new content length
  */
 void qweb_file_trunc_path(qweb_server_t* server, const char* fpath, size_t length);
 
+/**
+ * @brief Register a GET callback, computing the content of a file when it is requested.
+ *  It is sent with "Cache-Control: no-cache" unless set otherwise. Cached
+ *  responses carry an ETag, for clients to revalidate them, and the headers
+ *  the callback set.
+ * @note the file is removed with qweb_unregister_file, the handler itself is
+ *  kept until qweb_free as requests may still be waiting on it
+ *
+ * @param fpath path to register the callback at
+ * @param handler callback and cache policy
+ */
+void qweb_register_get_cb(qweb_server_t* server, const char* fpath, qweb_get_handler_t handler);
+
+/**
+ * @brief Register a page rendered from a template on each GET request.
+ *  Its slots are filled by the callback as the page is sent in chunks, so
+ *  the page is never held whole in memory. It is sent with
+ *  "Cache-Control: no-cache" unless set otherwise, and without an ETag.
+ * @note the file is removed with qweb_unregister_file
+ *
+ * @param fpath path to register the page at
+ * @param tpl compiled template (not copied, see QWEB_TEMPLATE)
+ * @param cb slot callback, run in the httpd task
+ * @param ctx context passed to the callback
+ */
+void qweb_register_template(qweb_server_t* server, const char* fpath, const qweb_template_t* tpl, qweb_template_slot_cb_t cb, void* ctx);
+
+/**
+ * @brief Register a dynamic file whose content is replaced one whole version
+ *  at a time. Each request gets the version published when it starts, even if
+ *  newer ones are committed while it is sent. Versions are written to buffers
+ *  of a pool of QWEB_DYN_BUFFERS allocated here, a buffer is reused once no
+ *  request holds the version it had. The file is empty until the first commit.
+ * @note the handle stays valid until qweb_free, even if the path is unregistered
+ *  (commits are then not served anymore)
+ *
+ * @param fpath file path
+ * @param ctype mime type
+ * @param capacity largest content of a version
+ * @returns the file, or NULL if it could not be allocated
+ */
+qweb_dyn_t* qweb_register_dyn(qweb_server_t* server, const char* fpath, const char* ctype, size_t capacity);
+
+/**
+ * @brief Take a buffer to write the next version of a dynamic file to.
+ *  It must be given back with qweb_dyn_commit or qweb_dyn_cancel.
+ *
+ * @param capacity set to the size of the buffer (optional)
+ * @returns the buffer, or NULL if requests still hold every older version
+ *  (the update can be retried later or skipped)
+ */
+char* qweb_dyn_acquire(qweb_dyn_t* dyn, size_t* capacity);
+
+/**
+ * @brief Publish a buffer taken with qweb_dyn_acquire as the current
+ *  version, with a new ETag
+ *
+ * @param buf buffer written
+ * @param length content length
+ * @returns ESP_ERR_INVALID_SIZE if the length exceeds the buffer, which is given back
+ */
+esp_err_t qweb_dyn_commit(qweb_dyn_t* dyn, char* buf, size_t length);
+
+/**
+ * @brief Give back a buffer taken with qweb_dyn_acquire, keeping the current version
+ */
+void qweb_dyn_cancel(qweb_dyn_t* dyn, char* buf);
+
+/**
+ * @brief Copy some content into the next version of a dynamic file and publish it
+ *
+ * @returns ESP_ERR_INVALID_SIZE if it does not fit in a buffer,
+ *  ESP_ERR_INVALID_STATE if requests still hold every older version
+ */
+esp_err_t qweb_dyn_set(qweb_dyn_t* dyn, const char* content, size_t content_length);
+
+/**
+ * @brief Choose whether a file is always sent in chunks, regardless
+ *  of the server's stream_threshold. Streamed files are sent one chunk
+ *  at a time, so requests on other sockets are served in between.
+ * @note the content of a streamed file must stay valid until the transfers
+ *  in progress have finished, even after it is unregistered
+ * 
+ * @param fpath file path
+ * @param stream true to always stream the file
+ * @return ESP_ERR_NOT_FOUND if the file is not registered
+ */
+esp_err_t qweb_file_set_stream(qweb_server_t* server, const char* fpath, bool stream);
+
+/**
+ * @brief Set the Cache-Control policy of a file, overriding the server's default
+ * 
+ * @param fpath file path
+ * @param cache_control a static Cache-Control value (see QWEB_CACHE_*), or NULL for the default
+ * @return ESP_ERR_NOT_FOUND if the file is not registered
+ */
+esp_err_t qweb_file_set_cache_control(qweb_server_t* server, const char* fpath, const char* cache_control);
+
+/**
+ * @brief Turn logging of the requests to a file on or off
+ *  (the GET counterpart of supress_log)
+ * 
+ * @param fpath file path
+ * @param log false to leave the file's requests out of the logs
+ * @return ESP_ERR_NOT_FOUND if the file is not registered
+ */
+esp_err_t qweb_file_set_log(qweb_server_t* server, const char* fpath, bool log);
+
+/**
+ * @brief Attach a precompressed variant to a registered file. The variant
+ *  is sent with a Content-Encoding header to clients whose Accept-Encoding
+ *  allows it, other clients get the original content.
+ * 
+ * @param fpath file path
+ * @param encoding content coding of the variant
+ * @param content encoded file contents (NULL to remove the variant)
+ * @param content_length encoded file size
+ * @return ESP_ERR_NOT_FOUND if the file is not registered
+ */
+esp_err_t qweb_file_set_encoded(qweb_server_t* server, const char* fpath, qweb_encoding_t encoding, const char* content, size_t content_length);
+
 /**
  * @brief Register a callback for a POST request to a given path
  * 
@@ -249,8 +1080,172 @@ void qweb_file_trunc_path(qweb_server_t* server, const char* fpath, size_t lengt
  */
 void qweb_register_post_cb(qweb_server_t* server, const char* path, qweb_post_handler_t handler);
 
+/**
+ * @brief Register a streamed handler for a POST request to a given path
+ * @note shares paths with qweb_register_post_cb, and is removed with qweb_unregister_post_cb
+ * 
+ * @param path path to register
+ * @param handler streamed handler
+ */
+void qweb_register_post_stream(qweb_server_t* server, const char* path, qweb_post_stream_handler_t handler);
+
+/**
+ * @brief Register a handler for multipart/form-data uploads POSTed to a given path
+ * @note shares paths with qweb_register_post_cb, and is removed with qweb_unregister_post_cb
+ *
+ * @param path path to register
+ * @param handler form handler
+ */
+void qweb_register_post_form(qweb_server_t* server, const char* path, qweb_post_form_handler_t handler);
+
+/**
+ * @brief Register a callback for POST requests to every path matching a pattern.
+ *  Patterns are made of static text, parameters (":name", one path segment)
+ *  and an optional trailing wildcard ("*", the rest of the path), e.g:
+ *  "/api/relay/:id", or "/api/files/" followed by a wildcard. Paths registered with
+ *  qweb_register_post_cb or qweb_register_post_stream take precedence.
+ * 
+ * @param pattern route pattern (not copied, must stay valid until it is unregistered)
+ * @param handler callback
+ * @return ESP_ERR_INVALID_ARG for malformed patterns, patterns with more than
+ *  QWEB_ROUTE_MAX_PARAMS parameters (the wildcard included), or a parameter
+ *  named differently than in an existing pattern at the same position
+ */
+esp_err_t qweb_register_post_route(qweb_server_t* server, const char* pattern, qweb_post_route_handler_t handler);
+
+/**
+ * @brief Accept batches of POST calls at a path, run one after the other
+ *  by the handlers registered at their own paths, in a single request.
+ *  qweb.js coalesces the calls made in the same tick into a batch sent
+ *  to QWEB_BATCH_PATH. A batch is a sequence of calls, each made of a
+ *  header line and its data:
+ *
+ *      <path> <data length>\n<data>
+ *
+ *  answered with their results, in the same order:
+ *
+ *      <status code> <data length> <content type>\n<data>
+ *
+ *  The whole batch counts against max_recvlen. A batch calling an async
+ *  handler runs on a worker task, which hands the calls to the other
+ *  handlers back to the httpd task; a busy pool turns the batch away with 503.
+ *  The headers set by response writers are dropped.
+ *  A malformed batch is answered with 400 before any call runs.
+ * @note shares paths with qweb_register_post_cb, and is removed with qweb_unregister_post_cb
+ *
+ * @param path path to register (not copied, must stay valid)
+ */
+esp_err_t qweb_register_batch(qweb_server_t* server, const char* path);
+
+/**
+ * @brief Accept WebSocket connections on a path. Every accepted connection
+ *  subscribes to the endpoint's broadcasts until it is closed.
+ * @note needs CONFIG_HTTPD_WS_SUPPORT, messages larger than max_recvlen are refused
+ * 
+ * @param path path to register (not copied, must stay valid)
+ * @param handler connection callbacks
+ * @return ESP_ERR_NOT_SUPPORTED without WebSocket support in the httpd,
+ *  ESP_ERR_NO_MEM past QWEB_WS_MAX_ENDPOINTS endpoints
+ */
+esp_err_t qweb_register_ws(qweb_server_t* server, const char* path, qweb_ws_handler_t handler);
+
+/**
+ * @brief Send a message to one WebSocket connection.
+ *  The data is copied, this may be called from any task.
+ * 
+ * @param fd socket of the connection
+ * @param binary send a binary message instead of text
+ */
+esp_err_t qweb_ws_send(qweb_server_t* server, int fd, const char* data, size_t data_len, bool binary);
+
+/**
+ * @brief Send a message to every connection of a WebSocket endpoint.
+ *  The data is copied once, and the same frame is written to each
+ *  subscriber from the httpd task. This may be called from any task.
+ * 
+ * @param path endpoint path
+ * @param binary send a binary message instead of text
+ * @return ESP_ERR_NOT_FOUND if the endpoint is not registered
+ */
+esp_err_t qweb_ws_broadcast(qweb_server_t* server, const char* path, const char* data, size_t data_len, bool binary);
+
+/**
+ * @brief Serve the counters of every file and post handler at a path,
+ *  in the Prometheus text format: requests, errors (404, 500, oversized
+ *  content), bytes received and sent, and a latency histogram.
+ *  Requests matching nothing are counted under an empty path.
+ * @note needs CONFIG_QWEB_METRICS, without it nothing is measured
+ * 
+ * @param path path to register (not copied, must stay valid)
+ * @return ESP_ERR_NOT_SUPPORTED without CONFIG_QWEB_METRICS
+ */
+esp_err_t qweb_register_metrics(qweb_server_t* server, const char* path);
+
+/**
+ * @brief Open a Server-Sent Events channel. A GET to the path starts a
+ *  text/event-stream response that stays open, and carries every event
+ *  published to the channel. Clients reconnecting with a Last-Event-ID
+ *  first receive the events they missed, among the last QWEB_SSE_RING_LEN.
+ * @note files registered at the same path take precedence
+ * 
+ * @param path channel path (not copied, must stay valid)
+ */
+esp_err_t qweb_register_sse(qweb_server_t* server, const char* path);
+
+/**
+ * @brief Publish an event to every client of a channel.
+ *  The event is formatted once and sent from the httpd task,
+ *  this may be called from any task.
+ * 
+ * @param path channel path
+ * @param event event type, or NULL for the default ("message"), on a single line
+ * @param data event data, may span several lines
+ * @return ESP_ERR_NOT_FOUND if the channel is not registered,
+ *  ESP_ERR_INVALID_ARG if the event type contains a line break
+ */
+esp_err_t qweb_sse_publish(qweb_server_t* server, const char* path, const char* event, const char* data);
+
+/**
+ * @brief A request, as recorded by the access log
+ */
+typedef struct qweb_access_record {
+    int64_t time_us;                // esp_timer time the request arrived
+    uint32_t latency_us;            // time taken to answer it
+    uint32_t bytes_in;              // content received
+    uint32_t bytes_out;             // content sent
+    uint16_t status;                // response status code
+    uint8_t method;                 // HTTP_GET or HTTP_POST
+    char uri[QWEB_ACCESS_LOG_URI_LEN];  // request uri, truncated
+} qweb_access_record_t;
+
+/**
+ * @brief Write out an access log record, called by the access log task
+ * @param ctx context given to qweb_set_access_sink
+ */
+typedef void (*qweb_access_sink_t)(const qweb_access_record_t* record, void* ctx);
+
+/**
+ * @brief Set where the access log writes out requests. Handlers only
+ *  push a record into a ring buffer, a low priority task passes them to
+ *  the sink, QWEB_ACCESS_LOG_RATE per second at most. Records that do not
+ *  fit in the ring are dropped (see qweb_access_log_dropped).
+ * @note the sink can be changed at any time, the previous one is no
+ *  longer called once this returns
+ * 
+ * @param sink sink, or NULL for the default (ESP_LOGI)
+ * @param ctx passed to the sink
+ * @return ESP_ERR_NOT_SUPPORTED without CONFIG_QWEB_ACCESS_LOG
+ */
+esp_err_t qweb_set_access_sink(qweb_server_t* server, qweb_access_sink_t sink, void* ctx);
+
+/**
+ * @brief Requests left out of the access log because its ring was full
+ */
+uint32_t qweb_access_log_dropped(const qweb_server_t* server);
+
 esp_err_t qweb_unregister_file(qweb_server_t* server, const char* path);
 esp_err_t qweb_unregister_post_cb(qweb_server_t* server, const char* path);
+esp_err_t qweb_unregister_post_route(qweb_server_t* server, const char* pattern);
 
 /**
  * @brief Free all resources used, fully destroy
@@ -0,0 +1,221 @@
+# Build helpers provided by the qweb component.
+# ESP-IDF includes this file in the project, so the functions below
+# can be called from any component's CMakeLists.txt.
+
+set(QWEB_COMPONENT_DIR "${CMAKE_CURRENT_LIST_DIR}")
+
+# qweb_embed_files(<target> FILES <file>...)
+#
+# Embed web assets along with their ETag, computed at build time by
+# tools/qweb_etag.py. `index.html` provides `index_html` for QWEB_FILE,
+# which picks up the tag from `index_html_etag` instead of hashing the
+# content when it is registered.
+function(qweb_embed_files target)
+    cmake_parse_arguments(arg "" "" "FILES" ${ARGN})
+    idf_build_get_property(python PYTHON)
+
+    set(outdir "${CMAKE_CURRENT_BINARY_DIR}/qweb")
+    file(MAKE_DIRECTORY "${outdir}")
+
+    foreach(file ${arg_FILES})
+        get_filename_component(src "${file}" ABSOLUTE)
+        get_filename_component(name "${file}" NAME)
+        target_add_binary_data(${target} "${src}" BINARY)
+
+        set(dst "${outdir}/${name}.etag")
+        add_custom_command(OUTPUT "${dst}"
+            COMMAND ${python} "${QWEB_COMPONENT_DIR}/tools/qweb_etag.py" "${src}" "${dst}"
+            DEPENDS "${src}" "${QWEB_COMPONENT_DIR}/tools/qweb_etag.py"
+            VERBATIM)
+        target_add_binary_data(${target} "${dst}" TEXT DEPENDS "${dst}")
+
+        # QWEB_FILE only holds a weak reference to the tag,
+        # which would not pull it out of the component library
+        string(MAKE_C_IDENTIFIER "${name}.etag" symbol)
+        target_link_libraries(${target} INTERFACE "-u _binary_${symbol}_start")
+    endforeach()
+endfunction()
+
+# qweb_embed_compressed(<target> FILES <file>... [BROTLI])
+#
+# Embed web assets together with variants compressed at build time.
+# Each file is embedded as with qweb_embed_files, and a gzip (and with BROTLI, a brotli) copy
+# is generated in the build directory and embedded next to it, so that
+# `index.html` provides `index_html`, `index_html_gz` and `index_html_br`
+# for QWEB_FILE_GZ / QWEB_FILE_GZ_BR. BROTLI requires the "brotli" python
+# package in the build environment (`pip install brotli`), configuring
+# fails without it.
+#
+# example:
+#   idf_component_register(SRCS "main.c" ...)
+#   qweb_embed_compressed(${COMPONENT_LIB} FILES web/index.html web/app.js)
+function(qweb_embed_compressed target)
+    cmake_parse_arguments(arg "BROTLI" "" "FILES" ${ARGN})
+    idf_build_get_property(python PYTHON)
+
+    set(suffixes gz)
+    if(arg_BROTLI)
+        # Checked here rather than failing halfway through the build
+        execute_process(COMMAND ${python} -c "import brotli" RESULT_VARIABLE no_brotli OUTPUT_QUIET ERROR_QUIET)
+        if(no_brotli)
+            message(FATAL_ERROR "qweb: qweb_embed_compressed(BROTLI) requires the \"brotli\" python package (pip install brotli)")
+        endif()
+        list(APPEND suffixes br)
+    endif()
+
+    set(outdir "${CMAKE_CURRENT_BINARY_DIR}/qweb")
+    file(MAKE_DIRECTORY "${outdir}")
+
+    foreach(file ${arg_FILES})
+        get_filename_component(src "${file}" ABSOLUTE)
+        get_filename_component(name "${file}" NAME)
+        qweb_embed_files(${target} FILES "${src}")
+
+        foreach(suffix ${suffixes})
+            if(suffix STREQUAL "gz")
+                set(encoding gzip)
+            else()
+                set(encoding br)
+            endif()
+            set(dst "${outdir}/${name}.${suffix}")
+            add_custom_command(OUTPUT "${dst}"
+                COMMAND ${python} "${QWEB_COMPONENT_DIR}/tools/qweb_compress.py" ${encoding} "${src}" "${dst}"
+                DEPENDS "${src}" "${QWEB_COMPONENT_DIR}/tools/qweb_compress.py"
+                VERBATIM)
+            target_add_binary_data(${target} "${dst}" BINARY DEPENDS "${dst}")
+        endforeach()
+    endforeach()
+endfunction()
+
+# qweb_embed_client(<target> [BROTLI])
+#
+# Embed the qweb.js browser client shipped with the component
+# (content/qweb.min.js) as with qweb_embed_compressed.
+# Serve it with QWEB_CLIENT(server, <url>).
+function(qweb_embed_client target)
+    cmake_parse_arguments(arg "BROTLI" "" "" ${ARGN})
+    if(arg_BROTLI)
+        qweb_embed_compressed(${target} FILES "${QWEB_COMPONENT_DIR}/content/qweb.min.js" BROTLI)
+    else()
+        qweb_embed_compressed(${target} FILES "${QWEB_COMPONENT_DIR}/content/qweb.min.js")
+    endif()
+endfunction()
+
+# qweb_add_manifest(<target> NAME <name> DIR <dir>
+#                   [ROUTES <url>=<file>...] [GZIP] [CACHE_CONTROL <value>])
+#
+# Generate a constant route manifest from a directory of web assets.
+# Every file below DIR is served at "/<relative path>", index.html files
+# also at their directory, and ROUTES adds more urls for files (relative
+# to DIR). Contents, ETags and (with GZIP) gzip variants are compiled into
+# the target as const data, indexed by a minimal perfect hash, so the
+# routes take no RAM and nothing is inserted at boot.
+# Serve it with QWEB_MANIFEST(server, <name>).
+#
+# example:
+#   qweb_add_manifest(${COMPONENT_LIB} NAME ui DIR web ROUTES "/app=app.html" GZIP)
+function(qweb_add_manifest target)
+    cmake_parse_arguments(arg "GZIP" "NAME;DIR;CACHE_CONTROL" "ROUTES" ${ARGN})
+    idf_build_get_property(python PYTHON)
+
+    get_filename_component(dir "${arg_DIR}" ABSOLUTE)
+    file(GLOB_RECURSE assets CONFIGURE_DEPENDS "${dir}/*")
+
+    set(args --name ${arg_NAME} --dir "${dir}")
+    foreach(route ${arg_ROUTES})
+        list(APPEND args --route "${route}")
+    endforeach()
+    if(arg_GZIP)
+        list(APPEND args --gzip)
+    endif()
+    if(arg_CACHE_CONTROL)
+        list(APPEND args --cache-control "${arg_CACHE_CONTROL}")
+    endif()
+
+    set(output "${CMAKE_CURRENT_BINARY_DIR}/qweb/qweb_manifest_${arg_NAME}.c")
+    add_custom_command(OUTPUT "${output}"
+        COMMAND ${python} "${QWEB_COMPONENT_DIR}/tools/qweb_manifest.py" ${args} --output "${output}"
+        DEPENDS ${assets} "${QWEB_COMPONENT_DIR}/tools/qweb_manifest.py" "${QWEB_COMPONENT_DIR}/tools/qweb_etag.py"
+        VERBATIM)
+    target_sources(${target} PRIVATE "${output}")
+endfunction()
+
+# qweb_add_template(<target> NAME <name> FILE <file>)
+#
+# Compile a page template, whose {{slot}} markers are filled when the page
+# is served. The literal text between slots is compiled into the target as
+# const data, and qweb_template_<name>.h (on the target's include path)
+# numbers the slots as <NAME>_SLOT_<SLOT> for the slot callback, followed
+# by <NAME>_SLOT_COUNT.
+# Serve it with QWEB_TEMPLATE(server, <url>, <name>, <callback>, <ctx>).
+#
+# example:
+#   qweb_add_template(${COMPONENT_LIB} NAME status FILE web/status.html)
+function(qweb_add_template target)
+    cmake_parse_arguments(arg "" "NAME;FILE" "" ${ARGN})
+    idf_build_get_property(python PYTHON)
+
+    get_filename_component(src "${arg_FILE}" ABSOLUTE)
+    set(outdir "${CMAKE_CURRENT_BINARY_DIR}/qweb")
+    file(MAKE_DIRECTORY "${outdir}")
+
+    set(output "${outdir}/qweb_template_${arg_NAME}.c")
+    set(header "${outdir}/qweb_template_${arg_NAME}.h")
+    add_custom_command(OUTPUT "${output}" "${header}"
+        COMMAND ${python} "${QWEB_COMPONENT_DIR}/tools/qweb_template.py" --name ${arg_NAME} --input "${src}"
+            --output "${output}" --header "${header}"
+        DEPENDS "${src}" "${QWEB_COMPONENT_DIR}/tools/qweb_template.py" "${QWEB_COMPONENT_DIR}/tools/qweb_manifest.py"
+        VERBATIM)
+    target_sources(${target} PRIVATE "${output}" "${header}")
+    target_include_directories(${target} PRIVATE "${outdir}")
+endfunction()
+
+# qweb_add_image(<partition> DIR <dir> [ROUTES <url>=<file>...] [GZIP]
+#                [CACHE_CONTROL <value>] [FLASH_IN_PROJECT])
+#
+# Pack a directory of web assets into an image for a data partition, served
+# in place with qweb_register_partition(server, "<partition>"). Urls are the
+# same as with qweb_add_manifest, but the assets can be updated by flashing
+# the partition alone, and take no room in the app partition. The image is
+# built as qweb_<partition>.bin in the build directory, and flashed along
+# with the app by `idf.py flash` with FLASH_IN_PROJECT.
+#
+# example:
+#   qweb_add_image(www DIR web GZIP FLASH_IN_PROJECT)
+function(qweb_add_image partition)
+    cmake_parse_arguments(arg "GZIP;FLASH_IN_PROJECT" "DIR;CACHE_CONTROL" "ROUTES" ${ARGN})
+    idf_build_get_property(python PYTHON)
+    idf_build_get_property(build_dir BUILD_DIR)
+
+    partition_table_get_partition_info(size "--partition-name ${partition}" "size")
+    if("${size}" STREQUAL "")
+        message(FATAL_ERROR "qweb: no partition named ${partition} in the partition table")
+    endif()
+
+    get_filename_component(dir "${arg_DIR}" ABSOLUTE)
+    file(GLOB_RECURSE assets CONFIGURE_DEPENDS "${dir}/*")
+
+    set(args --dir "${dir}" --size ${size})
+    foreach(route ${arg_ROUTES})
+        list(APPEND args --route "${route}")
+    endforeach()
+    if(arg_GZIP)
+        list(APPEND args --gzip)
+    endif()
+    if(arg_CACHE_CONTROL)
+        list(APPEND args --cache-control "${arg_CACHE_CONTROL}")
+    endif()
+
+    set(image "${build_dir}/qweb_${partition}.bin")
+    add_custom_command(OUTPUT "${image}"
+        COMMAND ${python} "${QWEB_COMPONENT_DIR}/tools/qweb_image.py" ${args} --output "${image}"
+        DEPENDS ${assets} "${QWEB_COMPONENT_DIR}/tools/qweb_image.py"
+            "${QWEB_COMPONENT_DIR}/tools/qweb_manifest.py" "${QWEB_COMPONENT_DIR}/tools/qweb_etag.py"
+        VERBATIM)
+    add_custom_target(qweb_${partition}_bin ALL DEPENDS "${image}")
+
+    if(arg_FLASH_IN_PROJECT)
+        esptool_py_flash_to_partition(flash "${partition}" "${image}")
+        add_dependencies(flash qweb_${partition}_bin)
+    endif()
+endfunction()
@@ -0,0 +1,191 @@
+#include <string.h>
+#include <inttypes.h>
+#include "qweb-access-log.h"
+
+#ifdef CONFIG_QWEB_ACCESS_LOG
+
+#include <stdatomic.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+_Static_assert((QWEB_ACCESS_LOG_RING & (QWEB_ACCESS_LOG_RING - 1)) == 0, "QWEB_ACCESS_LOG_RING must be a power of two");
+
+// Below the httpd task and the async workers
+#define ACCESS_LOG_PRIORITY     (1)
+#define ACCESS_LOG_STACK        (3072)
+
+// The task wakes up this often, and writes out QWEB_ACCESS_LOG_RATE records per second at most
+#define ACCESS_LOG_PERIOD_MS    (100)
+#define ACCESS_LOG_BUDGET       ((QWEB_ACCESS_LOG_RATE * ACCESS_LOG_PERIOD_MS + 999) / 1000)
+
+static const char* TAG = "qweb-access";
+
+/**
+ * @brief A slot of the ring. Its sequence number tells whose turn it is:
+ *  it equals the position for the producer claiming the slot, and the
+ *  position plus one once the record is written, for the task.
+ */
+typedef struct access_slot {
+    atomic_uint_least32_t seq;
+    qweb_access_record_t record;
+} access_slot_t;
+
+struct access_log {
+    access_slot_t ring[QWEB_ACCESS_LOG_RING];
+    atomic_uint_least32_t head;     // next position claimed by a producer
+    uint32_t tail;                  // next position read by the task
+    atomic_uint_least32_t dropped;
+    uint32_t dropped_reported;      // dropped records already warned about
+
+    // Changed together under sink_lock, which the task holds while it writes records out
+    SemaphoreHandle_t sink_lock;
+    qweb_access_sink_t sink;
+    void* sink_ctx;
+
+    atomic_bool stop;
+    SemaphoreHandle_t done;         // given by the task as it exits
+};
+
+
+static void access_log_default_sink(const qweb_access_record_t* record, void* ctx) {
+    ESP_LOGI(TAG, "%s %s %u %" PRIu32 "b %" PRIu32 "b %" PRIu32 "us",
+        record->method == HTTP_POST ? "POST" : "GET", record->uri, record->status,
+        record->bytes_in, record->bytes_out, record->latency_us);
+}
+
+/**
+ * @brief Take the oldest record, only called by the task
+ */
+static bool access_log_pop(access_log_t* log, qweb_access_record_t* record) {
+    access_slot_t* slot = &log->ring[log->tail & (QWEB_ACCESS_LOG_RING - 1)];
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != log->tail + 1) {
+        return false;
+    }
+    *record = slot->record;
+    // Hand the slot back to the producers, one lap later
+    atomic_store_explicit(&slot->seq, log->tail + QWEB_ACCESS_LOG_RING, memory_order_release);
+    log->tail++;
+    return true;
+}
+
+static void access_log_task(void* arg) {
+    access_log_t* log = (access_log_t*) arg;
+    qweb_access_record_t record;
+    for (;;) {
+        bool stop = atomic_load(&log->stop);
+
+        // Write out no more than the rate allows, the rest waits in the ring
+        xSemaphoreTake(log->sink_lock, portMAX_DELAY);
+        for (size_t i = 0; (stop || i < ACCESS_LOG_BUDGET) && access_log_pop(log, &record); i++) {
+            log->sink(&record, log->sink_ctx);
+        }
+        xSemaphoreGive(log->sink_lock);
+
+        uint32_t dropped = atomic_load_explicit(&log->dropped, memory_order_relaxed);
+        if (dropped != log->dropped_reported) {
+            ESP_LOGW(TAG, "%" PRIu32 " requests not logged, the access log is full", dropped - log->dropped_reported);
+            log->dropped_reported = dropped;
+        }
+
+        if (stop) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(ACCESS_LOG_PERIOD_MS));
+    }
+    xSemaphoreGive(log->done);
+    vTaskDelete(NULL);
+}
+
+
+access_log_t* access_log_init(void) {
+    access_log_t* log = calloc(sizeof(access_log_t), 1);
+    if (!log) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < QWEB_ACCESS_LOG_RING; i++) {
+        atomic_init(&log->ring[i].seq, i);
+    }
+    log->sink = access_log_default_sink;
+    log->sink_lock = xSemaphoreCreateMutex();
+    log->done = xSemaphoreCreateCounting(1, 0);
+    if (!log->sink_lock || !log->done ||
+        xTaskCreate(access_log_task, "qweb-access", ACCESS_LOG_STACK, log, ACCESS_LOG_PRIORITY, NULL) != pdPASS) {
+        if (log->sink_lock) {
+            vSemaphoreDelete(log->sink_lock);
+        }
+        if (log->done) {
+            vSemaphoreDelete(log->done);
+        }
+        free(log);
+        return NULL;
+    }
+    return log;
+}
+
+void access_log_free(access_log_t* log) {
+    if (!log) {
+        return;
+    }
+    atomic_store(&log->stop, true);
+    xSemaphoreTake(log->done, portMAX_DELAY);
+    vSemaphoreDelete(log->done);
+    vSemaphoreDelete(log->sink_lock);
+    free(log);
+}
+
+void access_log_set_sink(access_log_t* log, qweb_access_sink_t sink, void* ctx) {
+    // The previous sink is done with its records once this returns
+    xSemaphoreTake(log->sink_lock, portMAX_DELAY);
+    log->sink_ctx = ctx;
+    log->sink = sink ? sink : access_log_default_sink;
+    xSemaphoreGive(log->sink_lock);
+}
+
+void access_log_push(access_log_t* log, int method, const char* uri, const char* status, size_t bytes_in, size_t bytes_out, int64_t start) {
+    if (!log) {
+        return;
+    }
+
+    // Claim the slot at head, unless the task has not read it yet
+    uint32_t pos = atomic_load_explicit(&log->head, memory_order_relaxed);
+    access_slot_t* slot;
+    for (;;) {
+        slot = &log->ring[pos & (QWEB_ACCESS_LOG_RING - 1)];
+        int32_t lap = (int32_t) (atomic_load_explicit(&slot->seq, memory_order_acquire) - pos);
+        if (lap == 0) {
+            // A failed exchange reloads pos
+            if (atomic_compare_exchange_weak_explicit(&log->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (lap < 0) {
+            atomic_fetch_add_explicit(&log->dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&log->head, memory_order_relaxed);
+        }
+    }
+
+    qweb_access_record_t* record = &slot->record;
+    int64_t now = esp_timer_get_time();
+    record->time_us = start;
+    record->latency_us = (uint32_t) (now - start);
+    record->bytes_in = (uint32_t) bytes_in;
+    record->bytes_out = (uint32_t) bytes_out;
+    record->status = (status[0] - '0') * 100 + (status[1] - '0') * 10 + (status[2] - '0');
+    record->method = (uint8_t) method;
+    size_t uri_len = strnlen(uri, sizeof(record->uri) - 1);
+    memcpy(record->uri, uri, uri_len);
+    record->uri[uri_len] = '\0';
+
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+uint32_t access_log_dropped(const access_log_t* log) {
+    return atomic_load_explicit(&((access_log_t*) log)->dropped, memory_order_relaxed);
+}
+
+#endif
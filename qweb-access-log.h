@@ -0,0 +1,61 @@
+#ifndef QWEB_ACCESS_LOG_H
+#define QWEB_ACCESS_LOG_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp-qweb.h"
+
+#ifdef CONFIG_QWEB_ACCESS_LOG
+
+/**
+ * @brief Requests waiting to be written out by a low priority task.
+ *  Handlers push records without locks or blocking, records that do
+ *  not fit in the ring are dropped and counted.
+ */
+typedef struct access_log access_log_t;
+
+/**
+ * @brief Start the task writing out the records
+ * @returns the log, or NULL if it could not be started
+ */
+access_log_t* access_log_init(void);
+
+/**
+ * @brief Write out the records left and stop the task,
+ *  once nothing pushes records anymore
+ */
+void access_log_free(access_log_t* log);
+
+/**
+ * @brief Set where records are written out, NULL for the default ESP_LOGI sink.
+ *  Waits for the task to be done with the previous sink.
+ */
+void access_log_set_sink(access_log_t* log, qweb_access_sink_t sink, void* ctx);
+
+/**
+ * @brief Record a request that started at `start` (esp_timer time)
+ * @param status response status line (only its code is kept)
+ * @param uri request uri (truncated to QWEB_ACCESS_LOG_URI_LEN)
+ */
+void access_log_push(access_log_t* log, int method, const char* uri, const char* status, size_t bytes_in, size_t bytes_out, int64_t start);
+
+/**
+ * @brief Records dropped because the ring was full
+ */
+uint32_t access_log_dropped(const access_log_t* log);
+
+#define ACCESS_LOG_PUSH(log, quiet, method, uri, status, in, out, start) do {\
+        if (!(quiet)) access_log_push(log, method, uri, status, in, out, start);\
+    } while (0)
+
+#else
+
+// Without CONFIG_QWEB_ACCESS_LOG requests are logged by the handlers
+// (nothing is evaluated, the status only counts as used)
+#define ACCESS_LOG_PUSH(log, quiet, method, uri, status, in, out, start)   ((void) (status))
+
+#endif
+
+#endif
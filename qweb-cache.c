@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <string.h>
+#include "qweb-cache.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_idf_version.h"
+
+static const char* TAG = "qweb-cache";
+
+// Requests can only wait once they can be handed off from their handler,
+// before that the httpd task generates the responses and nothing runs meanwhile
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 2, 0)
+#define CACHE_CAN_WAIT
+#endif
+
+struct cache {
+    SemaphoreHandle_t lock;
+    int64_t ttl;                    // in microseconds
+    cache_resp_t* resp;             // latest response, NULL for none
+    char* pending;                  // uri being generated, NULL for none
+    size_t waiter_count;
+    cache_waiter_t waiters[CACHE_WAITERS_MAX];
+};
+
+
+cache_t* cache_init(uint32_t ttl_ms) {
+    cache_t* cache = (cache_t*) malloc(sizeof(cache_t));
+    if (!cache) {
+        return NULL;
+    }
+    cache->lock = xSemaphoreCreateMutex();
+    if (!cache->lock) {
+        free(cache);
+        return NULL;
+    }
+    cache->ttl = (int64_t) ttl_ms * 1000;
+    cache->resp = NULL;
+    cache->pending = NULL;
+    cache->waiter_count = 0;
+    return cache;
+}
+
+void cache_free(cache_t* cache) {
+    if (!cache) {
+        return;
+    }
+    cache_release(cache->resp);
+    free(cache->pending);
+    vSemaphoreDelete(cache->lock);
+    free(cache);
+}
+
+cache_result_t cache_lookup(cache_t* cache, httpd_req_t* req, int64_t start, cache_resp_t** resp) {
+    cache_result_t result;
+    xSemaphoreTake(cache->lock, portMAX_DELAY);
+    cache_resp_t* cur = cache->resp;
+    if (cur && esp_timer_get_time() < cur->expires && strcmp(cur->uri, req->uri) == 0) {
+        cache_retain(cur);
+        *resp = cur;
+        result = CACHE_HIT;
+    } else if (!cache->pending) {
+        // This request generates it, the same uri waits meanwhile
+        cache->pending = strdup(req->uri);
+        result = cache->pending ? CACHE_FILL : CACHE_BYPASS;
+    } else if (strcmp(cache->pending, req->uri) != 0) {
+        result = CACHE_BYPASS;
+#ifdef CACHE_CAN_WAIT
+    } else if (cache->waiter_count < CACHE_WAITERS_MAX &&
+        httpd_req_async_handler_begin(req, &cache->waiters[cache->waiter_count].req) == ESP_OK) {
+        cache->waiters[cache->waiter_count++].start = start;
+        result = CACHE_WAIT;
+#endif
+    } else {
+        result = CACHE_BUSY;
+    }
+    xSemaphoreGive(cache->lock);
+    return result;
+}
+
+cache_resp_t* cache_done(cache_t* cache, char* data, size_t length, const char* type, const char* status,
+    const char* hdrs, size_t hdrs_len, const char* etag, cache_waiter_t* waiters, size_t* count) {
+    cache_resp_t* resp = NULL;
+    if (data) {
+        // The strings of the callback may be gone by the next request
+        size_t type_size = strlen(type) + 1;
+        size_t status_size = strlen(status) + 1;
+        resp = (cache_resp_t*) malloc(sizeof(cache_resp_t) + type_size + status_size + hdrs_len);
+        if (resp) {
+            // One reference for the cache, one for the caller
+            atomic_init(&resp->refs, 2);
+            resp->data = data;
+            resp->length = length;
+            resp->type = memcpy(resp->strings, type, type_size);
+            resp->status = memcpy(resp->strings + type_size, status, status_size);
+            resp->hdrs = hdrs_len ? memcpy(resp->strings + type_size + status_size, hdrs, hdrs_len) : NULL;
+            resp->hdrs_len = hdrs_len;
+            resp->expires = esp_timer_get_time() + cache->ttl;
+            snprintf(resp->etag, CACHE_ETAG_SIZE, "%s", etag);
+        } else {
+            ESP_LOGE(TAG, "Could not keep a response of %ub", length);
+            free(data);
+        }
+    }
+
+    xSemaphoreTake(cache->lock, portMAX_DELAY);
+    cache_resp_t* old = NULL;
+    if (resp) {
+        resp->uri = cache->pending;
+        old = cache->resp;
+        cache->resp = resp;
+    } else {
+        free(cache->pending);
+    }
+    cache->pending = NULL;
+    memcpy(waiters, cache->waiters, cache->waiter_count * sizeof(cache_waiter_t));
+    *count = cache->waiter_count;
+    cache->waiter_count = 0;
+    xSemaphoreGive(cache->lock);
+
+    // Requests still sending the previous response keep it until they are done
+    cache_release(old);
+    return resp;
+}
+
+void cache_retain(cache_resp_t* resp) {
+    atomic_fetch_add(&resp->refs, 1);
+}
+
+void cache_release(cache_resp_t* resp) {
+    if (resp && atomic_fetch_sub(&resp->refs, 1) == 1) {
+        free(resp->uri);
+        free(resp->data);
+        free(resp);
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef QWEB_CACHE_H
+#define QWEB_CACHE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "esp_http_server.h"
+#include "esp-qweb.h"
+
+// Quoted 64-bit hex entity tag, with terminator (as the file entries')
+#define CACHE_ETAG_SIZE     (19)
+
+// Requests that can wait for a response being generated, per cache
+#define CACHE_WAITERS_MAX   (8)
+
+/**
+ * @brief The responses of a GET callback, kept for a while. It holds one
+ *  response at a time, for the uri (query included) it was generated for.
+ *  While it is generated, requests for the same uri are handed off to wait
+ *  for it rather than run the callback again (single-flight).
+ */
+typedef struct cache cache_t;
+
+/**
+ * @brief A response kept by a cache, shared by the requests it answers
+ */
+typedef struct cache_resp {
+    atomic_uint refs;               // one for being the cache's response, one per request sending it
+    char* uri;                      // uri it was generated for
+    char* data;
+    size_t length;
+    const char* type;               // content type set by the callback, copied into strings
+    const char* status;             // status set by the callback, copied into strings
+    const char* hdrs;               // headers set by the callback, "field\0value\0" pairs in strings
+    size_t hdrs_len;
+    int64_t expires;                // time (esp_timer_get_time) it goes stale
+    char etag[CACHE_ETAG_SIZE];
+    char strings[];
+} cache_resp_t;
+
+/**
+ * @brief A request handed off to wait for a response
+ */
+typedef struct cache_waiter {
+    httpd_req_t* req;               // async copy of the request, to complete once answered
+    int64_t start;                  // arrival time, for the metrics and the access log
+} cache_waiter_t;
+
+typedef enum cache_result {
+    CACHE_HIT,                      // a fresh response was found, release it once sent
+    CACHE_FILL,                     // the caller generates the response, then calls cache_done
+    CACHE_WAIT,                     // the request was handed off, it is answered after cache_done
+    CACHE_BYPASS,                   // another uri is being generated, the caller runs the callback without caching
+    CACHE_BUSY                      // too many requests wait already, the caller turns this one away
+} cache_result_t;
+
+/**
+ * @brief Allocate an empty cache
+ * @param ttl_ms how long responses are served once generated
+ */
+cache_t* cache_init(uint32_t ttl_ms);
+
+void cache_free(cache_t* cache);
+
+/**
+ * @brief Look for the response to a request
+ * @param start arrival time of the request, kept if it waits
+ * @param resp set to the response found, with a reference for the caller
+ */
+cache_result_t cache_lookup(cache_t* cache, httpd_req_t* req, int64_t start, cache_resp_t** resp);
+
+/**
+ * @brief Store the response generated after CACHE_FILL, and take the
+ *  requests waiting for it. Nothing is stored if generating it failed,
+ *  the next request generates it again.
+ * @param data heap buffer holding the response, taken over (NULL if generating it failed)
+ * @param type content type, copied as the callback's string may not outlive it
+ * @param status status line, copied likewise
+ * @param hdrs headers, "field\0value\0" pairs copied likewise (NULL for none)
+ * @param waiters set to the waiting requests (CACHE_WAITERS_MAX), to answer and complete
+ * @param count set to the number of waiters
+ * @returns the response with a reference for the caller, NULL if nothing was stored
+ */
+cache_resp_t* cache_done(cache_t* cache, char* data, size_t length, const char* type, const char* status,
+    const char* hdrs, size_t hdrs_len, const char* etag, cache_waiter_t* waiters, size_t* count);
+
+/**
+ * @brief Take another reference to a response already held
+ */
+void cache_retain(cache_resp_t* resp);
+
+/**
+ * @brief Drop a reference (nothing for NULL), the last one frees the response
+ */
+void cache_release(cache_resp_t* resp);
+
+#endif
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include "qweb-dyn.h"
+
+#include "esp_log.h"
+
+static const char* TAG = "qweb-dyn";
+
+struct dyn_buf {
+    /**
+     * One reference for being the current version or being filled by a writer,
+     * one per reader. A buffer without references is free for writers.
+     */
+    atomic_uint refs;
+    size_t length;                  // content length of the version held
+    char etag[DYN_ETAG_SIZE];
+    alignas(max_align_t) char data[];
+};
+
+struct qweb_dyn {
+    qweb_dyn_t* next;
+    size_t capacity;                // of each buffer
+    _Atomic(dyn_buf_t*) current;    // version served to new readers
+    dyn_buf_t* bufs[QWEB_DYN_BUFFERS];
+};
+
+static dyn_buf_t* dyn_buf_of(char* data) {
+    return (dyn_buf_t*) (data - offsetof(dyn_buf_t, data));
+}
+
+
+qweb_dyn_t* dyn_init(size_t capacity, const char* etag, qweb_dyn_t* next) {
+    // The buffers are allocated once, after the file
+    size_t stride = (sizeof(dyn_buf_t) + capacity + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+    size_t head = (sizeof(qweb_dyn_t) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+    qweb_dyn_t* dyn = (qweb_dyn_t*) malloc(head + QWEB_DYN_BUFFERS * stride);
+    if (!dyn) {
+        ESP_LOGE(TAG, "Could not allocate %u buffers of %ub", QWEB_DYN_BUFFERS, capacity);
+        return NULL;
+    }
+    dyn->next = next;
+    dyn->capacity = capacity;
+    for (size_t i = 0; i < QWEB_DYN_BUFFERS; i++) {
+        dyn_buf_t* buf = (dyn_buf_t*) ((char*) dyn + head + i * stride);
+        atomic_init(&buf->refs, 0);
+        buf->length = 0;
+        buf->etag[0] = '\0';
+        dyn->bufs[i] = buf;
+    }
+
+    // An empty version until the first commit
+    atomic_init(&dyn->bufs[0]->refs, 1);
+    snprintf(dyn->bufs[0]->etag, DYN_ETAG_SIZE, "%s", etag);
+    atomic_init(&dyn->current, dyn->bufs[0]);
+    return dyn;
+}
+
+void dyn_free(qweb_dyn_t* dyn) {
+    while (dyn) {
+        qweb_dyn_t* next = dyn->next;
+        free(dyn);
+        dyn = next;
+    }
+}
+
+size_t dyn_capacity(const qweb_dyn_t* dyn) {
+    return dyn->capacity;
+}
+
+char* dyn_acquire(qweb_dyn_t* dyn) {
+    for (size_t i = 0; i < QWEB_DYN_BUFFERS; i++) {
+        unsigned free_refs = 0;
+        if (atomic_compare_exchange_strong(&dyn->bufs[i]->refs, &free_refs, 1)) {
+            return dyn->bufs[i]->data;
+        }
+    }
+    // Readers still hold every older version, slow clients most likely
+    return NULL;
+}
+
+void dyn_publish(qweb_dyn_t* dyn, char* data, size_t length, const char* etag) {
+    dyn_buf_t* buf = dyn_buf_of(data);
+    buf->length = length;
+    snprintf(buf->etag, DYN_ETAG_SIZE, "%s", etag);
+
+    // The writer's reference becomes the current one, the previous version loses its own
+    dyn_release(atomic_exchange(&dyn->current, buf));
+}
+
+void dyn_cancel(qweb_dyn_t* dyn, char* data) {
+    dyn_release(dyn_buf_of(data));
+}
+
+dyn_buf_t* dyn_read(qweb_dyn_t* dyn) {
+    for (;;) {
+        dyn_buf_t* buf = atomic_load(&dyn->current);
+        atomic_fetch_add(&buf->refs, 1);
+        // Replaced in between, the buffer may have been recycled already
+        if (atomic_load(&dyn->current) == buf) {
+            return buf;
+        }
+        dyn_release(buf);
+    }
+}
+
+void dyn_retain(dyn_buf_t* buf) {
+    atomic_fetch_add(&buf->refs, 1);
+}
+
+void dyn_release(dyn_buf_t* buf) {
+    if (buf) {
+        atomic_fetch_sub(&buf->refs, 1);
+    }
+}
+
+const char* dyn_buf_data(const dyn_buf_t* buf) {
+    return buf->data;
+}
+
+size_t dyn_buf_length(const dyn_buf_t* buf) {
+    return buf->length;
+}
+
+const char* dyn_buf_etag(const dyn_buf_t* buf) {
+    return buf->etag;
+}
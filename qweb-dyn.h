@@ -0,0 +1,69 @@
+#ifndef QWEB_DYN_H
+#define QWEB_DYN_H
+
+#include <stdlib.h>
+#include "esp-qweb.h"
+
+// Quoted 64-bit hex entity tag, with terminator (as the file entries')
+#define DYN_ETAG_SIZE       (19)
+
+/**
+ * @brief A buffer of a dynamic file, holding one version of its content
+ */
+typedef struct dyn_buf dyn_buf_t;
+
+/**
+ * @brief Allocate a dynamic file with QWEB_DYN_BUFFERS buffers of `capacity` bytes,
+ *  publishing an empty version
+ * @param etag entity tag of the empty version
+ * @param next dynamic file linked after this one (freed along with it)
+ */
+qweb_dyn_t* dyn_init(size_t capacity, const char* etag, qweb_dyn_t* next);
+
+/**
+ * @brief Free a list of dynamic files, once no request uses them
+ */
+void dyn_free(qweb_dyn_t* dyn);
+
+/**
+ * @brief Size of each buffer
+ */
+size_t dyn_capacity(const qweb_dyn_t* dyn);
+
+/**
+ * @brief Take a buffer no reader holds, for a writer to fill
+ * @returns its data, or NULL if every buffer is in use
+ */
+char* dyn_acquire(qweb_dyn_t* dyn);
+
+/**
+ * @brief Publish a buffer taken with dyn_acquire as the current version,
+ *  the previous one is recycled once its readers are done
+ */
+void dyn_publish(qweb_dyn_t* dyn, char* data, size_t length, const char* etag);
+
+/**
+ * @brief Give back a buffer taken with dyn_acquire without publishing it
+ */
+void dyn_cancel(qweb_dyn_t* dyn, char* data);
+
+/**
+ * @brief Take a reference to the current version, for a reader
+ */
+dyn_buf_t* dyn_read(qweb_dyn_t* dyn);
+
+/**
+ * @brief Take another reference to a version already held
+ */
+void dyn_retain(dyn_buf_t* buf);
+
+/**
+ * @brief Drop a reference (nothing for NULL)
+ */
+void dyn_release(dyn_buf_t* buf);
+
+const char* dyn_buf_data(const dyn_buf_t* buf);
+size_t dyn_buf_length(const dyn_buf_t* buf);
+const char* dyn_buf_etag(const dyn_buf_t* buf);
+
+#endif
@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "qweb-form.h"
+
+#include "esp_log.h"
+
+static const char* TAG = "qweb-form";
+
+// The boundary preceded by a line break and two dashes, with terminator
+#define FORM_DELIM_MAX      (FORM_BOUNDARY_MAX + 5)
+
+typedef enum form_state {
+    FORM_PREAMBLE,                  // before the first delimiter, ignored
+    FORM_DELIM,                     // rest of a delimiter line
+    FORM_HEADERS,                   // headers of a part
+    FORM_DATA,                      // data of a part
+    FORM_DONE                       // after the closing delimiter, ignored
+} form_state_t;
+
+struct form_parser {
+    const qweb_post_form_handler_t* handler;
+    form_state_t state;
+    size_t delim_len;
+    size_t match;                   // delimiter bytes ending the data so far, held back
+    size_t dashes;                  // dashes after a delimiter, two close the body
+    size_t line_len;
+    char delim[FORM_DELIM_MAX];
+    uint8_t shift[256];             // Horspool shift for the last byte of a window
+    char line[FORM_LINE_MAX];       // header line being received
+    char name[FORM_FIELD_MAX];
+    char filename[FORM_FIELD_MAX];
+    char type[FORM_FIELD_MAX];
+    bool has_filename: 1;
+    bool has_type: 1;
+};
+
+
+/**
+ * @brief Read a parameter value, quoted or not. Quoted strings are taken
+ *  as browsers write them, with quotes in file names percent-encoded.
+ * @param out set to the value, cut to out_size, NULL to skip it
+ * @returns the position after the value
+ */
+static const char* form_value(const char* pos, char* out, size_t out_size) {
+    size_t len = 0;
+    bool quoted = *pos == '"';
+    for (pos += quoted; *pos; pos++) {
+        if (quoted ? *pos == '"' : (*pos == ';' || *pos == ' ' || *pos == '\t')) {
+            break;
+        }
+        if (out && len + 1 < out_size) {
+            out[len++] = *pos;
+        }
+    }
+    if (out) {
+        out[len] = '\0';
+    }
+    return quoted && *pos ? pos + 1 : pos;
+}
+
+/**
+ * @brief Find a parameter of a header value, such as name in `form-data; name="file"`
+ * @param out set to the value if found
+ * @returns true if the parameter is there
+ */
+static bool form_param(const char* value, const char* key, char* out, size_t out_size) {
+    size_t key_len = strlen(key);
+    const char* pos = value;
+    for (;;) {
+        // Parameters follow a ';', which quoted values may contain
+        while (*pos && *pos != ';') {
+            pos = *pos == '"' ? form_value(pos, NULL, 0) : pos + 1;
+        }
+        if (!*pos) {
+            return false;
+        }
+        pos++;
+        pos += strspn(pos, " \t");
+        bool match = strncasecmp(pos, key, key_len) == 0 && pos[key_len] == '=';
+        pos += strcspn(pos, "=;");
+        if (*pos == '=') {
+            pos = form_value(pos + 1, match ? out : NULL, out_size);
+            if (match) {
+                return true;
+            }
+        }
+    }
+}
+
+esp_err_t form_init(form_parser_t** form, const char* content_type, const qweb_post_form_handler_t* handler) {
+    char boundary[FORM_BOUNDARY_MAX + 2];
+    if (strncasecmp(content_type, "multipart/", 10) != 0 || !form_param(content_type, "boundary", boundary, sizeof(boundary))) {
+        ESP_LOGE(TAG, "No multipart boundary in content type \"%s\"", content_type);
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t boundary_len = strlen(boundary);
+    if (boundary_len == 0 || boundary_len > FORM_BOUNDARY_MAX || strcspn(boundary, "\r\n") != boundary_len) {
+        ESP_LOGE(TAG, "Invalid multipart boundary \"%s\"", boundary);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    form_parser_t* p = (form_parser_t*) malloc(sizeof(form_parser_t));
+    if (!p) {
+        return ESP_ERR_NO_MEM;
+    }
+    p->handler = handler;
+    p->state = FORM_PREAMBLE;
+    p->delim_len = boundary_len + 4;
+    memcpy(p->delim, "\r\n--", 4);
+    memcpy(p->delim + 4, boundary, boundary_len + 1);
+    // The body may start with the first delimiter, without the line break
+    p->match = 2;
+    p->dashes = 0;
+    p->line_len = 0;
+
+    for (size_t c = 0; c < 256; c++) {
+        p->shift[c] = p->delim_len;
+    }
+    for (size_t i = 0; i + 1 < p->delim_len; i++) {
+        p->shift[(uint8_t) p->delim[i]] = p->delim_len - 1 - i;
+    }
+
+    *form = p;
+    return ESP_OK;
+}
+
+void form_free(form_parser_t* form) {
+    free(form);
+}
+
+/**
+ * @brief Search for the delimiter in a piece of data (Boyer-Moore-Horspool)
+ * @returns its position, or the position of its start cut by the end of
+ *  the piece, or len if neither is there
+ */
+static size_t form_find(const form_parser_t* form, const char* data, size_t len) {
+    const size_t m = form->delim_len;
+    const char last = form->delim[m - 1];
+    for (size_t i = 0; i + m <= len; i += form->shift[(uint8_t) data[i + m - 1]]) {
+        if (data[i + m - 1] == last && memcmp(data + i, form->delim, m - 1) == 0) {
+            return i;
+        }
+    }
+
+    // The boundary has no CR, only the line break can start a delimiter
+    size_t start = len >= m ? len - m + 1 : 0;
+    for (const char* cr = memchr(data + start, '\r', len - start); cr; cr = memchr(cr + 1, '\r', data + len - cr - 1)) {
+        if (memcmp(cr, form->delim, data + len - cr) == 0) {
+            return cr - data;
+        }
+    }
+    return len;
+}
+
+/**
+ * @brief Pass data of the current part to the handler, the preamble is dropped
+ */
+static esp_err_t form_emit(form_parser_t* form, void* ctx, const char* data, size_t len) {
+    if (form->state != FORM_DATA || !len || !form->handler->data) {
+        return ESP_OK;
+    }
+    return form->handler->data(ctx, data, len);
+}
+
+static esp_err_t form_delimiter(form_parser_t* form, void* ctx) {
+    esp_err_t err = ESP_OK;
+    if (form->state == FORM_DATA && form->handler->part_end) {
+        err = form->handler->part_end(ctx);
+    }
+    form->state = FORM_DELIM;
+    form->dashes = 0;
+    return err;
+}
+
+/**
+ * @brief Pass on the data before the next delimiter
+ * @param used set to the amount of data consumed, at least one byte
+ */
+static esp_err_t form_body(form_parser_t* form, void* ctx, const char* data, size_t len, size_t* used) {
+    esp_err_t err;
+
+    // Resume a delimiter cut by the end of the previous piece
+    if (form->match) {
+        size_t want = form->delim_len - form->match;
+        size_t n = want < len ? want : len;
+        if (memcmp(data, form->delim + form->match, n) == 0) {
+            form->match += n;
+            *used = n;
+            if (form->match < form->delim_len) {
+                return ESP_OK;
+            }
+            form->match = 0;
+            return form_delimiter(form, ctx);
+        }
+        // It was data after all, and no other delimiter starts within it
+        if ((err = form_emit(form, ctx, form->delim, form->match)) != ESP_OK) {
+            return err;
+        }
+        form->match = 0;
+    }
+
+    size_t pos = form_find(form, data, len);
+    if ((err = form_emit(form, ctx, data, pos)) != ESP_OK) {
+        return err;
+    }
+    if (len - pos >= form->delim_len) {
+        *used = pos + form->delim_len;
+        return form_delimiter(form, ctx);
+    }
+    // The start of a delimiter is held back until the next piece tells
+    form->match = len - pos;
+    *used = len;
+    return ESP_OK;
+}
+
+/**
+ * @brief Rest of a delimiter line: "--" closes the body, otherwise the
+ *  headers of a part follow the line break (after optional padding)
+ */
+static esp_err_t form_delim_char(form_parser_t* form, char c) {
+    if (c == '-') {
+        if (++form->dashes == 2) {
+            form->state = FORM_DONE;
+        }
+        return ESP_OK;
+    }
+    if (form->dashes || (c != ' ' && c != '\t' && c != '\r' && c != '\n')) {
+        ESP_LOGE(TAG, "Malformed multipart delimiter");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (c == '\n') {
+        form->state = FORM_HEADERS;
+        form->line_len = 0;
+        form->name[0] = '\0';
+        form->has_filename = false;
+        form->has_type = false;
+    }
+    return ESP_OK;
+}
+
+static void form_header(form_parser_t* form) {
+    const char* line = form->line;
+    if (strncasecmp(line, "Content-Disposition:", 20) == 0) {
+        form_param(line, "name", form->name, FORM_FIELD_MAX);
+        form->has_filename = form_param(line, "filename", form->filename, FORM_FIELD_MAX);
+    } else if (strncasecmp(line, "Content-Type:", 13) == 0) {
+        snprintf(form->type, FORM_FIELD_MAX, "%s", line + 13 + strspn(line + 13, " \t"));
+        form->has_type = true;
+    }
+}
+
+static esp_err_t form_header_char(form_parser_t* form, void* ctx, char c) {
+    if (c != '\n') {
+        if (form->line_len + 1 < FORM_LINE_MAX) {
+            form->line[form->line_len++] = c;
+        }
+        return ESP_OK;
+    }
+
+    size_t len = form->line_len;
+    if (len && form->line[len - 1] == '\r') {
+        len--;
+    }
+    form->line[len] = '\0';
+    form->line_len = 0;
+    if (len) {
+        form_header(form);
+        return ESP_OK;
+    }
+
+    // A blank line ends the headers, the data follows
+    form->state = FORM_DATA;
+    if (!form->handler->part) {
+        return ESP_OK;
+    }
+    qweb_form_part_t part = {
+        .name = form->name,
+        .filename = form->has_filename ? form->filename : NULL,
+        .type = form->has_type ? form->type : NULL
+    };
+    return form->handler->part(ctx, &part);
+}
+
+esp_err_t form_feed(form_parser_t* form, void* ctx, const char* data, size_t len) {
+    esp_err_t err = ESP_OK;
+    while (len && err == ESP_OK) {
+        size_t used = 1;
+        switch (form->state) {
+        case FORM_PREAMBLE:
+        case FORM_DATA:
+            err = form_body(form, ctx, data, len, &used);
+            break;
+        case FORM_DELIM:
+            err = form_delim_char(form, *data);
+            break;
+        case FORM_HEADERS:
+            err = form_header_char(form, ctx, *data);
+            break;
+        case FORM_DONE:
+            // Epilogue
+            used = len;
+            break;
+        }
+        data += used;
+        len -= used;
+    }
+    return err;
+}
+
+esp_err_t form_finish(const form_parser_t* form) {
+    if (form->state != FORM_DONE) {
+        ESP_LOGE(TAG, "Multipart body ended before its closing delimiter");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
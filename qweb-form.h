@@ -0,0 +1,47 @@
+#ifndef QWEB_FORM_H
+#define QWEB_FORM_H
+
+#include <stdlib.h>
+#include "esp_err.h"
+#include "esp-qweb.h"
+
+// Longest boundary allowed by RFC 2046
+#define FORM_BOUNDARY_MAX   (70)
+
+// Part header lines are kept up to this length, the rest is ignored
+#define FORM_LINE_MAX       (256)
+
+// Size of the name, filename and type of a part, with terminator (longer values are cut)
+#define FORM_FIELD_MAX      (128)
+
+/**
+ * @brief An incremental multipart/form-data parser. It holds a header
+ *  line and the start of a delimiter cut between two pieces, never the
+ *  data of a part, which goes to the handler as it arrives.
+ */
+typedef struct form_parser form_parser_t;
+
+/**
+ * @brief Allocate a parser for a request
+ * @param content_type Content-Type header of the request, giving the boundary
+ * @param handler callbacks receiving the parts, must outlive the parser
+ * @returns ESP_ERR_INVALID_ARG if the content type is not multipart or has no usable boundary
+ */
+esp_err_t form_init(form_parser_t** form, const char* content_type, const qweb_post_form_handler_t* handler);
+
+/**
+ * @brief Parse the next piece of the request body, calling the handler for the parts in it
+ * @param ctx per-request context of the handler
+ * @returns ESP_ERR_INVALID_ARG if the body is malformed, or the first error of a callback
+ */
+esp_err_t form_feed(form_parser_t* form, void* ctx, const char* data, size_t len);
+
+/**
+ * @brief Check that the body is complete, once all of it was fed
+ * @returns ESP_ERR_INVALID_SIZE if it stops before the closing delimiter
+ */
+esp_err_t form_finish(const form_parser_t* form);
+
+void form_free(form_parser_t* form);
+
+#endif
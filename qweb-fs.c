@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "qweb-fs.h"
+
+#include "esp_log.h"
+#include "esp_partition.h"
+
+// Longest path of a file, on the filesystem or in a url
+#define FS_PATH_MAX         (256)
+
+// Buffer the files are hashed through while indexing
+#define FS_READ_BUF         (512)
+
+// Quoted 64-bit hex entity tag, with terminator
+#define FS_ETAG_SIZE        (19)
+
+static const char* TAG = "qweb-fs";
+
+/**
+ * @brief Layout of a qweb image (written by tools/qweb_image.py).
+ *  All fields are little endian, offsets are from the start of the image
+ *  and strings are NUL terminated. The header is followed by the file
+ *  table, then the strings and the contents.
+ */
+#define FS_IMAGE_MAGIC      "QWIM"
+#define FS_IMAGE_VERSION    (1)
+
+typedef struct fs_image_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t file_count;
+    uint32_t image_length;          // whole image, header included
+} fs_image_header_t;
+
+typedef struct fs_image_file {
+    uint32_t url;
+    uint32_t type;
+    uint32_t etag;
+    uint32_t cache_control;         // 0 for the server default
+    uint32_t content;
+    uint32_t content_length;
+    uint32_t gz_content;            // 0 if there is no gzip variant
+    uint32_t gz_length;
+} fs_image_file_t;
+
+struct fs_map {
+    const void* data;
+    size_t len;
+    esp_partition_mmap_handle_t handle;
+    fs_map_t* next;
+};
+
+static const struct {
+    const char* ext;
+    const char* type;
+} mime_types[] = {
+    { "html", HTTP_MIME_HTML }, { "htm", HTTP_MIME_HTML }, { "css", HTTP_MIME_CSS },
+    { "js", HTTP_MIME_JS }, { "mjs", HTTP_MIME_JS }, { "json", HTTP_MIME_JSON },
+    { "xml", HTTP_MIME_XML }, { "txt", HTTP_MIME_PLAIN }, { "png", HTTP_MIME_PNG },
+    { "jpg", HTTP_MIME_JPEG }, { "jpeg", HTTP_MIME_JPEG }, { "gif", HTTP_MIME_GIF },
+    { "bmp", HTTP_MIME_BMP }, { "svg", HTTP_MIME_SVG }, { "webp", HTTP_MIME_WEBP },
+    { "avif", HTTP_MIME_AVIF }, { "ico", HTTP_MIME_ICO }, { "pdf", HTTP_MIME_PDF },
+    { "zip", HTTP_MIME_ZIP }, { "gz", HTTP_MIME_GZIP }, { "tar", HTTP_MIME_TAR },
+    { "mp3", HTTP_MIME_MP3 }, { "wav", HTTP_MIME_WAV }, { "ogg", HTTP_MIME_OGG },
+    { "mp4", HTTP_MIME_MP4 }, { "webm", HTTP_MIME_WEBM }, { "csv", HTTP_MIME_CSV },
+    { "ttf", HTTP_MIME_TTF }, { "woff", HTTP_MIME_WOFF }, { "woff2", HTTP_MIME_WOFF2 },
+    { "wasm", HTTP_MIME_WASM },
+};
+
+
+const char* fs_mime_type(const char* name) {
+    const char* ext = strrchr(name, '.');
+    if (ext && !strchr(ext, '/')) {
+        for (size_t i = 0; i < sizeof(mime_types) / sizeof(mime_types[0]); i++) {
+            if (strcasecmp(&ext[1], mime_types[i].ext) == 0) {
+                return mime_types[i].type;
+            }
+        }
+    }
+    return HTTP_MIME_BINARY;
+}
+
+
+/////////////////////
+// Images
+/////////////////////
+
+static uint32_t fs_le32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void fs_image_header(const uint8_t* data, fs_image_header_t* header) {
+    memcpy(header->magic, data, sizeof(header->magic));
+    header->version = fs_le32(&data[4]);
+    header->file_count = fs_le32(&data[8]);
+    header->image_length = fs_le32(&data[12]);
+}
+
+/**
+ * @brief Find a string of an image
+ * @returns NULL if it is not terminated within the image
+ */
+static const char* fs_image_str(const uint8_t* image, size_t image_len, uint32_t offset) {
+    if (offset >= image_len || !memchr(&image[offset], '\0', image_len - offset)) {
+        return NULL;
+    }
+    return (const char*) &image[offset];
+}
+
+static bool fs_image_range(size_t image_len, uint32_t offset, uint32_t length) {
+    return offset <= image_len && length <= image_len - offset;
+}
+
+esp_err_t fs_image_index(const void* image, size_t image_len, fs_visit_t visit, void* ctx) {
+    const uint8_t* data = (const uint8_t*) image;
+    fs_image_header_t header;
+    if (image_len < sizeof(header)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    fs_image_header(data, &header);
+    if (memcmp(header.magic, FS_IMAGE_MAGIC, sizeof(header.magic)) != 0 || header.version != FS_IMAGE_VERSION ||
+        header.image_length < sizeof(header) || header.image_length > image_len ||
+        header.file_count > (header.image_length - sizeof(header)) / sizeof(fs_image_file_t)) {
+        ESP_LOGE(TAG, "Not a qweb image");
+        return ESP_ERR_INVALID_ARG;
+    }
+    image_len = header.image_length;
+
+    for (uint32_t i = 0; i < header.file_count; i++) {
+        const uint8_t* entry = &data[sizeof(header) + i * sizeof(fs_image_file_t)];
+        uint32_t cache_control = fs_le32(&entry[12]);
+        uint32_t gz_content = fs_le32(&entry[24]);
+        fs_file_t file = {
+            .url = fs_image_str(data, image_len, fs_le32(&entry[0])),
+            .type = fs_image_str(data, image_len, fs_le32(&entry[4])),
+            .etag = fs_image_str(data, image_len, fs_le32(&entry[8])),
+            .cache_control = cache_control ? fs_image_str(data, image_len, cache_control) : NULL,
+            .content = (const char*) &data[fs_le32(&entry[16])],
+            .content_length = fs_le32(&entry[20]),
+            .gz_content = gz_content ? (const char*) &data[gz_content] : NULL,
+            .gz_length = gz_content ? fs_le32(&entry[28]) : 0,
+            .path = NULL,
+            .gz_path = NULL
+        };
+        if (!file.url || !file.type || !file.etag || strlen(file.etag) != FS_ETAG_SIZE - 1 ||
+            (cache_control && !file.cache_control) ||
+            !fs_image_range(image_len, fs_le32(&entry[16]), file.content_length) ||
+            (gz_content && !fs_image_range(image_len, gz_content, file.gz_length))) {
+            ESP_LOGE(TAG, "Malformed file %u of the image", (unsigned) i);
+            return ESP_ERR_INVALID_ARG;
+        }
+        esp_err_t err = visit(&file, ctx);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+
+/////////////////////
+// Directories
+/////////////////////
+
+typedef struct fs_walk {
+    char path[FS_PATH_MAX];         // file being visited
+    char url[FS_PATH_MAX];          // its url
+    char gz_path[FS_PATH_MAX];      // its gzip variant
+    char buf[FS_READ_BUF];
+    fs_visit_t visit;
+    void* ctx;
+} fs_walk_t;
+
+/**
+ * @brief Compute the entity tag of a file (64-bit FNV-1a, the same as
+ *  etag_compute in esp-qweb.c and tools/qweb_etag.py)
+ */
+static bool fs_file_etag(fs_walk_t* walk, const char* path, char etag[FS_ETAG_SIZE]) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t amt;
+    while ((amt = fread(walk->buf, 1, sizeof(walk->buf), file)) > 0) {
+        for (size_t i = 0; i < amt; i++) {
+            hash ^= (uint8_t) walk->buf[i];
+            hash *= 0x100000001b3ULL;
+        }
+    }
+    bool ok = !ferror(file);
+    fclose(file);
+    snprintf(etag, FS_ETAG_SIZE, "\"%08lx%08lx\"", (unsigned long) (hash >> 32), (unsigned long) (hash & 0xffffffff));
+    return ok;
+}
+
+static bool fs_is_file(const char* path, size_t* size) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    *size = st.st_size;
+    return true;
+}
+
+/**
+ * @brief Visit a regular file, at path and url in the walk
+ */
+static esp_err_t fs_walk_file(fs_walk_t* walk, size_t path_len, size_t url_len, size_t size) {
+    // Gzip variants are attached to the file they encode
+    if (path_len > 3 && strcmp(&walk->path[path_len - 3], ".gz") == 0) {
+        walk->path[path_len - 3] = '\0';
+        size_t plain_size;
+        bool variant = fs_is_file(walk->path, &plain_size);
+        walk->path[path_len - 3] = '.';
+        if (variant) {
+            return ESP_OK;
+        }
+    }
+
+    char etag[FS_ETAG_SIZE];
+    if (!fs_file_etag(walk, walk->path, etag)) {
+        ESP_LOGW(TAG, "Could not read %s", walk->path);
+        return ESP_OK;
+    }
+
+    fs_file_t file = {
+        .url = walk->url,
+        .type = fs_mime_type(walk->path),
+        .etag = etag,
+        .cache_control = NULL,
+        .content = NULL,
+        .gz_content = NULL,
+        .path = walk->path,
+        .gz_path = NULL,
+        .content_length = size,
+        .gz_length = 0
+    };
+    if (path_len + 3 < FS_PATH_MAX) {
+        snprintf(walk->gz_path, FS_PATH_MAX, "%s.gz", walk->path);
+        if (fs_is_file(walk->gz_path, &file.gz_length)) {
+            file.gz_path = walk->gz_path;
+        }
+    }
+
+    esp_err_t err = walk->visit(&file, walk->ctx);
+
+    // Index pages are also served at their directory
+    static const char index[] = "index.html";
+    if (err == ESP_OK && url_len >= sizeof(index) - 1 &&
+        strcmp(&walk->url[url_len - (sizeof(index) - 1)], index) == 0 &&
+        (url_len == sizeof(index) - 1 || walk->url[url_len - sizeof(index)] == '/')) {
+        walk->url[url_len - (sizeof(index) - 1)] = '\0';
+        err = walk->visit(&file, walk->ctx);
+        walk->url[url_len - (sizeof(index) - 1)] = index[0];
+    }
+    return err;
+}
+
+/**
+ * @brief Visit the files below the directory at path in the walk
+ */
+static esp_err_t fs_walk_dir(fs_walk_t* walk, size_t path_len, size_t url_len) {
+    DIR* dir = opendir(walk->path);
+    if (!dir) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t err = ESP_OK;
+    struct dirent* ent;
+    while (err == ESP_OK && (ent = readdir(dir))) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+        size_t name_len = strlen(ent->d_name);
+        if (path_len + 1 + name_len >= FS_PATH_MAX || url_len + 1 + name_len >= FS_PATH_MAX) {
+            ESP_LOGW(TAG, "Skipping %s/%s, the path is too long", walk->path, ent->d_name);
+            continue;
+        }
+        walk->path[path_len] = '/';
+        memcpy(&walk->path[path_len + 1], ent->d_name, name_len + 1);
+        memcpy(&walk->url[url_len], ent->d_name, name_len + 1);
+
+        struct stat st;
+        if (stat(walk->path, &st) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            walk->url[url_len + name_len] = '/';
+            walk->url[url_len + name_len + 1] = '\0';
+            fs_walk_dir(walk, path_len + 1 + name_len, url_len + name_len + 1);
+        } else if (S_ISREG(st.st_mode)) {
+            err = fs_walk_file(walk, path_len + 1 + name_len, url_len + name_len, st.st_size);
+        }
+    }
+    walk->path[path_len] = '\0';
+    walk->url[url_len] = '\0';
+    closedir(dir);
+    return err;
+}
+
+esp_err_t fs_dir_index(const char* dir, const char* url_prefix, fs_visit_t visit, void* ctx) {
+    fs_walk_t* walk = malloc(sizeof(fs_walk_t));
+    if (!walk) {
+        return ESP_ERR_NO_MEM;
+    }
+    walk->visit = visit;
+    walk->ctx = ctx;
+
+    // Urls are "<prefix>/<relative path>", without doubled slashes
+    size_t path_len = snprintf(walk->path, FS_PATH_MAX, "%s", dir);
+    while (path_len > 1 && walk->path[path_len - 1] == '/') {
+        walk->path[--path_len] = '\0';
+    }
+    size_t url_len = snprintf(walk->url, FS_PATH_MAX, "%s", url_prefix);
+    if (url_len == 0 || walk->url[url_len - 1] != '/') {
+        walk->url[url_len++] = '/';
+        walk->url[url_len] = '\0';
+    }
+
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (path_len < FS_PATH_MAX && url_len < FS_PATH_MAX) {
+        err = fs_walk_dir(walk, path_len, url_len);
+    }
+    free(walk);
+    return err;
+}
+
+
+/////////////////////
+// Partitions
+/////////////////////
+
+fs_map_t* fs_map_partition(const char* label, fs_map_t* next) {
+    const esp_partition_t* part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (!part) {
+        ESP_LOGE(TAG, "No data partition labeled %s", label);
+        return NULL;
+    }
+
+    // Only the image is mapped, MMU pages are scarce
+    uint8_t raw[sizeof(fs_image_header_t)];
+    fs_image_header_t header;
+    if (esp_partition_read(part, 0, raw, sizeof(raw)) != ESP_OK) {
+        return NULL;
+    }
+    fs_image_header(raw, &header);
+    if (memcmp(header.magic, FS_IMAGE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.image_length < sizeof(header) || header.image_length > part->size) {
+        ESP_LOGE(TAG, "Partition %s does not hold a qweb image", label);
+        return NULL;
+    }
+
+    fs_map_t* map = malloc(sizeof(fs_map_t));
+    if (!map) {
+        return NULL;
+    }
+    esp_err_t err = esp_partition_mmap(part, 0, header.image_length, ESP_PARTITION_MMAP_DATA, &map->data, &map->handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Could not map partition %s: %s", label, esp_err_to_name(err));
+        free(map);
+        return NULL;
+    }
+    map->len = header.image_length;
+    map->next = next;
+    return map;
+}
+
+const void* fs_map_data(const fs_map_t* map, size_t* len) {
+    *len = map->len;
+    return map->data;
+}
+
+void fs_map_free(fs_map_t* map) {
+    while (map) {
+        fs_map_t* next = map->next;
+        esp_partition_munmap(map->handle);
+        free(map);
+        map = next;
+    }
+}
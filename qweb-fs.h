@@ -0,0 +1,73 @@
+#ifndef QWEB_FS_H
+#define QWEB_FS_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp-qweb.h"
+
+/**
+ * @brief A file found while indexing an image or a directory.
+ *  Image files hold their content, directory files the path to read it from.
+ *  Strings of directory files only live for the visit.
+ */
+typedef struct fs_file {
+    const char* url;                // path used to GET this file
+    const char* type;               // MIME type
+    const char* etag;               // quoted strong entity tag
+    const char* cache_control;      // Cache-Control policy, NULL for the server default
+    const char* content;            // data content (image files)
+    const char* gz_content;         // gzip encoded content (optional, image files)
+    const char* path;               // file to read the content from (directory files)
+    const char* gz_path;            // file to read the gzip encoded content from (optional, directory files)
+    size_t content_length;          // data length
+    size_t gz_length;               // gzip encoded length
+} fs_file_t;
+
+/**
+ * @brief Called for each file indexed
+ */
+typedef esp_err_t (*fs_visit_t)(const fs_file_t* file, void* ctx);
+
+/**
+ * @brief A data partition mapped into the address space
+ */
+typedef struct fs_map fs_map_t;
+
+/**
+ * @brief Index the files of a qweb image (see tools/qweb_image.py)
+ * @returns ESP_ERR_INVALID_ARG if the image is malformed
+ */
+esp_err_t fs_image_index(const void* image, size_t image_len, fs_visit_t visit, void* ctx);
+
+/**
+ * @brief Index the files below a directory, recursively
+ * @param url_prefix prepended to the path of each file relative to dir
+ * @returns ESP_ERR_NOT_FOUND if the directory cannot be opened
+ */
+esp_err_t fs_dir_index(const char* dir, const char* url_prefix, fs_visit_t visit, void* ctx);
+
+/**
+ * @brief Map a data partition
+ * @param next mapping linked after this one (freed along with it)
+ * @returns the mapping, or NULL if the partition cannot be found or mapped
+ */
+fs_map_t* fs_map_partition(const char* label, fs_map_t* next);
+
+/**
+ * @brief Where a partition is mapped
+ */
+const void* fs_map_data(const fs_map_t* map, size_t* len);
+
+/**
+ * @brief Unmap a list of partitions, once nothing refers to their content
+ */
+void fs_map_free(fs_map_t* map);
+
+/**
+ * @brief Guess the MIME type of a file from its extension
+ */
+const char* fs_mime_type(const char* name);
+
+#endif
@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <inttypes.h>
+#include "qweb-metrics.h"
+
+#ifdef CONFIG_QWEB_METRICS
+
+#include "qweb-resp.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+typedef struct metrics {
+    SemaphoreHandle_t lock;         // guards the list, not the counters
+    metrics_route_t* head;
+    metrics_route_t unmatched_get;
+    metrics_route_t unmatched_post;
+} metrics_t;
+
+static const uint32_t bucket_bounds[METRICS_BUCKETS - 1] = METRICS_BUCKET_BOUNDS;
+
+// Counters exported as-is, by offset in metrics_route_t
+static const struct {
+    const char* name;
+    const char* help;
+    size_t offset;
+} counters[] = {
+    { "qweb_requests_total", "Requests handled", offsetof(metrics_route_t, requests) },
+    { "qweb_errors_total", "Requests answered with an error", offsetof(metrics_route_t, errors) },
+    { "qweb_received_bytes_total", "Request content received", offsetof(metrics_route_t, bytes_in) },
+    { "qweb_sent_bytes_total", "Response content sent", offsetof(metrics_route_t, bytes_out) },
+};
+
+
+static uint32_t route_load(const metrics_route_t* route, size_t offset) {
+    return atomic_load_explicit((const atomic_uint_least32_t*) ((const char*) route + offset), memory_order_relaxed);
+}
+
+void metrics_clear(metrics_route_t* route, const char* method, const char* path) {
+    route->method = method;
+    route->path = path;
+    route->prev = NULL;
+    route->next = NULL;
+    atomic_init(&route->requests, 0);
+    atomic_init(&route->errors, 0);
+    atomic_init(&route->bytes_in, 0);
+    atomic_init(&route->bytes_out, 0);
+    atomic_init(&route->latency_us, 0);
+    for (size_t i = 0; i < METRICS_BUCKETS; i++) {
+        atomic_init(&route->buckets[i], 0);
+    }
+}
+
+static void route_link(metrics_t* metrics, metrics_route_t* route) {
+    route->next = metrics->head;
+    if (metrics->head) {
+        metrics->head->prev = route;
+    }
+    metrics->head = route;
+}
+
+
+metrics_t* metrics_init(void) {
+    metrics_t* metrics = calloc(sizeof(metrics_t), 1);
+    metrics->lock = xSemaphoreCreateMutex();
+    metrics_clear(&metrics->unmatched_get, "GET", "");
+    metrics_clear(&metrics->unmatched_post, "POST", "");
+    route_link(metrics, &metrics->unmatched_get);
+    route_link(metrics, &metrics->unmatched_post);
+    return metrics;
+}
+
+void metrics_free(metrics_t* metrics) {
+    vSemaphoreDelete(metrics->lock);
+    free(metrics);
+}
+
+void metrics_add(metrics_t* metrics, metrics_route_t* route, const char* method, const char* path) {
+    metrics_clear(route, method, path);
+    xSemaphoreTake(metrics->lock, portMAX_DELAY);
+    route_link(metrics, route);
+    xSemaphoreGive(metrics->lock);
+}
+
+void metrics_remove(metrics_t* metrics, metrics_route_t* route) {
+    xSemaphoreTake(metrics->lock, portMAX_DELAY);
+    if (route->prev) {
+        route->prev->next = route->next;
+    } else {
+        metrics->head = route->next;
+    }
+    if (route->next) {
+        route->next->prev = route->prev;
+    }
+    xSemaphoreGive(metrics->lock);
+}
+
+void metrics_replace(metrics_t* metrics, const metrics_route_t* old, metrics_route_t* route) {
+    // Added rather than stored, the route may already count requests of its own
+    for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+        atomic_fetch_add_explicit((atomic_uint_least32_t*) ((char*) route + counters[i].offset),
+            route_load(old, counters[i].offset), memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&route->latency_us, atomic_load_explicit(&old->latency_us, memory_order_relaxed), memory_order_relaxed);
+    for (size_t i = 0; i < METRICS_BUCKETS; i++) {
+        atomic_fetch_add_explicit(&route->buckets[i], atomic_load_explicit(&old->buckets[i], memory_order_relaxed), memory_order_relaxed);
+    }
+
+    xSemaphoreTake(metrics->lock, portMAX_DELAY);
+    route->prev = old->prev;
+    route->next = old->next;
+    if (route->prev) {
+        route->prev->next = route;
+    } else {
+        metrics->head = route;
+    }
+    if (route->next) {
+        route->next->prev = route;
+    }
+    xSemaphoreGive(metrics->lock);
+}
+
+metrics_route_t* metrics_unmatched(metrics_t* metrics, int method) {
+    return method == HTTP_POST ? &metrics->unmatched_post : &metrics->unmatched_get;
+}
+
+void metrics_record(metrics_route_t* route, int64_t start, size_t bytes_in, size_t bytes_out, bool error) {
+    uint32_t latency = (uint32_t) (esp_timer_get_time() - start);
+    size_t bucket = 0;
+    while (bucket < METRICS_BUCKETS - 1 && latency > bucket_bounds[bucket]) {
+        bucket++;
+    }
+
+    atomic_fetch_add_explicit(&route->requests, 1, memory_order_relaxed);
+    if (error) {
+        atomic_fetch_add_explicit(&route->errors, 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&route->bytes_in, bytes_in, memory_order_relaxed);
+    atomic_fetch_add_explicit(&route->bytes_out, bytes_out, memory_order_relaxed);
+    atomic_fetch_add_explicit(&route->latency_us, latency, memory_order_relaxed);
+    atomic_fetch_add_explicit(&route->buckets[bucket], 1, memory_order_relaxed);
+}
+
+/**
+ * @brief A route's counters, copied to be sent without holding the lock
+ */
+typedef struct metrics_snapshot {
+    const char* method;
+    const char* path;               // label value, escaped
+    uint32_t counters[sizeof(counters) / sizeof(counters[0])];
+    uint32_t latency_us;
+    uint32_t buckets[METRICS_BUCKETS];
+} metrics_snapshot_t;
+
+/**
+ * @brief Escape a label value as the text format requires (\\, \" and \n)
+ * @param out destination, or NULL to only measure
+ * @returns the escaped length
+ */
+static size_t metrics_escape(char* out, const char* in) {
+    size_t len = 0;
+    for (; *in; in++) {
+        char c = *in;
+        bool escaped = c == '\\' || c == '"' || c == '\n';
+        if (out) {
+            if (escaped) {
+                out[len] = '\\';
+            }
+            out[len + escaped] = c == '\n' ? 'n' : c;
+        }
+        len += 1 + escaped;
+    }
+    if (out) {
+        out[len] = '\0';
+    }
+    return len;
+}
+
+/**
+ * @brief Copy every route's counters and labels into one allocation,
+ *  the paths of routes removed meanwhile may be freed
+ * @param count set to the number of routes
+ * @returns NULL if it could not be allocated
+ */
+static metrics_snapshot_t* metrics_snapshot(metrics_t* metrics, size_t* count) {
+    xSemaphoreTake(metrics->lock, portMAX_DELAY);
+    size_t n = 0;
+    size_t chars = 0;
+    for (const metrics_route_t* route = metrics->head; route; route = route->next) {
+        n++;
+        chars += metrics_escape(NULL, route->path) + 1;
+    }
+    metrics_snapshot_t* snap = (metrics_snapshot_t*) malloc(n * sizeof(metrics_snapshot_t) + chars);
+    if (snap) {
+        char* str = (char*) &snap[n];
+        metrics_snapshot_t* out = snap;
+        for (const metrics_route_t* route = metrics->head; route; route = route->next, out++) {
+            out->method = route->method;
+            out->path = str;
+            str += metrics_escape(str, route->path) + 1;
+            for (size_t c = 0; c < sizeof(counters) / sizeof(counters[0]); c++) {
+                out->counters[c] = route_load(route, counters[c].offset);
+            }
+            out->latency_us = route_load(route, offsetof(metrics_route_t, latency_us));
+            for (size_t i = 0; i < METRICS_BUCKETS; i++) {
+                out->buckets[i] = atomic_load_explicit(&route->buckets[i], memory_order_relaxed);
+            }
+        }
+    }
+    xSemaphoreGive(metrics->lock);
+    *count = n;
+    return snap;
+}
+
+esp_err_t metrics_send(metrics_t* metrics, httpd_req_t* req) {
+    // Sending takes as long as the client does, registrations do not wait for it
+    size_t count;
+    metrics_snapshot_t* snap = metrics_snapshot(metrics, &count);
+    if (!snap) {
+        return httpd_resp_send_500(req);
+    }
+
+    char buf[QWEB_RESP_WRITER_BUF];
+    qweb_resp_writer_t writer;
+    resp_writer_init(&writer, req, buf, sizeof(buf));
+    qweb_resp_set_type(&writer, "text/plain; version=0.0.4");
+
+    for (size_t c = 0; c < sizeof(counters) / sizeof(counters[0]); c++) {
+        qweb_resp_printf(&writer, "# HELP %s %s\n# TYPE %s counter\n", counters[c].name, counters[c].help, counters[c].name);
+        for (const metrics_snapshot_t* route = snap; route < snap + count; route++) {
+            qweb_resp_printf(&writer, "%s{method=\"%s\",path=\"%s\"} %" PRIu32 "\n",
+                counters[c].name, route->method, route->path, route->counters[c]);
+        }
+    }
+
+    qweb_resp_printf(&writer, "# HELP qweb_request_duration_seconds Time spent handling requests\n"
+                              "# TYPE qweb_request_duration_seconds histogram\n");
+    for (const metrics_snapshot_t* route = snap; route < snap + count; route++) {
+        uint32_t cumulative = 0;
+        for (size_t i = 0; i < METRICS_BUCKETS; i++) {
+            cumulative += route->buckets[i];
+            if (i < METRICS_BUCKETS - 1) {
+                qweb_resp_printf(&writer, "qweb_request_duration_seconds_bucket{method=\"%s\",path=\"%s\",le=\"%g\"} %" PRIu32 "\n",
+                    route->method, route->path, bucket_bounds[i] / 1e6, cumulative);
+            } else {
+                qweb_resp_printf(&writer, "qweb_request_duration_seconds_bucket{method=\"%s\",path=\"%s\",le=\"+Inf\"} %" PRIu32 "\n",
+                    route->method, route->path, cumulative);
+            }
+        }
+        qweb_resp_printf(&writer, "qweb_request_duration_seconds_sum{method=\"%s\",path=\"%s\"} %.6f\n"
+                                  "qweb_request_duration_seconds_count{method=\"%s\",path=\"%s\"} %" PRIu32 "\n",
+            route->method, route->path, route->latency_us / 1e6,
+            route->method, route->path, cumulative);
+    }
+
+    free(snap);
+    return resp_writer_finish(&writer, ESP_OK);
+}
+
+#endif
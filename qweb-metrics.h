@@ -0,0 +1,102 @@
+#ifndef QWEB_METRICS_H
+#define QWEB_METRICS_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "esp-qweb.h"
+
+#ifdef CONFIG_QWEB_METRICS
+
+#include <stdatomic.h>
+#include "esp_timer.h"
+
+// Upper bounds of the latency histogram buckets, in microseconds (the last one is +Inf)
+#define METRICS_BUCKET_BOUNDS   { 1000, 5000, 10000, 50000, 100000, 500000, 1000000 }
+#define METRICS_BUCKETS         (8)
+
+/**
+ * @brief Counters of a file or post handler. They are updated without locks,
+ *  32-bit so that the atomics are native on every target.
+ */
+typedef struct metrics_route {
+    const char* method;             // "GET" or "POST"
+    const char* path;               // registered path or pattern
+    struct metrics_route* prev;     // exported routes
+    struct metrics_route* next;
+
+    atomic_uint_least32_t requests;
+    atomic_uint_least32_t errors;               // 404, 500, oversized content
+    atomic_uint_least32_t bytes_in;             // wraps like a counter reset
+    atomic_uint_least32_t bytes_out;
+    atomic_uint_least32_t latency_us;           // sum of latencies, wraps as well
+    atomic_uint_least32_t buckets[METRICS_BUCKETS];
+} metrics_route_t;
+
+/**
+ * @brief The routes of a server being measured
+ */
+typedef struct metrics metrics_t;
+
+metrics_t* metrics_init(void);
+void metrics_free(metrics_t* metrics);
+
+/**
+ * @brief Clear a route's counters, before any request can reach it
+ * @param path string labelling the route (not copied)
+ */
+void metrics_clear(metrics_route_t* route, const char* method, const char* path);
+
+/**
+ * @brief Clear a route's counters and export it
+ * @param path string labelling the route (not copied)
+ */
+void metrics_add(metrics_t* metrics, metrics_route_t* route, const char* method, const char* path);
+
+/**
+ * @brief Stop exporting a route, before it is freed
+ */
+void metrics_remove(metrics_t* metrics, metrics_route_t* route);
+
+/**
+ * @brief Export a route cleared by metrics_clear in place of another, adding its counters
+ *  (requests still counted on the old route afterwards are lost)
+ */
+void metrics_replace(metrics_t* metrics, const metrics_route_t* old, metrics_route_t* route);
+
+/**
+ * @brief Requests that matched nothing
+ */
+metrics_route_t* metrics_unmatched(metrics_t* metrics, int method);
+
+/**
+ * @brief Count a request that started at `start` (esp_timer time)
+ */
+void metrics_record(metrics_route_t* route, int64_t start, size_t bytes_in, size_t bytes_out, bool error);
+
+/**
+ * @brief Answer a request with every route's counters, in the Prometheus text format
+ */
+esp_err_t metrics_send(metrics_t* metrics, httpd_req_t* req);
+
+#define METRICS_RECORD(route, start, in, out, err)  metrics_record(route, start, in, out, err)
+#define METRICS_ADD(metrics, route, method, path)   metrics_add(metrics, route, method, path)
+#define METRICS_REMOVE(metrics, route)              metrics_remove(metrics, route)
+#define METRICS_CLEAR(route, method, path)          metrics_clear(route, method, path)
+#define METRICS_REPLACE(metrics, old, route)        metrics_replace(metrics, old, route)
+
+#else
+
+// Without CONFIG_QWEB_METRICS the instrumentation compiles to nothing
+// (route and counters are not evaluated, the error flag only counts as used)
+#define METRICS_RECORD(route, start, in, out, err)  ((void) (err))
+#define METRICS_ADD(metrics, route, method, path)
+#define METRICS_REMOVE(metrics, route)
+#define METRICS_CLEAR(route, method, path)
+#define METRICS_REPLACE(metrics, old, route)
+
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <errno.h>
+#include <ctype.h>
+#include "esp-qweb.h"
+
+/**
+ * @brief Value of a hex digit, -1 if it is not one
+ */
+static int params_hex(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+/**
+ * @brief Decode the percent-escapes and '+' of a key or value in place.
+ *  Malformed escapes are kept as they are.
+ * @returns the decoded length
+ */
+static size_t params_decode(char* s, size_t len) {
+    const char* in = s;
+    const char* end = s + len;
+    char* out = s;
+    for (; in < end; in++) {
+        int hi, lo;
+        if (*in == '+') {
+            *out++ = ' ';
+        } else if (*in == '%' && end - in > 2 && (hi = params_hex(in[1])) >= 0 && (lo = params_hex(in[2])) >= 0) {
+            *out++ = (char) (hi << 4 | lo);
+            in += 2;
+        } else {
+            *out++ = *in;
+        }
+    }
+    return out - s;
+}
+
+esp_err_t qweb_params_parse(qweb_params_t* params, char* data, size_t len) {
+    char* end = data + len;
+    for (char* pos = data; pos <= end;) {
+        char* amp = memchr(pos, '&', end - pos);
+        if (!amp) {
+            amp = end;
+        }
+        // Empty pieces, as in "a=1&&b=2", are no parameters
+        if (amp > pos) {
+            if (params->count == QWEB_PARAMS_MAX) {
+                return ESP_ERR_NO_MEM;
+            }
+            char* eq = memchr(pos, '=', amp - pos);
+            qweb_param_t* param = &params->params[params->count++];
+
+            // Decoding only shrinks, the terminators land on the separators at the latest
+            param->key = pos;
+            param->key_len = params_decode(pos, (eq ? eq : amp) - pos);
+            pos[param->key_len] = '\0';
+            char* value = eq ? eq + 1 : amp;
+            param->value = value;
+            param->value_len = eq ? params_decode(value, amp - value) : 0;
+            value[param->value_len] = '\0';
+        }
+        pos = amp + 1;
+    }
+    return ESP_OK;
+}
+
+const char* qweb_param(const qweb_params_t* params, const char* key, size_t* value_len) {
+    size_t key_len = strlen(key);
+    for (size_t i = 0; i < params->count; i++) {
+        const qweb_param_t* param = &params->params[i];
+        if (param->key_len == key_len && memcmp(param->key, key, key_len) == 0) {
+            if (value_len) {
+                *value_len = param->value_len;
+            }
+            return param->value;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t qweb_param_int(const qweb_params_t* params, const char* key, long* value) {
+    size_t len;
+    const char* str = qweb_param(params, key, &len);
+    if (!str) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    // strtol would skip leading spaces
+    if (!len || isspace((unsigned char) str[0])) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char* end;
+    errno = 0;
+    long result = strtol(str, &end, 10);
+    if (end != str + len || errno == ERANGE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *value = result;
+    return ESP_OK;
+}
+
+esp_err_t qweb_param_float(const qweb_params_t* params, const char* key, float* value) {
+    size_t len;
+    const char* str = qweb_param(params, key, &len);
+    if (!str) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (!len || isspace((unsigned char) str[0])) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char* end;
+    float result = strtof(str, &end);
+    if (end != str + len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *value = result;
+    return ESP_OK;
+}
+
+esp_err_t qweb_param_bool(const qweb_params_t* params, const char* key, bool* value) {
+    static const char* const truthy[] = { "", "1", "true", "on", "yes" };
+    static const char* const falsy[] = { "0", "false", "off", "no" };
+
+    size_t len;
+    const char* str = qweb_param(params, key, &len);
+    if (!str) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (len != strlen(str)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < sizeof(truthy) / sizeof(truthy[0]); i++) {
+        if (strcasecmp(str, truthy[i]) == 0) {
+            *value = true;
+            return ESP_OK;
+        }
+    }
+    for (size_t i = 0; i < sizeof(falsy) / sizeof(falsy[0]); i++) {
+        if (strcasecmp(str, falsy[i]) == 0) {
+            *value = false;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_INVALID_ARG;
+}
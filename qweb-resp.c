@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "qweb-resp.h"
+
+#include "esp_log.h"
+
+static const char* TAG = "qweb-resp";
+
+/**
+ * @brief Make room for more data in the buffer of a capturing writer
+ */
+static esp_err_t resp_writer_grow(qweb_resp_writer_t* writer, size_t len) {
+    if (writer->err != ESP_OK || writer->cap - writer->len > len) {
+        return writer->err;
+    }
+    size_t cap = writer->cap * 2 > writer->len + len ? writer->cap * 2 : writer->len + len + 1;
+    char* buf = realloc(writer->buf, cap);
+    if (!buf) {
+        return (writer->err = ESP_ERR_NO_MEM);
+    }
+    writer->buf = buf;
+    writer->cap = cap;
+    return ESP_OK;
+}
+
+/**
+ * @brief Send the pending data as a chunk
+ */
+static esp_err_t resp_writer_send(qweb_resp_writer_t* writer) {
+    if (writer->err != ESP_OK) {
+        return writer->err;
+    }
+    writer->started = true;
+    if (writer->len) {
+        writer->err = httpd_resp_send_chunk(writer->req, writer->buf, writer->len);
+        writer->sent += writer->len;
+        writer->len = 0;
+    }
+    return writer->err;
+}
+
+
+void resp_writer_init(qweb_resp_writer_t* writer, httpd_req_t* req, char* buf, size_t cap) {
+    *writer = (qweb_resp_writer_t) {
+        .req = req,
+        .buf = buf,
+        .len = 0,
+        .cap = cap,
+        .sent = 0,
+        .status = HTTPD_200,
+        .type = HTTPD_TYPE_TEXT,
+        .hdrs = NULL,
+        .hdrs_len = 0,
+        .started = false,
+        .capture = false,
+        .keep_hdrs = false,
+        .err = ESP_OK
+    };
+}
+
+esp_err_t resp_writer_init_capture(qweb_resp_writer_t* writer, httpd_req_t* req, bool keep_hdrs) {
+    char* buf = malloc(QWEB_RESP_WRITER_BUF);
+    resp_writer_init(writer, req, buf, buf ? QWEB_RESP_WRITER_BUF : 0);
+    if (!buf) {
+        return ESP_ERR_NO_MEM;
+    }
+    writer->capture = true;
+    writer->keep_hdrs = keep_hdrs;
+    return ESP_OK;
+}
+
+esp_err_t resp_writer_finish(qweb_resp_writer_t* writer, esp_err_t status) {
+    if (writer->capture) {
+        if (status != ESP_OK || writer->err != ESP_OK) {
+            writer->status = HTTPD_500;
+            writer->len = 0;
+        }
+        writer->sent = writer->len;
+        return ESP_OK;
+    }
+    if (!writer->started) {
+        if (status != ESP_OK) {
+            writer->status = HTTPD_500;
+            return httpd_resp_send_500(writer->req);
+        }
+        // Everything fit in the buffer
+        writer->sent = writer->len;
+        return httpd_resp_send(writer->req, writer->buf, writer->len);
+    }
+    if (status != ESP_OK) {
+        ESP_LOGE(TAG, "Response to %s failed after it started (%d)", writer->req->uri, status);
+    }
+    if (resp_writer_send(writer) != ESP_OK) {
+        return writer->err;
+    }
+    return httpd_resp_send_chunk(writer->req, NULL, 0);
+}
+
+
+esp_err_t qweb_resp_set_status(qweb_resp_writer_t* writer, const char* status) {
+    if (writer->started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    writer->status = status;
+    return writer->capture ? ESP_OK : httpd_resp_set_status(writer->req, status);
+}
+
+esp_err_t qweb_resp_set_type(qweb_resp_writer_t* writer, const char* type) {
+    if (writer->started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    writer->type = type;
+    return writer->capture ? ESP_OK : httpd_resp_set_type(writer->req, type);
+}
+
+esp_err_t qweb_resp_set_hdr(qweb_resp_writer_t* writer, const char* field, const char* value) {
+    if (writer->started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!writer->capture) {
+        return httpd_resp_set_hdr(writer->req, field, value);
+    }
+    if (!writer->keep_hdrs) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // Copied, the strings of the callback may not outlive it
+    size_t field_size = strlen(field) + 1;
+    size_t value_size = strlen(value) + 1;
+    char* hdrs = realloc(writer->hdrs, writer->hdrs_len + field_size + value_size);
+    if (!hdrs) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(&hdrs[writer->hdrs_len], field, field_size);
+    memcpy(&hdrs[writer->hdrs_len + field_size], value, value_size);
+    writer->hdrs = hdrs;
+    writer->hdrs_len += field_size + value_size;
+    return ESP_OK;
+}
+
+esp_err_t qweb_resp_write(qweb_resp_writer_t* writer, const char* data, size_t len) {
+    if (writer->capture) {
+        if (resp_writer_grow(writer, len) == ESP_OK) {
+            memcpy(&writer->buf[writer->len], data, len);
+            writer->len += len;
+        }
+        return writer->err;
+    }
+    while (len && writer->err == ESP_OK) {
+        // Large writes skip the buffer
+        if (writer->len == 0 && len >= writer->cap) {
+            writer->started = true;
+            writer->err = httpd_resp_send_chunk(writer->req, data, len);
+            writer->sent += len;
+            break;
+        }
+        size_t amt = writer->cap - writer->len;
+        amt = amt < len ? amt : len;
+        memcpy(&writer->buf[writer->len], data, amt);
+        writer->len += amt;
+        data += amt;
+        len -= amt;
+        if (writer->len == writer->cap) {
+            resp_writer_send(writer);
+        }
+    }
+    return writer->err;
+}
+
+esp_err_t qweb_resp_printf(qweb_resp_writer_t* writer, const char* fmt, ...) {
+    if (writer->err != ESP_OK) {
+        return writer->err;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(&writer->buf[writer->len], writer->cap - writer->len, fmt, args);
+    va_end(args);
+    if (len < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ((size_t) len < writer->cap - writer->len) {
+        writer->len += len;
+        return ESP_OK;
+    }
+
+    // A captured response grows to fit
+    if (writer->capture) {
+        if (resp_writer_grow(writer, len) == ESP_OK) {
+            va_start(args, fmt);
+            vsnprintf(&writer->buf[writer->len], writer->cap - writer->len, fmt, args);
+            va_end(args);
+            writer->len += len;
+        }
+        return writer->err;
+    }
+
+    // It did not fit, make room and format again
+    if (resp_writer_send(writer) != ESP_OK) {
+        return writer->err;
+    }
+    if ((size_t) len < writer->cap) {
+        va_start(args, fmt);
+        vsnprintf(writer->buf, writer->cap, fmt, args);
+        va_end(args);
+        writer->len = len;
+        return ESP_OK;
+    }
+
+    // Larger than the whole buffer
+    char* tmp = malloc(len + 1);
+    if (!tmp) {
+        return (writer->err = ESP_ERR_NO_MEM);
+    }
+    va_start(args, fmt);
+    vsnprintf(tmp, len + 1, fmt, args);
+    va_end(args);
+    qweb_resp_write(writer, tmp, len);
+    free(tmp);
+    return writer->err;
+}
+
+esp_err_t qweb_resp_flush(qweb_resp_writer_t* writer) {
+    return writer->capture ? writer->err : resp_writer_send(writer);
+}
+
+esp_err_t qweb_resp_write_html(qweb_resp_writer_t* writer, const char* text) {
+    while (*text && writer->err == ESP_OK) {
+        // Runs without special characters are written as they are
+        size_t run = strcspn(text, "&<>\"'");
+        if (run) {
+            qweb_resp_write(writer, text, run);
+            text += run;
+            continue;
+        }
+        const char* entity;
+        switch (*text) {
+        case '&': entity = "&amp;"; break;
+        case '<': entity = "&lt;"; break;
+        case '>': entity = "&gt;"; break;
+        case '"': entity = "&quot;"; break;
+        default: entity = "&#39;"; break;
+        }
+        qweb_resp_write(writer, entity, strlen(entity));
+        text++;
+    }
+    return writer->err;
+}
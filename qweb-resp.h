@@ -0,0 +1,58 @@
+#ifndef QWEB_RESP_H
+#define QWEB_RESP_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "esp-qweb.h"
+
+/**
+ * @brief A response being written to the client.
+ *  Data is gathered in a caller provided buffer and sent as
+ *  a chunk whenever it fills up. A capturing writer collects the
+ *  whole response in a heap buffer instead, for a call of a batch.
+ */
+struct qweb_resp_writer {
+    httpd_req_t* req;               // request to answer
+    char* buf;                      // pending data
+    size_t len;                     // pending data length
+    size_t cap;                     // buffer size
+    size_t sent;                    // data sent so far
+    const char* status;             // status line of the response
+    const char* type;               // content type of the response
+    char* hdrs;                     // captured headers, "field\0value\0" pairs (heap)
+    size_t hdrs_len;
+    bool started: 1;                // status and headers are sent, data goes out in chunks
+    bool capture: 1;                // nothing is sent, buf grows to hold the response
+    bool keep_hdrs: 1;              // a captured response keeps its headers in hdrs
+    esp_err_t err;                  // first error encountered, all writes fail after it
+};
+
+/**
+ * @brief Prepare a writer to answer a request
+ * @param buf buffer used for the data, must outlive the writer
+ * @param cap buffer size
+ */
+void resp_writer_init(qweb_resp_writer_t* writer, httpd_req_t* req, char* buf, size_t cap);
+
+/**
+ * @brief Prepare a writer collecting a response in a heap buffer (writer->buf,
+ *  freed by the caller), without sending anything. The writer is set up
+ *  even if the buffer cannot be allocated.
+ * @param req request the response is part of
+ * @param keep_hdrs copy the headers into writer->hdrs (freed by the caller),
+ *  otherwise qweb_resp_set_hdr returns ESP_ERR_NOT_SUPPORTED
+ */
+esp_err_t resp_writer_init_capture(qweb_resp_writer_t* writer, httpd_req_t* req, bool keep_hdrs);
+
+/**
+ * @brief Complete the response. A response that fit in the buffer is sent
+ *  whole (with a Content-Length), a chunked response is terminated.
+ * @param status result of the callback that wrote the response, a 500 is
+ *  sent instead if it failed before anything was sent. A captured response
+ *  is then dropped, leaving the 500 status.
+ */
+esp_err_t resp_writer_finish(qweb_resp_writer_t* writer, esp_err_t status);
+
+#endif
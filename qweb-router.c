@@ -0,0 +1,325 @@
+#include <string.h>
+#include "qweb-router.h"
+#include "static-containers.h"
+
+/**
+ * @brief A node of the radix tree. Every node is reached
+ *  by matching its label after the labels of its parents.
+ */
+typedef struct router_node {
+    const char* label;              // static text (points into text, or a child's text after a split)
+    size_t label_len;               // static text length
+
+    struct router_node** children;  // static text children, by distinct first character
+    size_t children_cnt;
+    size_t children_cap;
+
+    struct router_node* param;      // child matching a parameter segment
+    const char* param_name;         // name of that parameter (the child's text)
+    size_t param_name_len;
+
+    void* value;                    // value of the route ending here
+    void* wildcard;                 // value of the route ending here with '*'
+    char text[];                    // copy of the label, or of the parameter name
+} router_node_t;
+
+typedef struct router {
+    router_node_t root;
+} router_t;
+
+
+/**
+ * @brief Allocate a node, with a copy of text
+ * @returns the node labeled with text (or with nothing for parameters), or NULL
+ */
+static router_node_t* node_new(const char* text, size_t text_len, bool param) {
+    router_node_t* node = calloc(sizeof(router_node_t) + text_len, 1);
+    if (!node) {
+        return NULL;
+    }
+    memcpy(node->text, text, text_len);
+    node->label = node->text;
+    node->label_len = param ? 0 : text_len;
+    return node;
+}
+
+static void node_free(router_node_t* node, void (*dealloc)(void*)) {
+    STC_VEC_FOREACH(i, node->children) {
+        node_free(node->children[i], dealloc);
+        free(node->children[i]);
+    }
+    STC_VEC_FREE(node->children);
+    if (node->param) {
+        node_free(node->param, dealloc);
+        free(node->param);
+    }
+    if (dealloc && node->value) {
+        dealloc(node->value);
+    }
+    if (dealloc && node->wildcard) {
+        dealloc(node->wildcard);
+    }
+}
+
+/**
+ * @brief Walk down the static text of a pattern, splitting
+ *  or adding nodes as needed
+ * @returns the node at the end of the text
+ */
+static router_node_t* node_insert_static(router_node_t* node, const char* text, size_t len) {
+    while (len) {
+        size_t idx = STC_VEC_CNT(node->children);
+        STC_VEC_FOREACH(i, node->children) {
+            if (node->children[i]->label[0] == text[0]) {
+                idx = i;
+                break;
+            }
+        }
+
+        // Nothing shares a prefix, the rest is a new leaf
+        if (idx == STC_VEC_CNT(node->children)) {
+            router_node_t* leaf = node_new(text, len, false);
+            if (leaf) {
+                STC_VEC_PUSH(node->children, leaf);
+            }
+            return leaf;
+        }
+
+        router_node_t* child = node->children[idx];
+        size_t common = 1;
+        while (common < len && common < child->label_len && child->label[common] == text[common]) {
+            common++;
+        }
+
+        // Split the child where the text diverges
+        if (common < child->label_len) {
+            router_node_t* mid = node_new(child->label, common, false);
+            if (!mid) {
+                return NULL;
+            }
+            child->label += common;
+            child->label_len -= common;
+            STC_VEC_PUSH(mid->children, child);
+            node->children[idx] = mid;
+            child = mid;
+        }
+
+        node = child;
+        text += common;
+        len -= common;
+    }
+    return node;
+}
+
+/**
+ * @brief Check the syntax of a pattern, and that its parameters and
+ *  wildcard fit in qweb_route_params_t
+ */
+static bool pattern_valid(const char* pattern) {
+    size_t count = 0;
+    for (const char* c = pattern; *c; c++) {
+        if (*c == ':') {
+            size_t name_len = strcspn(c + 1, "/");
+            if (name_len == 0 || memchr(c + 1, '*', name_len) || memchr(c + 1, ':', name_len)) {
+                return false;
+            }
+            c += name_len;
+            count++;
+        } else if (*c == '*') {
+            // '*' only at the end
+            if (c[1]) {
+                return false;
+            }
+            count++;
+        }
+    }
+    return count <= QWEB_ROUTE_MAX_PARAMS;
+}
+
+/**
+ * @brief Find the node at the end of a valid pattern
+ * @param create add the missing nodes
+ * @param found set to the node
+ * @param wildcard set if the pattern ends with '*'
+ * @return ESP_ERR_NOT_FOUND if a node is missing (without create),
+ *  ESP_ERR_INVALID_ARG if a parameter is named differently than at the
+ *  same position, ESP_ERR_NO_MEM if a node could not be allocated
+ */
+static esp_err_t node_find_pattern(router_node_t* node, const char* pattern, bool create, router_node_t** found, bool* wildcard) {
+    *wildcard = false;
+    while (*pattern) {
+        size_t static_len = strcspn(pattern, ":*");
+        if (static_len) {
+            if (create) {
+                node = node_insert_static(node, pattern, static_len);
+                if (!node) {
+                    return ESP_ERR_NO_MEM;
+                }
+            } else {
+                // Follow the exact same labels
+                size_t left = static_len;
+                const char* text = pattern;
+                while (node && left) {
+                    router_node_t* next = NULL;
+                    STC_VEC_FOREACH(i, node->children) {
+                        router_node_t* child = node->children[i];
+                        if (child->label_len <= left && strncmp(child->label, text, child->label_len) == 0) {
+                            next = child;
+                            break;
+                        }
+                    }
+                    if (next) {
+                        text += next->label_len;
+                        left -= next->label_len;
+                    }
+                    node = next;
+                }
+                if (!node) {
+                    return ESP_ERR_NOT_FOUND;
+                }
+            }
+            pattern += static_len;
+        } else if (*pattern == ':') {
+            const char* name = pattern + 1;
+            size_t name_len = strcspn(name, "/");
+            if (!node->param) {
+                if (!create) {
+                    return ESP_ERR_NOT_FOUND;
+                }
+                node->param = node_new(name, name_len, true);
+                if (!node->param) {
+                    return ESP_ERR_NO_MEM;
+                }
+                node->param_name = node->param->text;
+                node->param_name_len = name_len;
+            } else if (node->param_name_len != name_len || strncmp(node->param_name, name, name_len) != 0) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            node = node->param;
+            pattern = name + name_len;
+        } else {
+            *wildcard = true;
+            break;
+        }
+    }
+    *found = node;
+    return ESP_OK;
+}
+
+static bool params_push(qweb_route_params_t* params, const char* name, size_t name_len, const char* value, size_t value_len) {
+    if (params->count == QWEB_ROUTE_MAX_PARAMS) {
+        return false;
+    }
+    params->params[params->count++] = (qweb_route_param_t) {
+        .name = name,
+        .name_len = name_len,
+        .value = value,
+        .value_len = value_len
+    };
+    return true;
+}
+
+static void* node_match(const router_node_t* node, const char* path, size_t len, qweb_route_params_t* params) {
+    if (len == 0 && node->value) {
+        return node->value;
+    }
+
+    if (len) {
+        STC_VEC_FOREACH(i, node->children) {
+            const router_node_t* child = node->children[i];
+            if (child->label[0] != path[0]) {
+                continue;
+            }
+            // Children have distinct first characters, only one can match
+            if (child->label_len <= len && memcmp(child->label, path, child->label_len) == 0) {
+                void* value = node_match(child, &path[child->label_len], len - child->label_len, params);
+                if (value) {
+                    return value;
+                }
+            }
+            break;
+        }
+    }
+
+    if (node->param) {
+        const char* slash = memchr(path, '/', len);
+        size_t seg_len = slash ? (size_t) (slash - path) : len;
+        if (seg_len && params_push(params, node->param_name, node->param_name_len, path, seg_len)) {
+            void* value = node_match(node->param, &path[seg_len], len - seg_len, params);
+            if (value) {
+                return value;
+            }
+            params->count--;
+        }
+    }
+
+    if (node->wildcard && params_push(params, "*", 1, path, len)) {
+        return node->wildcard;
+    }
+
+    return NULL;
+}
+
+
+router_t* router_init(void) {
+    router_t* router = calloc(sizeof(router_t), 1);
+    router->root.label = "";
+    return router;
+}
+
+esp_err_t router_insert(router_t* router, const char* pattern, void* value, void** old) {
+    if (!pattern_valid(pattern)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bool wildcard;
+    router_node_t* node;
+    esp_err_t err = node_find_pattern(&router->root, pattern, true, &node, &wildcard);
+    if (err != ESP_OK) {
+        return err;
+    }
+    void** slot = wildcard ? &node->wildcard : &node->value;
+    *old = *slot;
+    *slot = value;
+    return ESP_OK;
+}
+
+void* router_remove(router_t* router, const char* pattern) {
+    if (!pattern_valid(pattern)) {
+        return NULL;
+    }
+    bool wildcard;
+    router_node_t* node;
+    if (node_find_pattern(&router->root, pattern, false, &node, &wildcard) != ESP_OK) {
+        return NULL;
+    }
+    // Nodes stay in place, they are reused if the route comes back
+    void** slot = wildcard ? &node->wildcard : &node->value;
+    void* value = *slot;
+    *slot = NULL;
+    return value;
+}
+
+void* router_match(const router_t* router, const char* path, size_t path_len, qweb_route_params_t* params) {
+    params->count = 0;
+    return node_match(&router->root, path, path_len, params);
+}
+
+void router_free(router_t* router, void (*dealloc)(void*)) {
+    node_free(&router->root, dealloc);
+    free(router);
+}
+
+
+const char* qweb_route_param(const qweb_route_params_t* params, const char* name, size_t* value_len) {
+    size_t name_len = strlen(name);
+    for (size_t i = 0; i < params->count; i++) {
+        const qweb_route_param_t* param = &params->params[i];
+        if (param->name_len == name_len && strncmp(param->name, name, name_len) == 0) {
+            if (value_len) {
+                *value_len = param->value_len;
+            }
+            return param->value;
+        }
+    }
+    return NULL;
+}
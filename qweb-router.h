@@ -0,0 +1,60 @@
+#ifndef QWEB_ROUTER_H
+#define QWEB_ROUTER_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp-qweb.h"
+
+/**
+ * @brief A compressed radix tree of route patterns.
+ *  Patterns are made of static text, parameter segments (":name",
+ *  matching up to the next '/') and a trailing wildcard ("*", matching
+ *  the rest of the path). Lookups cost depends on the path length,
+ *  not on the number of routes. The tree keeps its own copy of the
+ *  patterns' text.
+ */
+typedef struct router router_t;
+
+/**
+ * @brief Create an empty router
+ */
+router_t* router_init(void);
+
+/**
+ * @brief Add a route
+ * 
+ * @param pattern route pattern
+ * @param value value to associate to the route
+ * @param old set to the value previously associated to the same route, or NULL
+ * @return ESP_ERR_INVALID_ARG for malformed patterns, patterns with more
+ *  than QWEB_ROUTE_MAX_PARAMS parameters and wildcard, or patterns naming a
+ *  parameter differently than an existing route at the same position,
+ *  ESP_ERR_NO_MEM if the nodes could not be allocated
+ */
+esp_err_t router_insert(router_t* router, const char* pattern, void* value, void** old);
+
+/**
+ * @brief Remove a route
+ * @returns the value associated to the route, or NULL
+ */
+void* router_remove(router_t* router, const char* pattern);
+
+/**
+ * @brief Find the route matching a path. Static text is preferred
+ *  over parameters, and parameters over wildcards.
+ * 
+ * @param path path to match (not necessarily null terminated)
+ * @param path_len path length
+ * @param params filled with slices of path for each parameter and wildcard
+ * @returns the value associated to the matching route, or NULL
+ */
+void* router_match(const router_t* router, const char* path, size_t path_len, qweb_route_params_t* params);
+
+/**
+ * @brief Free a router
+ * @param dealloc called on every value, may be NULL
+ */
+void router_free(router_t* router, void (*dealloc)(void*));
+
+#endif
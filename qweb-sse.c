@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "qweb-sse.h"
+#include "static-containers.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+// Room before the event text for "<chunk size>\r\nid: <id>\n"
+#define SSE_PREFIX_MAX      (32)
+
+// Chunk trailer
+#define SSE_SUFFIX          "\r\n"
+#define SSE_SUFFIX_LEN      (2)
+
+// Largest Last-Event-ID header read
+#define SSE_LAST_ID_MAX     (16)
+
+static const char* TAG = "qweb-sse";
+
+/**
+ * @brief An event, formatted as a complete chunk of the event stream
+ */
+typedef struct sse_event {
+    struct sse_channel* channel;
+    uint32_t id;
+    const char* frame;              // start of the chunk, inside buf
+    size_t len;                     // chunk length
+    size_t text_len;                // length of the text without the id
+    char buf[];                     // [SSE_PREFIX_MAX] text [SSE_SUFFIX]
+} sse_event_t;
+
+typedef struct sse_channel {
+    const char* path;
+    httpd_handle_t httpd;
+
+    sse_event_t* ring[QWEB_SSE_RING_LEN];   // latest events, by id
+    uint32_t next_id;
+
+    int* fds;                       // sockets of the subscribed connections
+    size_t fds_cnt;
+    size_t fds_cap;
+} sse_channel_t;
+
+/**
+ * @brief Session context of a subscribed connection
+ */
+typedef struct sse_sub {
+    sse_channel_t* channel;
+    int fd;
+} sse_sub_t;
+
+typedef struct sse {
+    httpd_handle_t httpd;
+    SemaphoreHandle_t lock;         // guards the channel vector, channels are never removed
+    sse_channel_t** channels;
+    size_t channels_cnt;
+    size_t channels_cap;
+} sse_t;
+
+
+/**
+ * @brief Find a channel, with the channel vector locked
+ */
+static sse_channel_t* sse_find_locked(const sse_t* sse, const char* path, size_t path_len) {
+    STC_VEC_FOREACH(i, sse->channels) {
+        const char* cpath = sse->channels[i]->path;
+        if (strlen(cpath) == path_len && strncmp(cpath, path, path_len) == 0) {
+            return sse->channels[i];
+        }
+    }
+    return NULL;
+}
+
+static sse_channel_t* sse_find(const sse_t* sse, const char* path, size_t path_len) {
+    xSemaphoreTake(sse->lock, portMAX_DELAY);
+    sse_channel_t* channel = sse_find_locked(sse, path, path_len);
+    xSemaphoreGive(sse->lock);
+    return channel;
+}
+
+/**
+ * @brief Remove a connection from its channel when its session is closed
+ */
+static void sse_sub_free(void* ctx) {
+    sse_sub_t* sub = ctx;
+    sse_channel_t* channel = sub->channel;
+    STC_VEC_FOREACH(i, channel->fds) {
+        if (channel->fds[i] == sub->fd) {
+            STC_VEC_REMOVE(channel->fds, i)
+            break;
+        }
+    }
+    ESP_LOGI(TAG, "Event stream %d closed on %s", sub->fd, channel->path);
+    free(sub);
+}
+
+/**
+ * @brief Number the event, keep it in the ring and send it to every
+ *  subscriber. Runs in the httpd task, so nothing else touches the channel.
+ */
+static void sse_publish_work(void* arg) {
+    sse_event_t* event = arg;
+    sse_channel_t* channel = event->channel;
+
+    event->id = channel->next_id++;
+
+    // Put the chunk size and id right before the text
+    char head[SSE_PREFIX_MAX];
+    int id_len = snprintf(NULL, 0, "id: %" PRIu32 "\n", event->id);
+    int head_len = snprintf(head, sizeof(head), "%x\r\nid: %" PRIu32 "\n", (unsigned) (id_len + event->text_len), event->id);
+    char* frame = &event->buf[SSE_PREFIX_MAX - head_len];
+    memcpy(frame, head, head_len);
+    event->frame = frame;
+    event->len = head_len + event->text_len + SSE_SUFFIX_LEN;
+
+    sse_event_t** slot = &channel->ring[event->id % QWEB_SSE_RING_LEN];
+    free(*slot);
+    *slot = event;
+
+    STC_VEC_FOREACH(i, channel->fds) {
+        int fd = channel->fds[i];
+        if (httpd_socket_send(channel->httpd, fd, event->frame, event->len, 0) < 0) {
+            ESP_LOGW(TAG, "Could not send to event stream %d, closing it", fd);
+            httpd_sess_trigger_close(channel->httpd, fd);
+        }
+    }
+}
+
+/**
+ * @brief Get the id of the last event a reconnecting client received
+ */
+static bool sse_last_id(httpd_req_t* req, uint32_t* last_id) {
+    char value[SSE_LAST_ID_MAX];
+    size_t len = httpd_req_get_hdr_value_len(req, "Last-Event-ID");
+    if (len == 0 || len >= sizeof(value) ||
+        httpd_req_get_hdr_value_str(req, "Last-Event-ID", value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+    char* end;
+    unsigned long id = strtoul(value, &end, 10);
+    if (end == value || *end) {
+        return false;
+    }
+    *last_id = id;
+    return true;
+}
+
+
+sse_t* sse_init(httpd_handle_t httpd) {
+    sse_t* sse = calloc(sizeof(sse_t), 1);
+    if (!sse) {
+        return NULL;
+    }
+    sse->httpd = httpd;
+    sse->lock = xSemaphoreCreateMutex();
+    if (!sse->lock) {
+        free(sse);
+        return NULL;
+    }
+    return sse;
+}
+
+esp_err_t sse_register(sse_t* sse, const char* path) {
+    xSemaphoreTake(sse->lock, portMAX_DELAY);
+    if (sse_find_locked(sse, path, strlen(path))) {
+        xSemaphoreGive(sse->lock);
+        return ESP_OK;
+    }
+    sse_channel_t* channel = calloc(sizeof(sse_channel_t), 1);
+    if (!channel) {
+        xSemaphoreGive(sse->lock);
+        return ESP_ERR_NO_MEM;
+    }
+    channel->path = path;
+    channel->httpd = sse->httpd;
+    channel->next_id = 1;
+    STC_VEC_PUSH(sse->channels, channel);
+    xSemaphoreGive(sse->lock);
+    return ESP_OK;
+}
+
+bool sse_handle(sse_t* sse, httpd_req_t* req, const char* path, size_t path_len) {
+    sse_channel_t* channel = sse_find(sse, path, path_len);
+    if (!channel) {
+        return false;
+    }
+
+    // The first chunk sends the headers, the response is never terminated
+    httpd_resp_set_type(req, "text/event-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    if (httpd_resp_send_chunk(req, ": qweb\n\n", HTTPD_RESP_USE_STRLEN) != ESP_OK) {
+        return true;
+    }
+
+    // Replay what a reconnecting client missed. An id ahead of the
+    // channel comes from before a restart, so everything is missed.
+    uint32_t last_id;
+    if (sse_last_id(req, &last_id)) {
+        uint32_t first = last_id + 1;
+        if (last_id >= channel->next_id || channel->next_id - first > QWEB_SSE_RING_LEN) {
+            first = channel->next_id > QWEB_SSE_RING_LEN ? channel->next_id - QWEB_SSE_RING_LEN : 1;
+        }
+        for (uint32_t id = first; id != channel->next_id; id++) {
+            const sse_event_t* event = channel->ring[id % QWEB_SSE_RING_LEN];
+            if (event && event->id == id && httpd_send(req, event->frame, event->len) < 0) {
+                return true;
+            }
+        }
+    }
+
+    sse_sub_t* sub = malloc(sizeof(sse_sub_t));
+    if (!sub) {
+        return true;
+    }
+    sub->channel = channel;
+    sub->fd = httpd_req_to_sockfd(req);
+    STC_VEC_PUSH(channel->fds, sub->fd);
+
+    // Freed by the httpd along with the session
+    req->sess_ctx = sub;
+    req->free_ctx = sse_sub_free;
+
+    ESP_LOGI(TAG, "Event stream %d opened on %s", sub->fd, channel->path);
+    return true;
+}
+
+esp_err_t sse_publish(sse_t* sse, const char* path, const char* event, const char* data) {
+    // A line break would end the field and start another
+    if (event && event[strcspn(event, "\r\n")]) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sse_channel_t* channel = sse_find(sse, path, strlen(path));
+    if (!channel) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (!data) {
+        data = "";
+    }
+
+    // Every line of data gets its own field
+    size_t text_len = 1;
+    if (event) {
+        text_len += strlen("event: \n") + strlen(event);
+    }
+    for (const char* line = data; line; ) {
+        const char* nl = strchr(line, '\n');
+        size_t line_len = nl ? (size_t) (nl - line) : strlen(line);
+        text_len += strlen("data: \n") + line_len;
+        line = nl ? nl + 1 : NULL;
+    }
+
+    sse_event_t* ev = malloc(sizeof(sse_event_t) + SSE_PREFIX_MAX + text_len + SSE_SUFFIX_LEN + 1);
+    if (!ev) {
+        return ESP_ERR_NO_MEM;
+    }
+    ev->channel = channel;
+    ev->text_len = text_len;
+
+    char* text = &ev->buf[SSE_PREFIX_MAX];
+    if (event) {
+        text += sprintf(text, "event: %s\n", event);
+    }
+    for (const char* line = data; line; ) {
+        const char* nl = strchr(line, '\n');
+        size_t line_len = nl ? (size_t) (nl - line) : strlen(line);
+        text += sprintf(text, "data: %.*s\n", (int) line_len, line);
+        line = nl ? nl + 1 : NULL;
+    }
+    strcpy(text, "\n" SSE_SUFFIX);
+
+    esp_err_t err = httpd_queue_work(sse->httpd, sse_publish_work, ev);
+    if (err != ESP_OK) {
+        free(ev);
+    }
+    return err;
+}
+
+void sse_free(sse_t* sse) {
+    STC_VEC_FOREACH(i, sse->channels) {
+        sse_channel_t* channel = sse->channels[i];
+        for (size_t j = 0; j < QWEB_SSE_RING_LEN; j++) {
+            free(channel->ring[j]);
+        }
+        STC_VEC_FREE(channel->fds);
+        free(channel);
+    }
+    STC_VEC_FREE(sse->channels);
+    vSemaphoreDelete(sse->lock);
+    free(sse);
+}
@@ -0,0 +1,43 @@
+#ifndef QWEB_SSE_H
+#define QWEB_SSE_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "esp-qweb.h"
+
+/**
+ * @brief The Server-Sent Events channels of a server
+ */
+typedef struct sse sse_t;
+
+sse_t* sse_init(httpd_handle_t httpd);
+
+/**
+ * @brief Add a channel
+ * @param path channel path (not copied)
+ */
+esp_err_t sse_register(sse_t* sse, const char* path);
+
+/**
+ * @brief Open an event stream if a request is for a channel.
+ *  The connection stays subscribed to the channel after the handler returns.
+ * @returns false if the path is not a channel
+ */
+bool sse_handle(sse_t* sse, httpd_req_t* req, const char* path, size_t path_len);
+
+/**
+ * @brief Format an event and queue it to be sent from the httpd task
+ *  (from any task)
+ * @return ESP_ERR_NOT_FOUND if the channel does not exist,
+ *  ESP_ERR_INVALID_ARG if the event type contains a line break
+ */
+esp_err_t sse_publish(sse_t* sse, const char* path, const char* event, const char* data);
+
+/**
+ * @brief Free the channels, once the httpd is stopped
+ */
+void sse_free(sse_t* sse);
+
+#endif
@@ -0,0 +1,364 @@
+#include <string.h>
+#include <stdatomic.h>
+#include "qweb-table.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+// Buckets of a new table, doubled whenever there are more values than buckets
+#define TABLE_MIN_BUCKETS   (16)
+
+static const char* TAG = "qweb-table";
+
+/**
+ * @brief Something unlinked from the table, waiting for the readers
+ *  that could still see it
+ */
+typedef struct table_retired {
+    struct table_retired* next;
+    bool bucket_array;              // a whole bucket array rather than a node
+} table_retired_t;
+
+typedef struct table_node {
+    table_retired_t retired;        // first, for the retired lists
+    const char* key;
+    void* value;                    // freed with the node, unless NULL
+    _Atomic(struct table_node*) next;
+} table_node_t;
+
+typedef struct table_buckets {
+    table_retired_t retired;        // first, for the retired lists
+    size_t mask;                    // bucket count - 1
+    _Atomic(table_node_t*) heads[];
+} table_buckets_t;
+
+struct table {
+    _Atomic(table_buckets_t*) buckets;
+    size_t count;
+
+    /**
+     * Readers count themselves under the parity of the epoch they start in.
+     * Everything retired in epoch E goes on retired[E & 1], and is freed
+     * when the epoch moves from E + 1 to E + 2, which waits for the readers
+     * of epoch E to be gone. Readers starting later cannot reach it anymore.
+     */
+    atomic_uint_least32_t epoch;
+    atomic_uint_least32_t readers[2];
+    table_retired_t* retired[2];
+
+    SemaphoreHandle_t lock;         // held by writers
+    table_ops_t ops;
+};
+
+
+static size_t table_hash(const char* key, size_t len) {
+    size_t hash = 5381;
+    for (size_t i = 0; i < len; i++) {
+        hash = hash * 33 + (uint8_t) key[i];
+    }
+    return hash;
+}
+
+static table_buckets_t* table_buckets_alloc(size_t count) {
+    table_buckets_t* buckets = malloc(sizeof(table_buckets_t) + count * sizeof(buckets->heads[0]));
+    if (!buckets) {
+        return NULL;
+    }
+    buckets->retired = (table_retired_t) { .next = NULL, .bucket_array = true };
+    buckets->mask = count - 1;
+    for (size_t i = 0; i < count; i++) {
+        atomic_init(&buckets->heads[i], NULL);
+    }
+    return buckets;
+}
+
+/**
+ * @brief Free retired nodes or bucket arrays. The nodes of a bucket array are
+ *  freed with it, only nodes unlinked on their own carry a value.
+ */
+static void table_reclaim(table_retired_t* retired) {
+    while (retired) {
+        table_retired_t* next = retired->next;
+        if (retired->bucket_array) {
+            table_buckets_t* buckets = (table_buckets_t*) retired;
+            for (size_t i = 0; i <= buckets->mask; i++) {
+                table_node_t* node = atomic_load_explicit(&buckets->heads[i], memory_order_relaxed);
+                while (node) {
+                    table_node_t* node_next = atomic_load_explicit(&node->next, memory_order_relaxed);
+                    free(node);
+                    node = node_next;
+                }
+            }
+        } else {
+            table_node_t* node = (table_node_t*) retired;
+            free(node->value);
+        }
+        free(retired);
+        retired = next;
+    }
+}
+
+static void table_retire(table_t* table, table_retired_t* retired) {
+    uint32_t epoch = atomic_load(&table->epoch);
+    retired->next = table->retired[epoch & 1];
+    table->retired[epoch & 1] = retired;
+}
+
+/**
+ * @brief Move to the next epoch if the readers of the previous one are gone,
+ *  freeing what was retired before them. Called by writers.
+ */
+static bool table_advance(table_t* table) {
+    uint32_t epoch = atomic_load(&table->epoch);
+    uint32_t old = (epoch + 1) & 1;
+    if (atomic_load(&table->readers[old]) != 0) {
+        return false;
+    }
+    table_reclaim(table->retired[old]);
+    table->retired[old] = NULL;
+    atomic_store(&table->epoch, epoch + 1);
+    return true;
+}
+
+/**
+ * @brief Reclaim what no reader can see anymore, without waiting for readers.
+ *  Two epochs later, with no reader in between, everything retired is freed.
+ */
+static void table_collect(table_t* table) {
+    if ((table->retired[0] || table->retired[1]) && table_advance(table)) {
+        table_advance(table);
+    }
+}
+
+/**
+ * @brief Find where the node of a key is linked
+ * @returns the link pointing to the node, or NULL if there is no such node
+ */
+static _Atomic(table_node_t*)* table_find(table_buckets_t* buckets, const char* key) {
+    _Atomic(table_node_t*)* link = &buckets->heads[table_hash(key, strlen(key)) & buckets->mask];
+    table_node_t* node;
+    while ((node = atomic_load_explicit(link, memory_order_relaxed))) {
+        if (strcmp(node->key, key) == 0) {
+            return link;
+        }
+        link = &node->next;
+    }
+    return NULL;
+}
+
+static table_node_t* table_node_alloc(const char* key, void* value, table_node_t* next) {
+    table_node_t* node = malloc(sizeof(table_node_t));
+    if (!node) {
+        return NULL;
+    }
+    node->retired = (table_retired_t) { .next = NULL, .bucket_array = false };
+    node->key = key;
+    node->value = value;
+    atomic_init(&node->next, next);
+    return node;
+}
+
+/**
+ * @brief Publish a copy of the table with twice the buckets. Nodes cannot
+ *  be in two chains at once, so every node is copied as well.
+ */
+static void table_grow(table_t* table) {
+    table_buckets_t* old = atomic_load_explicit(&table->buckets, memory_order_relaxed);
+    table_buckets_t* grown = table_buckets_alloc((old->mask + 1) * 2);
+    if (!grown) {
+        // Lookups only get slower
+        return;
+    }
+    for (size_t i = 0; i <= old->mask; i++) {
+        table_node_t* node = atomic_load_explicit(&old->heads[i], memory_order_relaxed);
+        for (; node; node = atomic_load_explicit(&node->next, memory_order_relaxed)) {
+            _Atomic(table_node_t*)* head = &grown->heads[table_hash(node->key, strlen(node->key)) & grown->mask];
+            table_node_t* copy = table_node_alloc(node->key, node->value,
+                atomic_load_explicit(head, memory_order_relaxed));
+            if (!copy) {
+                table_reclaim(&grown->retired);
+                return;
+            }
+            atomic_store_explicit(head, copy, memory_order_relaxed);
+        }
+    }
+    atomic_store_explicit(&table->buckets, grown, memory_order_release);
+    table_retire(table, &old->retired);
+    ESP_LOGD(TAG, "Grown to %u buckets", grown->mask + 1);
+}
+
+
+table_t* table_init(const table_ops_t* ops) {
+    table_t* table = calloc(sizeof(table_t), 1);
+    if (!table) {
+        return NULL;
+    }
+    table_buckets_t* buckets = table_buckets_alloc(TABLE_MIN_BUCKETS);
+    table->lock = xSemaphoreCreateMutex();
+    if (!buckets || !table->lock) {
+        free(buckets);
+        if (table->lock) {
+            vSemaphoreDelete(table->lock);
+        }
+        free(table);
+        return NULL;
+    }
+    atomic_init(&table->buckets, buckets);
+    atomic_init(&table->epoch, 0);
+    atomic_init(&table->readers[0], 0);
+    atomic_init(&table->readers[1], 0);
+    table->ops = *ops;
+    return table;
+}
+
+void table_free(table_t* table) {
+    if (!table) {
+        return;
+    }
+    table_reclaim(table->retired[0]);
+    table_reclaim(table->retired[1]);
+
+    // The values still in the table go with their nodes
+    table_buckets_t* buckets = atomic_load(&table->buckets);
+    for (size_t i = 0; i <= buckets->mask; i++) {
+        table_node_t* node = atomic_load_explicit(&buckets->heads[i], memory_order_relaxed);
+        for (; node; node = atomic_load_explicit(&node->next, memory_order_relaxed)) {
+            free(node->value);
+        }
+    }
+    table_reclaim(&buckets->retired);
+    vSemaphoreDelete(table->lock);
+    free(table);
+}
+
+uint32_t table_read_lock(table_t* table) {
+    for (;;) {
+        uint32_t epoch = atomic_load(&table->epoch);
+        atomic_fetch_add(&table->readers[epoch & 1], 1);
+        // Counted under the parity of an epoch that ended, writers may not have seen it
+        if (atomic_load(&table->epoch) == epoch) {
+            return epoch;
+        }
+        atomic_fetch_sub(&table->readers[epoch & 1], 1);
+    }
+}
+
+void table_read_unlock(table_t* table, uint32_t token) {
+    atomic_fetch_sub(&table->readers[token & 1], 1);
+}
+
+void table_defer_free(table_t* table, void* value) {
+    xSemaphoreTake(table->lock, portMAX_DELAY);
+    // Retired like a node that held the value
+    table_node_t* node = table_node_alloc(NULL, value, NULL);
+    if (node) {
+        table_retire(table, &node->retired);
+        table_collect(table);
+    } else {
+        // Wait for the readers that could see it instead
+        for (size_t i = 0; i < 2; i++) {
+            while (!table_advance(table)) {
+                vTaskDelay(1);
+            }
+        }
+        free(value);
+    }
+    xSemaphoreGive(table->lock);
+}
+
+void* table_get(table_t* table, const char* key) {
+    return table_get_n(table, key, strlen(key));
+}
+
+void* table_get_n(table_t* table, const char* key, size_t len) {
+    table_buckets_t* buckets = atomic_load_explicit(&table->buckets, memory_order_acquire);
+    table_node_t* node = atomic_load_explicit(&buckets->heads[table_hash(key, len) & buckets->mask], memory_order_acquire);
+    for (; node; node = atomic_load_explicit(&node->next, memory_order_acquire)) {
+        if (strncmp(node->key, key, len) == 0 && node->key[len] == '\0') {
+            return node->value;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t table_insert(table_t* table, const char* key, void* value) {
+    xSemaphoreTake(table->lock, portMAX_DELAY);
+    table_buckets_t* buckets = atomic_load_explicit(&table->buckets, memory_order_relaxed);
+    _Atomic(table_node_t*)* link = table_find(buckets, key);
+    table_node_t* old = link ? atomic_load_explicit(link, memory_order_relaxed) : NULL;
+
+    // Replacing a node takes its place in the chain, a new one goes first in its bucket
+    if (!link) {
+        link = &buckets->heads[table_hash(key, strlen(key)) & buckets->mask];
+    }
+    table_node_t* node = table_node_alloc(key, value,
+        atomic_load_explicit(old ? &old->next : link, memory_order_relaxed));
+    if (!node) {
+        xSemaphoreGive(table->lock);
+        return ESP_ERR_NO_MEM;
+    }
+    atomic_store_explicit(link, node, memory_order_release);
+
+    if (old) {
+        if (table->ops.unlink) {
+            table->ops.unlink(old->value, table->ops.ctx);
+        }
+        table_retire(table, &old->retired);
+    } else if (++table->count > buckets->mask + 1) {
+        table_grow(table);
+    }
+    table_collect(table);
+    xSemaphoreGive(table->lock);
+    return ESP_OK;
+}
+
+esp_err_t table_remove(table_t* table, const char* key) {
+    xSemaphoreTake(table->lock, portMAX_DELAY);
+    _Atomic(table_node_t*)* link = table_find(atomic_load_explicit(&table->buckets, memory_order_relaxed), key);
+    if (!link) {
+        xSemaphoreGive(table->lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // Readers on the node still find the rest of the chain through it
+    table_node_t* old = atomic_load_explicit(link, memory_order_relaxed);
+    atomic_store_explicit(link, atomic_load_explicit(&old->next, memory_order_relaxed), memory_order_release);
+    if (table->ops.unlink) {
+        table->ops.unlink(old->value, table->ops.ctx);
+    }
+    table_retire(table, &old->retired);
+    table->count--;
+    table_collect(table);
+    xSemaphoreGive(table->lock);
+    return ESP_OK;
+}
+
+esp_err_t table_update(table_t* table, const char* key, void (*edit)(void* value, void* arg), void* arg) {
+    xSemaphoreTake(table->lock, portMAX_DELAY);
+    _Atomic(table_node_t*)* link = table_find(atomic_load_explicit(&table->buckets, memory_order_relaxed), key);
+    if (!link) {
+        xSemaphoreGive(table->lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    table_node_t* old = atomic_load_explicit(link, memory_order_relaxed);
+    const char* copy_key = NULL;
+    void* value = table->ops.copy(old->value, &copy_key, table->ops.ctx);
+    table_node_t* node = value ? table_node_alloc(copy_key, value, atomic_load_explicit(&old->next, memory_order_relaxed)) : NULL;
+    if (!node) {
+        free(value);
+        xSemaphoreGive(table->lock);
+        return ESP_ERR_NO_MEM;
+    }
+    edit(value, arg);
+    atomic_store_explicit(link, node, memory_order_release);
+    if (table->ops.replace) {
+        table->ops.replace(old->value, value, table->ops.ctx);
+    }
+    table_retire(table, &old->retired);
+    table_collect(table);
+    xSemaphoreGive(table->lock);
+    return ESP_OK;
+}
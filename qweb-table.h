@@ -0,0 +1,88 @@
+#ifndef QWEB_TABLE_H
+#define QWEB_TABLE_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief A hash table of values keyed by strings, read without locks.
+ *  Writers are serialized by a mutex and never change what readers can see
+ *  in place: they link new nodes, unlink old ones and publish grown tables
+ *  atomically. Whatever leaves the table is kept until every reader that
+ *  could still see it is done (epoch based reclamation), then freed.
+ *  Values are freed with free().
+ */
+typedef struct table table_t;
+
+/**
+ * @brief Called by writers, with the table locked
+ */
+typedef struct table_ops {
+    // A value left the table, replaced or removed (optional)
+    void (*unlink)(void* value, void* ctx);
+    // Duplicate a value for table_update, the copy takes over from the original.
+    // Sets key to the copy's own key, as the original's may go with it.
+    void* (*copy)(const void* value, const char** key, void* ctx);
+    // The edited copy was published in place of the original (optional)
+    void (*replace)(const void* old, void* value, void* ctx);
+    void* ctx;
+} table_ops_t;
+
+table_t* table_init(const table_ops_t* ops);
+
+/**
+ * @brief Free the table and every value, once no reader is left
+ */
+void table_free(table_t* table);
+
+/**
+ * @brief Enter a read-side section, in which values found stay valid
+ * @returns token to leave the section with (it may end in another task)
+ */
+uint32_t table_read_lock(table_t* table);
+
+void table_read_unlock(table_t* table, uint32_t token);
+
+/**
+ * @brief Free something kept outside the table but read in its read-side
+ *  sections, once the readers that could still see it are done
+ * @param value (freed with free())
+ */
+void table_defer_free(table_t* table, void* value);
+
+/**
+ * @brief Find a value, from a read-side section
+ * @returns NULL if there is none
+ */
+void* table_get(table_t* table, const char* key);
+
+/**
+ * @brief Find a value by a key that is not null terminated, such as the
+ *  path at the start of a uri, from a read-side section
+ * @returns NULL if there is none
+ */
+void* table_get_n(table_t* table, const char* key, size_t len);
+
+/**
+ * @brief Add a value, replacing any other with the same key
+ * @param key (not copied, it must live as long as the value)
+ */
+esp_err_t table_insert(table_t* table, const char* key, void* value);
+
+/**
+ * @brief Remove a value
+ * @returns ESP_ERR_NOT_FOUND if there is none with this key
+ */
+esp_err_t table_remove(table_t* table, const char* key);
+
+/**
+ * @brief Replace a value with an edited copy, readers see either one
+ *  or the other
+ * @param edit changes the copy (its key must not change)
+ * @returns ESP_ERR_NOT_FOUND if there is no value with this key
+ */
+esp_err_t table_update(table_t* table, const char* key, void (*edit)(void* value, void* arg), void* arg);
+
+#endif
@@ -0,0 +1,24 @@
+#include <string.h>
+#include "esp-qweb.h"
+
+#include "esp_log.h"
+
+static const char* TAG = "qweb-template";
+
+esp_err_t qweb_template_render(qweb_resp_writer_t* writer, const qweb_template_t* tpl, const char* uri, qweb_template_slot_cb_t cb, void* ctx) {
+    esp_err_t err = ESP_OK;
+    for (size_t i = 0; i < tpl->segment_count && err == ESP_OK; i++) {
+        const qweb_template_segment_t* seg = &tpl->segments[i];
+        // Literals larger than the writer's buffer go out directly from flash
+        if (seg->literal_len && (err = qweb_resp_write(writer, seg->literal, seg->literal_len)) != ESP_OK) {
+            break;
+        }
+        if (seg->slot < 0 || !cb) {
+            continue;
+        }
+        if ((err = cb(uri, seg->slot, writer, ctx)) != ESP_OK) {
+            ESP_LOGE(TAG, "%s: slot %s failed (%s)", uri, tpl->slot_names[seg->slot], esp_err_to_name(err));
+        }
+    }
+    return err;
+}
@@ -0,0 +1,196 @@
+#include <string.h>
+#include "qweb-ws.h"
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+
+#include "static-containers.h"
+#include "esp_log.h"
+
+// Messages up to this size are received on the httpd task stack
+#define WS_STACK_BUF        (128)
+
+static const char* TAG = "qweb-ws";
+
+struct ws_endpoint {
+    const char* path;
+    qweb_ws_handler_t handler;
+    size_t max_recvlen;
+
+    int* fds;                       // sockets of the subscribed connections
+    size_t fds_cnt;
+    size_t fds_cap;
+};
+
+/**
+ * @brief Session context of an accepted connection
+ */
+typedef struct ws_sub {
+    ws_endpoint_t* endpoint;
+    int fd;
+} ws_sub_t;
+
+/**
+ * @brief A message waiting to be sent from the httpd task
+ */
+typedef struct ws_job {
+    httpd_handle_t httpd;
+    ws_endpoint_t* endpoint;        // endpoint to broadcast to, NULL to send to fd
+    int fd;
+    bool binary;
+    size_t len;
+    char data[];
+} ws_job_t;
+
+
+/**
+ * @brief Remove a connection from its endpoint when its session is closed
+ */
+static void ws_sub_free(void* ctx) {
+    ws_sub_t* sub = ctx;
+    ws_endpoint_t* endpoint = sub->endpoint;
+    STC_VEC_FOREACH(i, endpoint->fds) {
+        if (endpoint->fds[i] == sub->fd) {
+            STC_VEC_REMOVE(endpoint->fds, i)
+            break;
+        }
+    }
+    if (!endpoint->handler.supress_log) {
+        ESP_LOGI(TAG, "WebSocket %d closed on %s", sub->fd, endpoint->path);
+    }
+    if (endpoint->handler.close) {
+        endpoint->handler.close(endpoint->path, sub->fd);
+    }
+    free(sub);
+}
+
+static void ws_send_frame(httpd_handle_t httpd, int fd, httpd_ws_frame_t* frame) {
+    if (httpd_ws_send_frame_async(httpd, fd, frame) != ESP_OK) {
+        ESP_LOGW(TAG, "Could not send to WebSocket %d, closing it", fd);
+        httpd_sess_trigger_close(httpd, fd);
+    }
+}
+
+/**
+ * @brief Send a queued message, runs in the httpd task
+ *  so the subscribers cannot change meanwhile
+ */
+static void ws_send_work(void* arg) {
+    ws_job_t* job = arg;
+    httpd_ws_frame_t frame = {
+        .final = true,
+        .fragmented = false,
+        .type = job->binary ? HTTPD_WS_TYPE_BINARY : HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t*) job->data,
+        .len = job->len
+    };
+
+    if (job->endpoint) {
+        STC_VEC_FOREACH(i, job->endpoint->fds) {
+            ws_send_frame(job->httpd, job->endpoint->fds[i], &frame);
+        }
+    } else if (httpd_ws_get_fd_info(job->httpd, job->fd) == HTTPD_WS_CLIENT_WEBSOCKET) {
+        ws_send_frame(job->httpd, job->fd, &frame);
+    } else {
+        ESP_LOGW(TAG, "Socket %d is not a WebSocket, message dropped", job->fd);
+    }
+    free(job);
+}
+
+
+ws_endpoint_t* ws_endpoint_new(const char* path, qweb_ws_handler_t handler, size_t max_recvlen) {
+    ws_endpoint_t* endpoint = calloc(sizeof(ws_endpoint_t), 1);
+    if (endpoint) {
+        endpoint->path = path;
+        endpoint->handler = handler;
+        endpoint->max_recvlen = max_recvlen;
+    }
+    return endpoint;
+}
+
+void ws_endpoint_free(void* endpoint) {
+    ws_endpoint_t* ep = endpoint;
+    STC_VEC_FREE(ep->fds);
+    free(ep);
+}
+
+esp_err_t ws_handler(httpd_req_t* req) {
+    ws_endpoint_t* endpoint = req->user_ctx;
+    int fd = httpd_req_to_sockfd(req);
+
+    // The handshake is done, subscribe the connection
+    if (req->method == HTTP_GET) {
+        if (endpoint->handler.open && endpoint->handler.open(endpoint->path, fd) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        ws_sub_t* sub = malloc(sizeof(ws_sub_t));
+        if (!sub) {
+            return ESP_ERR_NO_MEM;
+        }
+        sub->endpoint = endpoint;
+        sub->fd = fd;
+        STC_VEC_PUSH(endpoint->fds, fd);
+
+        // Freed by the httpd along with the session
+        req->sess_ctx = sub;
+        req->free_ctx = ws_sub_free;
+
+        if (!endpoint->handler.supress_log) {
+            ESP_LOGI(TAG, "WebSocket %d opened on %s", fd, endpoint->path);
+        }
+        return ESP_OK;
+    }
+
+    // Read the frame header first to learn its length
+    httpd_ws_frame_t frame = { 0 };
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (frame.len > endpoint->max_recvlen) {
+        ESP_LOGE(TAG, "WebSocket message of %ub on %s is larger than %ub", frame.len, endpoint->path, endpoint->max_recvlen);
+        return ESP_FAIL;
+    }
+
+    char stack_buf[WS_STACK_BUF];
+    char* data = frame.len < sizeof(stack_buf) ? stack_buf : malloc(frame.len + 1);
+    if (!data) {
+        return ESP_ERR_NO_MEM;
+    }
+    frame.payload = (uint8_t*) data;
+    if (frame.len) {
+        err = httpd_ws_recv_frame(req, &frame, frame.len);
+    }
+    data[frame.len] = '\0';
+
+    if (err == ESP_OK && endpoint->handler.message &&
+        (frame.type == HTTPD_WS_TYPE_TEXT || frame.type == HTTPD_WS_TYPE_BINARY)) {
+        err = endpoint->handler.message(endpoint->path, fd, data, frame.len, frame.type == HTTPD_WS_TYPE_BINARY);
+    }
+
+    if (data != stack_buf) {
+        free(data);
+    }
+    return err;
+}
+
+esp_err_t ws_send(httpd_handle_t httpd, ws_endpoint_t* endpoint, int fd, const char* data, size_t len, bool binary) {
+    // One copy, shared by every subscriber
+    ws_job_t* job = malloc(sizeof(ws_job_t) + len);
+    if (!job) {
+        return ESP_ERR_NO_MEM;
+    }
+    job->httpd = httpd;
+    job->endpoint = endpoint;
+    job->fd = fd;
+    job->binary = binary;
+    job->len = len;
+    memcpy(job->data, data, len);
+
+    esp_err_t err = httpd_queue_work(httpd, ws_send_work, job);
+    if (err != ESP_OK) {
+        free(job);
+    }
+    return err;
+}
+
+#endif
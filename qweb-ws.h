@@ -0,0 +1,42 @@
+#ifndef QWEB_WS_H
+#define QWEB_WS_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "esp-qweb.h"
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+
+/**
+ * @brief A WebSocket endpoint and its subscribed connections
+ */
+typedef struct ws_endpoint ws_endpoint_t;
+
+/**
+ * @brief Create an endpoint
+ * @param path endpoint path (not copied)
+ * @param max_recvlen largest message accepted
+ */
+ws_endpoint_t* ws_endpoint_new(const char* path, qweb_ws_handler_t handler, size_t max_recvlen);
+
+/**
+ * @brief Free an endpoint, once the httpd is stopped
+ */
+void ws_endpoint_free(void* endpoint);
+
+/**
+ * @brief Uri handler of WebSocket endpoints, its user_ctx is the endpoint
+ */
+esp_err_t ws_handler(httpd_req_t* req);
+
+/**
+ * @brief Copy a message and queue it to be sent from the httpd task
+ * @param endpoint endpoint to broadcast to, or NULL to send to fd only
+ */
+esp_err_t ws_send(httpd_handle_t httpd, ws_endpoint_t* endpoint, int fd, const char* data, size_t len, bool binary);
+
+#endif
+
+#endif
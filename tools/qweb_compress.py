@@ -0,0 +1,38 @@
+#!/usr/bin/env python
+"""
+Compress a web asset for embedding with qweb.
+
+usage: qweb_compress.py {gzip,br} <input> <output>
+
+The output is reproducible (no timestamps or names are stored),
+so unchanged assets do not cause relinking. br requires the "brotli"
+python package, there is no fallback since the variant is linked in.
+"""
+import gzip
+import sys
+
+
+def compress(encoding, data):
+    if encoding == 'gzip':
+        return gzip.compress(data, compresslevel=9, mtime=0)
+    if encoding == 'br':
+        try:
+            import brotli
+        except ImportError:
+            sys.exit('qweb: brotli compression requires the "brotli" python package')
+        return brotli.compress(data, quality=11)
+    sys.exit('qweb: unknown encoding "%s"' % encoding)
+
+
+def main():
+    if len(sys.argv) != 4:
+        sys.exit(__doc__)
+    encoding, src, dst = sys.argv[1:]
+    with open(src, 'rb') as f:
+        data = f.read()
+    with open(dst, 'wb') as f:
+        f.write(compress(encoding, data))
+
+
+if __name__ == '__main__':
+    main()
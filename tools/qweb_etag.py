@@ -0,0 +1,32 @@
+#!/usr/bin/env python
+"""
+Compute the strong entity tag of a web asset for embedding with qweb.
+
+usage: qweb_etag.py <input> <output>
+
+The tag is the quoted 64-bit FNV-1a hash of the content, the same
+one esp-qweb.c computes for files registered without a tag.
+"""
+import sys
+
+
+def etag(data):
+    h = 0xcbf29ce484222325
+    for b in bytearray(data):
+        h ^= b
+        h = (h * 0x100000001b3) & 0xffffffffffffffff
+    return '"%016x"' % h
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    src, dst = sys.argv[1:]
+    with open(src, 'rb') as f:
+        tag = etag(f.read())
+    with open(dst, 'w') as f:
+        f.write(tag)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,103 @@
+#!/usr/bin/env python
+"""
+Pack a directory of web assets into a qweb image, for a data partition.
+
+usage: qweb_image.py --dir <dir> --output <file.bin> [--size <partition size>]
+                     [--route <url>=<file>]... [--gzip] [--cache-control <value>]
+
+Files are served at the same urls as with qweb_manifest.py. The image is
+mapped and served in place by qweb_register_partition (or qweb_register_image),
+its layout is described in qweb-fs.c: a header, a table of files, then their
+strings and contents. All fields are little endian 32-bit offsets from the
+start of the image.
+"""
+import argparse
+import gzip
+import os
+import struct
+import sys
+
+from qweb_etag import etag
+from qweb_manifest import COMPRESSED_EXTS, MIME_TYPES, collect
+
+MAGIC = b'QWIM'
+VERSION = 1
+HEADER = struct.Struct('<4sIII')
+FILE = struct.Struct('<IIIIIIII')
+
+
+class Image(object):
+    def __init__(self, file_count):
+        self.data = bytearray(HEADER.size + FILE.size * file_count)
+        self.strings = {}
+
+    def align(self):
+        self.data += b'\0' * (-len(self.data) % 4)
+
+    def add_string(self, s):
+        if s not in self.strings:
+            self.strings[s] = len(self.data)
+            self.data += s.encode() + b'\0'
+        return self.strings[s]
+
+    def add_blob(self, blob):
+        self.align()
+        offset = len(self.data)
+        self.data += blob
+        return offset
+
+
+def parse_size(value):
+    return int(value, 0)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--dir', required=True)
+    parser.add_argument('--output', required=True)
+    parser.add_argument('--size', type=parse_size)
+    parser.add_argument('--route', action='append', default=[])
+    parser.add_argument('--gzip', action='store_true')
+    parser.add_argument('--cache-control')
+    args = parser.parse_args()
+
+    files, urls = collect(args.dir, args.route)
+    if not urls:
+        sys.exit('qweb: no files in %s' % args.dir)
+
+    keys = sorted(urls)
+    image = Image(len(keys))
+
+    # File contents, shared by all the urls of a file
+    content = {}
+    for rel in sorted(files):
+        with open(files[rel], 'rb') as f:
+            data = f.read()
+        offset = image.add_blob(data)
+        gz_offset, gz_length = 0, 0
+        if args.gzip and not rel.lower().endswith(COMPRESSED_EXTS):
+            gz = gzip.compress(data, compresslevel=9, mtime=0)
+            if len(gz) < len(data):
+                gz_offset, gz_length = image.add_blob(gz), len(gz)
+        content[rel] = (offset, len(data), gz_offset, gz_length, etag(data))
+
+    cache_control = image.add_string(args.cache_control) if args.cache_control else 0
+    for i, url in enumerate(keys):
+        rel = urls[url]
+        offset, length, gz_offset, gz_length, tag = content[rel]
+        mime = MIME_TYPES.get(os.path.splitext(rel)[1].lower(), 'application/octet-stream')
+        FILE.pack_into(image.data, HEADER.size + FILE.size * i,
+                       image.add_string(url), image.add_string(mime), image.add_string(tag),
+                       cache_control, offset, length, gz_offset, gz_length)
+
+    image.align()
+    HEADER.pack_into(image.data, 0, MAGIC, VERSION, len(keys), len(image.data))
+    if args.size is not None and len(image.data) > args.size:
+        sys.exit('qweb: the image takes %d bytes, the partition only holds %d' % (len(image.data), args.size))
+
+    with open(args.output, 'wb') as f:
+        f.write(image.data)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,176 @@
+#!/usr/bin/env python
+"""
+Generate a flash-resident route manifest for qweb.
+
+usage: qweb_manifest.py --name <name> --dir <dir> --output <file.c>
+                        [--route <url>=<file>]... [--gzip] [--cache-control <value>]
+
+Every file below <dir> is served at "/<relative path>", index.html files also
+at their directory ("/" for the top level one), and each --route adds another
+url for a file. The output defines `const qweb_manifest_t qweb_manifest_<name>`,
+holding the file contents, their ETags (see qweb_etag.py) and optionally gzip
+variants, indexed by a minimal perfect hash (hash and displace, matching
+manifest_hash() in esp-qweb.c).
+"""
+import argparse
+import gzip
+import os
+import sys
+
+from qweb_etag import etag
+
+MIME_TYPES = {
+    '.html': 'text/html', '.htm': 'text/html', '.css': 'text/css',
+    '.js': 'application/javascript', '.mjs': 'application/javascript',
+    '.json': 'application/json', '.xml': 'application/xml', '.txt': 'text/plain',
+    '.png': 'image/png', '.jpg': 'image/jpeg', '.jpeg': 'image/jpeg', '.gif': 'image/gif',
+    '.bmp': 'image/bmp', '.svg': 'image/svg+xml', '.webp': 'image/webp', '.avif': 'image/avif',
+    '.ico': 'image/x-icon', '.pdf': 'application/pdf', '.zip': 'application/zip',
+    '.gz': 'application/gzip', '.tar': 'application/x-tar', '.mp3': 'audio/mpeg',
+    '.wav': 'audio/wav', '.ogg': 'audio/ogg', '.mp4': 'video/mp4', '.webm': 'video/webm',
+    '.csv': 'text/csv', '.ttf': 'font/ttf', '.woff': 'font/woff', '.woff2': 'font/woff2',
+    '.wasm': 'application/wasm',
+}
+
+# Compressing these again does not help
+COMPRESSED_EXTS = ('.png', '.jpg', '.jpeg', '.gif', '.webp', '.avif', '.zip', '.gz',
+                   '.mp3', '.ogg', '.mp4', '.webm', '.woff', '.woff2')
+
+MASK32 = 0xffffffff
+
+
+def manifest_hash(key, seed):
+    h = (0x811c9dc5 ^ seed) & MASK32
+    for b in bytearray(key):
+        h ^= b
+        h = (h * 0x01000193) & MASK32
+    return h
+
+
+def perfect_hash(keys):
+    """Find per-bucket seeds placing every key in its own slot"""
+    n = len(keys)
+    nbuckets = max(1, (n + 1) // 2)
+    buckets = [[] for _ in range(nbuckets)]
+    for i, key in enumerate(keys):
+        buckets[manifest_hash(key, 0) % nbuckets].append(i)
+
+    seeds = [0] * nbuckets
+    slots = [None] * n
+    for b in sorted(range(nbuckets), key=lambda b: -len(buckets[b])):
+        if not buckets[b]:
+            continue
+        seed = 1
+        while True:
+            placed = [manifest_hash(keys[i], seed) % n for i in buckets[b]]
+            if len(set(placed)) == len(placed) and all(slots[p] is None for p in placed):
+                break
+            seed += 1
+        seeds[b] = seed
+        for i, p in zip(buckets[b], placed):
+            slots[p] = i
+    return seeds, slots
+
+
+def c_string(data):
+    lines = []
+    for i in range(0, len(data), 32):
+        lines.append('    "' + ''.join('\\x%02x' % b for b in bytearray(data[i:i + 32])) + '"')
+    return '\n'.join(lines) if lines else '    ""'
+
+
+def c_quote(s):
+    return '"' + s.replace('\\', '\\\\').replace('"', '\\"') + '"'
+
+
+def collect(root, routes):
+    files = {}
+    for dirpath, _, names in os.walk(root):
+        for name in sorted(names):
+            rel = os.path.relpath(os.path.join(dirpath, name), root).replace(os.sep, '/')
+            files[rel] = os.path.join(dirpath, name)
+
+    urls = {}
+    for rel in sorted(files):
+        urls['/' + rel] = rel
+        if rel == 'index.html' or rel.endswith('/index.html'):
+            urls['/' + rel[:-len('index.html')]] = rel
+    for route in routes:
+        url, _, rel = route.partition('=')
+        if rel not in files:
+            sys.exit('qweb: route %s refers to missing file %s' % (url, rel))
+        urls[url] = rel
+    return files, urls
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--name', required=True)
+    parser.add_argument('--dir', required=True)
+    parser.add_argument('--output', required=True)
+    parser.add_argument('--route', action='append', default=[])
+    parser.add_argument('--gzip', action='store_true')
+    parser.add_argument('--cache-control')
+    args = parser.parse_args()
+
+    files, urls = collect(args.dir, args.route)
+    if not urls:
+        sys.exit('qweb: no files in %s' % args.dir)
+
+    out = ['/* Generated by qweb_manifest.py, do not edit */',
+           '#include "esp-qweb.h"', '']
+
+    # File contents, shared by all the urls of a file
+    content = {}
+    for i, rel in enumerate(sorted(files)):
+        with open(files[rel], 'rb') as f:
+            data = f.read()
+        ident = 'qweb_mf_%s_%d' % (args.name, i)
+        out.append('// %s' % rel)
+        out.append('static const char %s[] =\n%s;' % (ident, c_string(data)))
+        gz_ident = None
+        if args.gzip and not rel.lower().endswith(COMPRESSED_EXTS):
+            gz = gzip.compress(data, compresslevel=9, mtime=0)
+            if len(gz) < len(data):
+                gz_ident = ident + '_gz'
+                out.append('static const char %s[] =\n%s;' % (gz_ident, c_string(gz)))
+                content[rel] = (ident, len(data), gz_ident, len(gz), etag(data))
+        if not gz_ident:
+            content[rel] = (ident, len(data), None, 0, etag(data))
+        out.append('')
+
+    keys = sorted(urls)
+    seeds, slots = perfect_hash([k.encode() for k in keys])
+
+    out.append('static const qweb_manifest_file_t qweb_mf_%s_files[] = {' % args.name)
+    for slot in slots:
+        url = keys[slot]
+        rel = urls[url]
+        ident, length, gz_ident, gz_length, tag = content[rel]
+        mime = MIME_TYPES.get(os.path.splitext(rel)[1].lower(), 'application/octet-stream')
+        out.append('    { .path = %s, .type = %s, .content = %s, .content_length = %d, '
+                   '.gz_content = %s, .gz_length = %d, .etag = %s, .cache_control = %s },' % (
+                       c_quote(url), c_quote(mime), ident, length,
+                       gz_ident or 'NULL', gz_length, c_quote(tag),
+                       c_quote(args.cache_control) if args.cache_control else 'NULL'))
+    out.append('};')
+    out.append('')
+    out.append('static const uint32_t qweb_mf_%s_seeds[] = {' % args.name)
+    for i in range(0, len(seeds), 8):
+        out.append('    ' + ' '.join('%du,' % s for s in seeds[i:i + 8]))
+    out.append('};')
+    out.append('')
+    out.append('const qweb_manifest_t qweb_manifest_%s = {' % args.name)
+    out.append('    .files = qweb_mf_%s_files,' % args.name)
+    out.append('    .file_count = %d,' % len(slots))
+    out.append('    .seeds = qweb_mf_%s_seeds,' % args.name)
+    out.append('    .bucket_count = %d,' % len(seeds))
+    out.append('};')
+    out.append('')
+
+    with open(args.output, 'w') as f:
+        f.write('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,118 @@
+#!/usr/bin/env python
+"""
+Minify a script for embedding with qweb, e.g. content/qweb.js into content/qweb.min.js.
+
+usage: qweb_minify.py <input> <output>
+
+Comments and indentation are dropped, and whitespace is kept only where it
+separates tokens. Line breaks stay where a statement may end without a
+semicolon. Names are left alone, so the output behaves exactly as the input.
+Template literals must not nest other template literals.
+"""
+import re
+import sys
+
+# Characters of identifiers, keywords and numbers
+WORD = re.compile(r'[A-Za-z0-9_$\\]')
+
+# A line break after these cannot end a statement
+CONTINUES = set('{([,;:=<>+-*/%&|^!~?.')
+
+# Nor before these
+CONTINUED = set('{}()[],;:=<>*/%&|^?.')
+
+# Keywords after which a '/' starts a regular expression
+REGEX_KEYWORDS = {'return', 'typeof', 'instanceof', 'in', 'of', 'new', 'delete', 'void', 'throw', 'case', 'do', 'else'}
+
+
+def regex_allowed(out):
+    """Whether a '/' following the output so far starts a regular expression"""
+    text = ''.join(out).rstrip()
+    if not text:
+        return True
+    if text[-1] in ')]}' or WORD.match(text[-1]):
+        word = re.search(r'[A-Za-z_$][A-Za-z0-9_$]*$', text)
+        return bool(word) and word.group() in REGEX_KEYWORDS
+    return True
+
+
+def skip_quoted(src, i):
+    """Index after the string, template or regular expression literal starting at i"""
+    quote = src[i]
+    i += 1
+    in_class = False
+    while i < len(src):
+        c = src[i]
+        if c == '\\':
+            i += 2
+            continue
+        if quote == '/' and c == '[':
+            in_class = True
+        elif quote == '/' and c == ']':
+            in_class = False
+        elif c == quote and not in_class:
+            i += 1
+            if quote == '/':
+                # Flags
+                while i < len(src) and WORD.match(src[i]):
+                    i += 1
+            return i
+        elif c == '\n' and quote in '\'"/':
+            sys.exit('qweb: unterminated literal')
+        i += 1
+    sys.exit('qweb: unterminated literal')
+
+
+def minify(src):
+    out = []
+    i = 0
+    # Whitespace seen since the last token: None, ' ' or '\n'
+    gap = None
+    while i < len(src):
+        c = src[i]
+        if c in ' \t\r\n':
+            gap = '\n' if c == '\n' or gap == '\n' else ' '
+            i += 1
+            continue
+        if src.startswith('//', i):
+            end = src.find('\n', i)
+            i = len(src) if end < 0 else end
+            continue
+        if src.startswith('/*', i):
+            end = src.find('*/', i + 2)
+            if end < 0:
+                sys.exit('qweb: unterminated comment')
+            i = end + 2
+            gap = gap or ' '
+            continue
+
+        if gap and out:
+            prev = out[-1][-1]
+            postfix = len(out) > 1 and out[-2] + out[-1] in ('++', '--')
+            if gap == '\n' and (prev not in CONTINUES or postfix) and c not in CONTINUED:
+                out.append('\n')
+            elif (WORD.match(prev) and WORD.match(c)) or (prev in '+-' and c == prev):
+                out.append(' ')
+        gap = None
+
+        if c in '\'"`' or (c == '/' and regex_allowed(out)):
+            end = skip_quoted(src, i)
+        else:
+            end = i + 1
+        out.append(src[i:end])
+        i = end
+    return ''.join(out) + '\n'
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    src, dst = sys.argv[1:]
+    with open(src, encoding='utf-8') as f:
+        text = f.read()
+    with open(dst, 'w', encoding='utf-8', newline='\n') as f:
+        f.write(minify(text))
+
+
+if __name__ == '__main__':
+    main()
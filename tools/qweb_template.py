@@ -0,0 +1,109 @@
+#!/usr/bin/env python
+"""
+Compile a page template for qweb.
+
+usage: qweb_template.py --name <name> --input <template> --output <file.c> --header <file.h>
+
+Slots are written {{name}} (letters, digits and underscores, spaces around
+the name are allowed), everything else is literal. The output defines
+`const qweb_template_t qweb_template_<name>`: the literal segments as const
+data, each followed by the id of the slot after it, so that nothing is
+parsed when a page is rendered. A slot used several times keeps its id.
+The header numbers the slots as <NAME>_SLOT_<SLOT>, in order of first use,
+for the slot callback to switch on, followed by <NAME>_SLOT_COUNT. Slot
+names must stay distinct in upper case, and cannot be "count".
+"""
+import argparse
+import os
+import re
+import sys
+
+from qweb_manifest import MIME_TYPES, c_string, c_quote
+
+SLOT = re.compile(rb'\{\{\s*([A-Za-z_][A-Za-z0-9_]*)\s*\}\}')
+
+# qweb_template_segment_t.slot of the last segment
+NO_SLOT = -1
+
+
+def compile_template(data):
+    """Split a template into (literal, slot id) segments and slot names"""
+    segments = []
+    slots = []
+    pos = 0
+    for match in SLOT.finditer(data):
+        name = match.group(1).decode()
+        if name not in slots:
+            slots.append(name)
+        segments.append((data[pos:match.start()], slots.index(name)))
+        pos = match.end()
+    segments.append((data[pos:], NO_SLOT))
+    return segments, slots
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--name', required=True)
+    parser.add_argument('--input', required=True)
+    parser.add_argument('--output', required=True)
+    parser.add_argument('--header', required=True)
+    args = parser.parse_args()
+
+    if not re.match(r'^[A-Za-z_][A-Za-z0-9_]*$', args.name):
+        sys.exit('qweb: template name %s is not a C identifier' % args.name)
+    with open(args.input, 'rb') as f:
+        segments, slots = compile_template(f.read())
+    seen = {'COUNT': 'COUNT'}
+    for slot in slots:
+        if slot.upper() in seen:
+            sys.exit('qweb: slot %s of %s collides with %s_SLOT_%s' % (
+                slot, args.input, args.name.upper(), seen[slot.upper()]))
+        seen[slot.upper()] = slot.upper()
+    mime = MIME_TYPES.get(os.path.splitext(args.input)[1].lower(), 'text/plain')
+
+    guard = 'QWEB_TEMPLATE_%s_H' % args.name.upper()
+    hdr = ['/* Generated by qweb_template.py, do not edit */',
+           '#ifndef %s' % guard, '#define %s' % guard, '',
+           '#include "esp-qweb.h"', '',
+           'extern const qweb_template_t qweb_template_%s;' % args.name, '',
+           'enum {']
+    for i, slot in enumerate(slots):
+        hdr.append('    %s_SLOT_%s = %d,' % (args.name.upper(), slot.upper(), i))
+    hdr.append('    %s_SLOT_COUNT = %d,' % (args.name.upper(), len(slots)))
+    hdr += ['};', '', '#endif', '']
+
+    out = ['/* Generated by qweb_template.py, do not edit */',
+           '#include "esp-qweb.h"', '']
+    for i, (literal, _) in enumerate(segments):
+        out.append('static const char qweb_tpl_%s_%d[] =\n%s;' % (args.name, i, c_string(literal)))
+    out.append('')
+    out.append('static const qweb_template_segment_t qweb_tpl_%s_segments[] = {' % args.name)
+    for i, (literal, slot) in enumerate(segments):
+        out.append('    { .literal = qweb_tpl_%s_%d, .literal_len = %d, .slot = %d },' % (
+            args.name, i, len(literal), slot))
+    out.append('};')
+    out.append('')
+    out.append('static const char* const qweb_tpl_%s_slots[] = {' % args.name)
+    for slot in slots:
+        out.append('    %s,' % c_quote(slot))
+    if not slots:
+        out.append('    NULL')
+    out.append('};')
+    out.append('')
+    out.append('const qweb_template_t qweb_template_%s = {' % args.name)
+    out.append('    .segments = qweb_tpl_%s_segments,' % args.name)
+    out.append('    .segment_count = %d,' % len(segments))
+    out.append('    .slot_names = qweb_tpl_%s_slots,' % args.name)
+    out.append('    .slot_count = %d,' % len(slots))
+    out.append('    .type = %s,' % c_quote(mime))
+    out.append('};')
+    out.append('')
+
+    with open(args.output, 'w') as f:
+        f.write('\n'.join(out))
+    with open(args.header, 'w') as f:
+        f.write('\n'.join(hdr))
+
+
+if __name__ == '__main__':
+    main()